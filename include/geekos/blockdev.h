@@ -36,29 +36,112 @@ struct Block_Request;
 
 /*
  * List of block I/O requests.
+ * Block_Request_List holds requests in dispatch order,
+ * Block_Request_Fifo holds them in order of deadline.
  */
 DEFINE_LIST(Block_Request_List, Block_Request);
+DEFINE_LIST(Block_Request_Fifo, Block_Request);
+
+/*
+ * Maximum number of blocks that may be coalesced
+ * into a single chain of merged requests.
+ */
+#define BLOCK_MAX_MERGE_BLOCKS 256
+
+/*
+ * Number of preallocated requests per block device.
+ */
+#define BLOCK_REQUEST_POOL_SIZE 32
 
 /*
  * An I/O request for a block device.
+ * A request transfers numBlocks consecutive blocks to or from buf.
+ * Requests for adjacent blocks may be merged by the I/O scheduler:
+ * the first request of such a chain is dispatched to the driver,
+ * and the others follow it via mergeNext.
+ * Requests come from the device's request pool (Create_Request),
+ * or live in storage owned by the caller (Init_Request).
  */
 struct Block_Request {
     struct Block_Device *dev;
     enum Request_Type type;
     int blockNum;
+    int numBlocks;
     void *buf;
     volatile enum Request_State state;
     volatile int errorCode;
     struct Thread_Queue waitQueue;
+    bool pooled;
+
+    /* Chain of requests merged behind this one (valid in the chain head) */
+    struct Block_Request *mergeNext, *mergeTail;
+    int mergeBlocks;
+
+    /* Tick by which the deadline scheduler must dispatch the request */
+    ulong_t deadline;
+
+    /* Cycle counter when the request was posted */
+    unsigned long long postCycles;
 
     DEFINE_LINK(Block_Request_List, Block_Request);
+    DEFINE_LINK(Block_Request_Fifo, Block_Request);
 };
 
 IMPLEMENT_LIST(Block_Request_List, Block_Request);
+IMPLEMENT_LIST(Block_Request_Fifo, Block_Request);
+
+struct Block_Scheduler;
+
+/*
+ * Queue of pending requests for a block device driver.
+ * A driver may share one queue between several units;
+ * the I/O scheduler orders requests by (unit, blockNum).
+ */
+struct Block_Request_Queue {
+    struct Block_Request_List requestList;	/* requests in dispatch order */
+    struct Block_Request_Fifo fifo;		/* requests in deadline order */
+    struct Block_Scheduler *sched;
+    int headUnit;				/* unit of last dispatched request */
+    int headBlock;				/* block following last dispatched request */
+};
+
+/*
+ * An I/O scheduler.
+ * Add_Request inserts a (non-merged) request into the dispatch list,
+ * Next_Request chooses the request to be dispatched next
+ * without removing it.  Both are called with interrupts disabled.
+ */
+struct Block_Scheduler {
+    const char *name;
+    void (*Add_Request)(struct Block_Request_Queue *queue, struct Block_Request *request);
+    struct Block_Request *(*Next_Request)(struct Block_Request_Queue *queue);
+};
 
 struct Block_Device;
 struct Block_Device_Ops;
 
+/*
+ * Number of buckets of the request latency histogram.
+ * Bucket i counts requests that took less than 2^(i+1) microseconds
+ * (and at least 2^i, for i > 0); the last bucket also counts all
+ * slower requests.
+ */
+#define BLOCK_LATENCY_BUCKETS 24
+
+/*
+ * I/O statistics of a block device.
+ * Updated with interrupts disabled.
+ */
+struct Block_Device_Stats {
+    ulong_t reads, writes;			/* requests posted */
+    ulong_t blocksRead, blocksWritten;
+    ulong_t errors;
+    int queueDepth;				/* requests posted but not completed */
+    int maxQueueDepth;
+    ulong_t totalLatency;			/* microseconds, of completed requests */
+    ulong_t latencyHist[BLOCK_LATENCY_BUCKETS];
+};
+
 /*
  * A block device.
  */
@@ -69,18 +152,28 @@ struct Block_Device {
     bool inUse;
     void *driverData;
     struct Thread_Queue *waitQueue;
-    struct Block_Request_List *requestQueue;
+    struct Block_Request_Queue *requestQueue;
+
+    /* Preallocated requests, and the list of those not in use */
+    struct Block_Request *requestPool;
+    struct Block_Request_List freeRequests;
+
+    struct Block_Device_Stats stats;
 
     DEFINE_LINK(Block_Device_List, Block_Device);
 };
 
 /*
  * Operations that may be requested on block devices.
+ * Transfer moves the whole range of blocks covered by a request
+ * and the requests merged behind it (blockNum up to
+ * blockNum + mergeBlocks), returning 0 or an error code.
  */
 struct Block_Device_Ops {
     int (*Open)(struct Block_Device *dev);
     int (*Close)(struct Block_Device *dev);
     int (*Get_Num_Blocks)(struct Block_Device *dev);
+    int (*Transfer)(struct Block_Device *dev, struct Block_Request *request);
 };
 
 /*
@@ -89,13 +182,20 @@ struct Block_Device_Ops {
  */
 int Register_Block_Device(const char *name, struct Block_Device_Ops *ops,
     int unit, void *driverData, struct Thread_Queue *waitQueue,
-    struct Block_Request_List *requestQueue);
+    struct Block_Request_Queue *requestQueue);
 int Open_Block_Device(const char *name, struct Block_Device **pDev);
 int Close_Block_Device(struct Block_Device *dev);
+void Init_Block_Request_Queue(struct Block_Request_Queue *requestQueue);
+int Set_Block_Scheduler(struct Block_Request_Queue *requestQueue, const char *schedName);
+void Init_Request(struct Block_Request *request, struct Block_Device *dev,
+    enum Request_Type type, int blockNum, int numBlocks, void *buf);
 struct Block_Request *Create_Request(struct Block_Device *dev, enum Request_Type type,
-    int blockNum, void *buf);
+    int blockNum, int numBlocks, void *buf);
+void Free_Request(struct Block_Request *request);
+void Post_Request(struct Block_Request *request);
+int Wait_For_Request(struct Block_Request *request);
 void Post_Request_And_Wait(struct Block_Request *request);
-struct Block_Request *Dequeue_Request(struct Block_Request_List *requestQueue,
+struct Block_Request *Dequeue_Request(struct Block_Request_Queue *requestQueue,
     struct Thread_Queue *waitQueue);
 void Notify_Request_Completion(struct Block_Request *request, enum Request_State state, int errorCode);
 
@@ -105,7 +205,11 @@ void Notify_Request_Completion(struct Block_Request *request, enum Request_State
  */
 int Block_Read(struct Block_Device *dev, int blockNum, void *buf);
 int Block_Write(struct Block_Device *dev, int blockNum, void *buf);
+int Block_Read_Multiple(struct Block_Device *dev, int blockNum, int numBlocks, void *buf);
+int Block_Write_Multiple(struct Block_Device *dev, int blockNum, int numBlocks, void *buf);
 int Get_Num_Blocks(struct Block_Device *dev);
+int Set_IO_Scheduler(const char *devName, const char *schedName);
+void Dump_Block_Device_Info(void);
 
 /*
  * Misc. routines
@@ -15,6 +15,7 @@
 #include <geekos/synch.h>
 
 struct Block_Device;
+struct Block_Request;
 
 /*
  * Bits for FS_Buffer flags.
@@ -39,6 +40,7 @@ struct FS_Buffer {
     ulong_t fsBlockNum;		/*!< Filesystem block number. */
     void *data;			/*!< In-memory data of block. May be out of sync with disk. */
     uint_t flags;		/*!< Flags representing state of buffer. */
+    struct Block_Request *request;	/*!< Pending writeback request, if any. */
     DEFINE_LINK(FS_Buffer_List, FS_Buffer);
 };
 
@@ -55,8 +57,8 @@ struct FS_Buffer_Cache {
     uint_t fsBlockSize;			/*!< Size of filesystem blocks. */
     uint_t numCached;			/*!< Current number of buffers (cached blocks). */
     struct FS_Buffer_List bufferList;	/*!< List of buffers. */
-    struct Mutex lock;			/*!< Lock for synchronization. */
-    struct Condition cond;		/*!< Condition: waiting for a buffer. */
+    struct RW_Lock lock;		/*!< Read: lookups, write: list changes and I/O. */
+    struct Thread_Queue waitQueue;	/*!< Threads waiting for a buffer in use. */
 };
 
 struct FS_Buffer_Cache *Create_FS_Buffer_Cache(struct Block_Device *dev, uint_t fsBlockSize);
@@ -0,0 +1,26 @@
+/*
+ * Fast user-space synchronization (futexes)
+ *
+ * This is free software.  You are permitted to use,
+ * redistribute, and modify it as specified in the file "COPYING".
+ */
+
+#ifndef GEEKOS_FUTEX_H
+#define GEEKOS_FUTEX_H
+
+/*
+ * Futex operations.
+ */
+#define FUTEX_WAIT	0	/* wait while the word holds a value */
+#define FUTEX_WAKE	1	/* wake up to a number of waiters */
+
+#ifdef GEEKOS
+
+#include <geekos/ktypes.h>
+
+int Futex_Wait(ulong_t uaddr, int val);
+int Futex_Wake(ulong_t uaddr, int count);
+
+#endif  /* GEEKOS */
+
+#endif  /* GEEKOS_FUTEX_H */
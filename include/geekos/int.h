@@ -126,6 +126,15 @@ do {					\
     __Enable_Interrupts();		\
 } while (0)
 
+/*
+ * Stop the processor until the next interrupt.
+ */
+#define Wait_For_Interrupt()		\
+do {					\
+    KASSERT(Interrupts_Enabled());	\
+    __asm__ __volatile__ ("hlt");	\
+} while (0)
+
 /*
  * Dump interrupt state struct to screen
  */
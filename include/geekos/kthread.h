@@ -33,29 +33,23 @@ DEFINE_LIST(Thread_Queue, Kernel_Thread);
  */
 DEFINE_LIST(All_Thread_List, Kernel_Thread);
 
-#define MAX_SEM 20
-#define MAX_SEM_NAME 25
-
-
 /*
- * List of semaphores for one thread
+ * List of threads in the EDF real-time class.
  */
-DEFINE_LIST(Thread_Semaphore_List, ThreadsSemaphore);
+DEFINE_LIST(Edf_Thread_List, Kernel_Thread);
 
 /*
- * define a list for threads waiting on a semaphore
+ * List of mutexes held by a thread.
  */
+struct Mutex;
+DEFINE_LIST(Mutex_List, Mutex);
 
-struct Semaphore
-{
-    int sem_id; // starts at 1..N = MAX_SEM, 0 = free semaphore
-    int registered_users; // users registerd on that semaphore
-    int sem_count; // count value of the semaphore
-    char sem_name[MAX_SEM_NAME]; // name of the semaphore
-    struct Thread_Queue semQueue;
-};
+/*
+ * List of semaphores for one thread
+ */
+DEFINE_LIST(Thread_Semaphore_List, ThreadsSemaphore);
 
-struct Semaphore g_semaphores[MAX_SEM];
+struct Semaphore;
 
 struct ThreadsSemaphore
 {
@@ -64,6 +58,44 @@ struct ThreadsSemaphore
 };
 
 
+/*
+ * What a thread waits for.  Blocked time is accounted per reason,
+ * since most wait queues (those of requests, futex waiters or
+ * threads) are too short-lived to keep statistics for.
+ */
+enum Wait_Reason {
+    WAIT_OTHER = 0,
+    WAIT_MUTEX,
+    WAIT_CONDITION,
+    WAIT_RW_LOCK,
+    WAIT_SEMAPHORE,
+    WAIT_FUTEX,
+    WAIT_JOIN,
+    WAIT_SLEEP,
+    WAIT_BLOCK_IO,		/* block requests and busy buffers */
+    WAIT_DEVICE,		/* driver threads waiting for work or interrupts */
+    WAIT_KEYBOARD,
+    WAIT_PIPE,			/* pipes and message queues */
+    WAIT_WORK_QUEUE,		/* idle work queue threads */
+    NUM_WAIT_REASONS
+};
+
+/*
+ * Scheduling statistics of a thread.  Times are in microseconds.
+ */
+struct Thread_Sched_Stats {
+    ulong_t cpuTicks;			/* ticks spent running */
+    ulong_t runs;			/* times chosen to run */
+    ulong_t totalRunLatency;		/* time runnable before running */
+    ulong_t maxRunLatency;
+    ulong_t switches;			/* times switched away from */
+    ulong_t voluntarySwitches;		/* ... by waiting, yielding or exiting */
+    ulong_t blockedTime;		/* time spent in Wait() */
+    unsigned long long readyCycles;	/* when last made runnable */
+    unsigned long long blockCycles;	/* when it last started waiting */
+    int waitReason;			/* what it waits for */
+};
+
 /*
  * Kernel thread context data structure.
  * NOTE: there is assembly code in lowlevel.asm that depends
@@ -77,6 +109,7 @@ struct Kernel_Thread {
     DEFINE_LINK(Thread_Queue, Kernel_Thread);
     void* stackPage;
     struct User_Context* userContext;
+    int userStackSlot;			/* stack slot in a shared user context */
     struct Kernel_Thread* owner;
     int refCount;
 
@@ -88,6 +121,12 @@ struct Kernel_Thread {
     /* The kernel thread id; also used as process id */
     int pid;
 
+    /* Name shown in the process list for a kernel thread, or null */
+    const char* name;
+
+    /* Next thread in the same pid hash bucket */
+    struct Kernel_Thread* pidHashNext;
+
     /* Link fields for list of all threads in the system. */
     DEFINE_LINK(All_Thread_List, Kernel_Thread);
 
@@ -102,6 +141,53 @@ struct Kernel_Thread {
     int currentReadyQueue;
     bool blocked;
 
+    /* Level of the run queue the thread is on (valid while runnable) */
+    int runLevel;
+
+    /* Tick at which the thread was last put on the run queue */
+    ulong_t readyTime;
+
+    /* Part of the run queue the thread is on (0 if not runnable) */
+    int runClass;
+
+    /*
+     * Real-time scheduling class (RT_NONE, RT_FIFO or RT_EDF),
+     * FIFO priority, and EDF period, budget, current deadline and
+     * budget used in the current period (all in ticks).
+     */
+    int rtClass;
+    int rtPriority;
+    ulong_t rtPeriod;
+    ulong_t rtBudget;
+    ulong_t rtDeadline;
+    ulong_t rtUsed;
+
+    /* Link fields for the list of EDF threads */
+    DEFINE_LINK(Edf_Thread_List, Kernel_Thread);
+
+    struct Thread_Sched_Stats schedStats;
+
+    /*
+     * Weighted virtual runtime for the fair policy, and the
+     * position in the fair run queue heap (0 if not in the heap).
+     */
+    ulong_t vruntime;
+    int runIndex;
+
+    /*
+     * Saved x87/SSE register state (FPU_STATE_SIZE bytes), allocated
+     * the first time the thread uses the FPU.
+     */
+    uchar_t* fpuState;
+
+    /*
+     * Priority without priority inheritance, the mutex the thread
+     * waits for, and the mutexes it holds (see synch.c).
+     */
+    int basePriority;
+    struct Mutex* waitingMutex;
+    struct Mutex_List heldMutexes;
+
     struct Thread_Semaphore_List SemaphoreList;
 };
 
@@ -110,6 +196,7 @@ struct Kernel_Thread {
  */
 IMPLEMENT_LIST(Thread_Queue, Kernel_Thread);
 IMPLEMENT_LIST(All_Thread_List, Kernel_Thread);
+IMPLEMENT_LIST(Edf_Thread_List, Kernel_Thread);
 IMPLEMENT_LIST(Thread_Semaphore_List, ThreadsSemaphore);
 
 
@@ -122,6 +209,21 @@ static __inline__ void Remove_Thread(struct Thread_Queue *queue, struct Kernel_T
     Remove_From_Thread_Queue(queue, kthread);
 }
 
+/*
+ * Put a thread in a queue ordered by priority, behind threads of
+ * equal or higher priority.  Scans from the back, since threads
+ * usually have the same priority.
+ */
+static __inline__ void Enqueue_Thread_By_Priority(struct Thread_Queue *queue, struct Kernel_Thread *kthread) {
+    struct Kernel_Thread *pos = Get_Back_Of_Thread_Queue(queue);
+    while (pos != 0 && pos->priority < kthread->priority)
+	pos = Get_Prev_In_Thread_Queue(pos);
+    if (pos == 0)
+	Add_To_Front_Of_Thread_Queue(queue, kthread);
+    else
+	Insert_After_In_Thread_Queue(queue, pos, kthread);
+}
+
 
 // print processlist to screen
 int PrintProcessList(void);
@@ -146,9 +248,11 @@ struct Kernel_Thread* Start_Kernel_Thread(
     Thread_Start_Func startFunc,
     ulong_t arg,
     int priority,
-    bool detached
+    bool detached,
+    const char* name
 );
 struct Kernel_Thread* Start_User_Thread(struct User_Context* userContext, bool detached);
+int Start_Shared_User_Thread(ulong_t entryAddr, ulong_t func, ulong_t arg);
 
 struct Kernel_Thread* Get_Current(void);
 void Schedule(void);
@@ -168,6 +272,7 @@ void Init_Scheduler(void);
  * Wait queue functions.
  */
 void Wait(struct Thread_Queue* waitQueue);
+void Wait_For(struct Thread_Queue* waitQueue, int reason);
 void Wake_Up(struct Thread_Queue* waitQueue);
 void Wake_Up_One(struct Thread_Queue* waitQueue);
 
@@ -87,6 +87,17 @@ static __inline__ void Add_To_Back_Of_##LType(struct LType *listPtr, struct NTyp
 	listPtr->tail = nodePtr;								\
     }												\
 }												\
+static __inline__ void Insert_After_In_##LType(struct LType *listPtr, struct NType *posPtr,	\
+	struct NType *nodePtr) {								\
+    KASSERT(!Is_Member_Of_##LType(listPtr, nodePtr));						\
+    nodePtr->prev##LType = posPtr;								\
+    nodePtr->next##LType = posPtr->next##LType;							\
+    if (posPtr->next##LType != 0)								\
+	posPtr->next##LType->prev##LType = nodePtr;						\
+    else											\
+	listPtr->tail = nodePtr;								\
+    posPtr->next##LType = nodePtr;								\
+}												\
 static __inline__ void Append_##LType(struct LType *listToModify, struct LType *listToAppend) {	\
     if (listToAppend->head != 0) {								\
 	if (listToModify->head == 0) {								\
@@ -102,6 +102,7 @@ extern pde_t* g_dir;                        /* global pointer for kernel page di
  * Bits used in the kernelInfo field of the PTE's:
  */
 #define KINFO_PAGE_ON_DISK        0x4         /* Page not present; contents in paging file */
+#define KINFO_GUARD_PAGE          0x2         /* Page never mapped; guards a thread stack */
 
 void Init_VM(struct Boot_Info *bootInfo);
 void Init_Paging(void);
@@ -0,0 +1,55 @@
+/*
+ * PCI configuration space access
+ *
+ * This is free software.  You are permitted to use,
+ * redistribute, and modify it as specified in the file "COPYING".
+ */
+
+#ifndef GEEKOS_PCI_H
+#define GEEKOS_PCI_H
+
+#include <geekos/ktypes.h>
+
+#ifdef GEEKOS
+
+/*
+ * Offsets of configuration space registers.
+ */
+#define PCI_VENDOR_ID		0x00
+#define PCI_COMMAND		0x04
+#define PCI_CLASS_REVISION	0x08
+#define PCI_BAR0		0x10
+#define PCI_BAR4		0x20
+
+/* Bits of the command register */
+#define PCI_COMMAND_IO		0x0001
+#define PCI_COMMAND_MEMORY	0x0002
+#define PCI_COMMAND_MASTER	0x0004
+
+/* Class codes */
+#define PCI_CLASS_MASS_STORAGE	0x01
+#define PCI_SUBCLASS_IDE	0x01
+
+/* Programming interface bit of IDE controllers capable of bus mastering */
+#define PCI_IDE_BUS_MASTER	0x80
+
+/* Low bit of a BAR that maps I/O ports, and the mask of its address */
+#define PCI_BAR_IO		0x00000001
+#define PCI_BAR_IO_MASK		0xfffffffc
+
+/*
+ * Location of a PCI function.
+ */
+struct PCI_Device {
+    int bus;
+    int device;
+    int function;
+};
+
+ulong_t PCI_Read_Config(struct PCI_Device *pciDev, int reg);
+void PCI_Write_Config(struct PCI_Device *pciDev, int reg, ulong_t value);
+bool PCI_Find_Class(int classCode, int subclass, struct PCI_Device *pciDev);
+
+#endif  /* GEEKOS */
+
+#endif  /* GEEKOS_PCI_H */
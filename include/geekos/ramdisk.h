@@ -0,0 +1,31 @@
+/*
+ * RAM disk block device
+ *
+ * This is free software.  You are permitted to use,
+ * redistribute, and modify it as specified in the file "COPYING".
+ */
+
+#ifndef GEEKOS_RAMDISK_H
+#define GEEKOS_RAMDISK_H
+
+/*
+ * Maximum number of RAM disks, and maximum size of one (in blocks).
+ */
+#define RAMDISK_MAX_UNITS	4
+#define RAMDISK_MAX_BLOCKS	65536
+
+#ifdef GEEKOS
+
+/*
+ * Size of the RAM disk (ram0) created at boot, in blocks;
+ * 0 to create none.  RAM disk pages are never paged out, so by
+ * default disks are only created on demand (see ramdisk.exe).
+ */
+#define RAMDISK_BOOT_BLOCKS	0
+
+void Init_Ram_Disk(void);
+int Create_Ram_Disk(int numBlocks);
+
+#endif  /* GEEKOS */
+
+#endif  /* GEEKOS_RAMDISK_H */
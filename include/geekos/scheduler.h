@@ -10,16 +10,99 @@
 #ifndef GEEKOS_SCHEDULER_H
 #define GEEKOS_SCHEDULER_H
 
-#include <geekos/kthread.h>
-
+/*
+ * The scheduling policies and real-time classes are shared
+ * with user programs (through <sched.h>).
+ */
 #define SCHEDULE_ROUNDROBIN	0
 #define SCHEDULE_MLF	1
+#define SCHEDULE_FAIR	2
+
+/*
+ * Flag or'ed into the policy to lengthen time slices
+ * while the run queue is short.
+ */
+#define SCHEDULE_ADAPTIVE	0x10
 
 /*
  * Number of ready queue levels.
  */
 #define MAX_QUEUE_LEVEL 4
 
+/*
+ * Real-time classes.  Runnable EDF threads always run before FIFO
+ * threads, and FIFO threads before all threads of the normal policy.
+ * FIFO threads run until they block or yield; EDF threads that
+ * used up the budget of their period run as normal threads
+ * until the next period.
+ */
+#define RT_NONE	0
+#define RT_FIFO	1
+#define RT_EDF	2
+
+/*
+ * Number of FIFO priorities, and the FIFO priority of
+ * device request threads.
+ */
+#define RT_NUM_PRIORITIES 32
+#define RT_PRIORITY_DEVICE 16
+
+/*
+ * Maximum total utilization (budget / period) of
+ * admitted EDF threads, in per mille, and maximum EDF period.
+ */
+#define RT_MAX_UTILIZATION 900
+#define RT_MAX_PERIOD 65536
+
+#ifdef GEEKOS
+
+#include <geekos/kthread.h>
+
+/*
+ * Number of run queue levels; thread priorities and MLF queues
+ * are both mapped to levels, so priorities must be below this.
+ */
+#define NUM_RUN_LEVELS 32
+
+/*
+ * Fair policy: initial size of the run queue heap (it doubles
+ * as threads are created), virtual runtime charged per tick
+ * to a thread of weight 1, and how far behind the most deserving
+ * thread a woken thread may be placed (in ticks of a priority 1 thread).
+ */
+#define FAIR_HEAP_INITIAL_SIZE 64
+#define FAIR_TICK_VRUNTIME 1024
+#define FAIR_SLEEPER_CREDIT (2 * FAIR_TICK_VRUNTIME)
+
+/*
+ * Fair policy: ticks a thread runs before it can be preempted
+ * by a thread with less virtual runtime.
+ */
+#define FAIR_MIN_TICKS 2
+
+/*
+ * MLF aging: every aging interval, threads that waited on the run
+ * queue for a whole interval move up one queue, and every
+ * MLF_BOOST_AGING_ROUNDS intervals all threads are boosted to queue 0.
+ * An interval of 0 disables aging.
+ */
+#define MLF_DEFAULT_AGING_TICKS 36
+#define MLF_BOOST_AGING_ROUNDS 4
+
+/*
+ * Adaptive time slicing: the quantum is multiplied by
+ * ADAPTIVE_EMPTY_FACTOR if no other thread is runnable, and by
+ * ADAPTIVE_SHORT_FACTOR if fewer than ADAPTIVE_SHORT_QUEUE are.
+ */
+#define ADAPTIVE_EMPTY_FACTOR 4
+#define ADAPTIVE_SHORT_FACTOR 2
+#define ADAPTIVE_SHORT_QUEUE 3
+
+/*
+ * Buckets of the run queue length histogram (sampled every tick).
+ */
+#define RUN_QUEUE_HIST_BUCKETS 16
+
 
 
 // currently used scheduling algorithm
@@ -28,27 +111,15 @@ extern volatile int g_currentScheduleAlgorithm;
 // number of context switches so far
 volatile ulong_t g_contextSwitches;
 
+// number of context switches to threads of each MLF queue
+extern volatile ulong_t g_queueContextSwitches[MAX_QUEUE_LEVEL];
+
 /*
  * Find the best (highest priority) thread in given
- * thread queue.  Returns null if queue is empty.
+ * wait queue.  Wait() keeps wait queues ordered by priority,
+ * so this is the first thread.  Returns null if queue is empty.
  */
 static __inline__ struct Kernel_Thread* Find_Best(struct Thread_Queue* queue)
-{
-    /* Pick the highest priority thread */
-    struct Kernel_Thread *kthread = queue->head, *best = 0;
-    while (kthread != 0) {
-	if (best == 0 || kthread->priority > best->priority)
-	    best = kthread;
-	kthread = Get_Next_In_Thread_Queue(kthread);
-    }
-    return best;
-}
-
-/*
- * Get next thread from given
- * thread queue.  Returns null if queue is empty.
- */
-static __inline__ struct Kernel_Thread* Find_Next(struct Thread_Queue* queue)
 {
     return queue->head;
 }
@@ -74,9 +145,32 @@ int Move_All_Threads_To_Wait_Queue(int toQueue);
 // switch to specified scheduling algorithm
 int Switch2SchedulingPolicy(int policy, int quantum);
 
+// set the MLF aging interval in ticks (0 disables aging)
+int Set_MLF_Aging(int agingTicks);
+
 // determine next run/wait-queue for this thread
 int Set_ThreadWaitQueueByReschedule(struct Kernel_Thread* kthread);
 
+// reserve (and give back) room in the run queues for a new thread
+int Reserve_Run_Queue_Slot(void);
+void Release_Run_Queue_Slot(void);
+
+// change the priority of a thread (e.g. for priority inheritance)
+void Set_Thread_Priority(struct Kernel_Thread* kthread, int priority);
+
+// put a thread in a real-time class (or back to normal with RT_NONE)
+int Set_Real_Time(struct Kernel_Thread* kthread, int rtClass, int param, int budget);
+
+// get the time slice of given thread in ticks
+int Get_Thread_Quantum(struct Kernel_Thread* kthread);
+
+// charge a timer tick to the running thread, and request a reschedule
+// if its time slice is used up
+void Account_Scheduler_Tick(struct Kernel_Thread* kthread);
+
 void Dump_Scheduler_Info(void);
+void Dump_Thread_Sched_Info(void);
+
+#endif  /* GEEKOS */
 
 #endif  /* GEEKOS_SCHEDULER_H */
@@ -0,0 +1,41 @@
+/*
+ * Named user semaphores
+ *
+ * This is free software.  You are permitted to use,
+ * redistribute, and modify it as specified in the file "COPYING".
+ */
+
+#ifndef GEEKOS_SEMAPHORE_H
+#define GEEKOS_SEMAPHORE_H
+
+#include <geekos/ktypes.h>
+#include <geekos/kthread.h>
+
+#define MAX_SEM_NAME 25
+
+/* Initial size of the semaphore table; it doubles when full */
+#define SEM_TABLE_MIN_SIZE 32
+
+struct Semaphore
+{
+    int sem_id; // index in the semaphore table + 1
+    int registered_users; // users registerd on that semaphore
+    int sem_count; // count value of the semaphore
+    char sem_name[MAX_SEM_NAME+1]; // name of the semaphore
+    struct Thread_Queue semQueue;
+    struct Semaphore* nameNext; // next semaphore in the same name hash bucket
+
+    /* Wait statistics */
+    ulong_t numP, numV;
+    ulong_t numWaits; // P operations that had to wait
+    ulong_t waitTicks; // total ticks spent waiting
+    ulong_t maxWaitTicks;
+};
+
+int Register_Semaphore(const char* name, int initialCount, struct Kernel_Thread* kthread);
+int Semaphore_P(int sem_id, struct Kernel_Thread* kthread);
+int Semaphore_V(int sem_id, struct Kernel_Thread* kthread);
+int DestroySemaphore(int sem_id, struct Kernel_Thread* kthread);
+void Dump_Semaphore_Info(void);
+
+#endif  /* GEEKOS_SEMAPHORE_H */
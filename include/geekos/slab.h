@@ -0,0 +1,40 @@
+/*
+ * Object caches
+ *
+ * This is free software.  You are permitted to use,
+ * redistribute, and modify it as specified in the file "COPYING".
+ */
+
+#ifndef GEEKOS_SLAB_H
+#define GEEKOS_SLAB_H
+
+#include <geekos/ktypes.h>
+
+/*
+ * A free object in a cache; overlays the object itself.
+ */
+struct Free_Object {
+    struct Free_Object* next;
+};
+
+/*
+ * A cache of fixed size objects.  Objects are carved out of whole
+ * pages, and freed objects are kept on a free list for reuse;
+ * pages are never given back to the page allocator.
+ */
+struct Object_Cache {
+    const char* name;
+    uint_t objectSize;
+    struct Free_Object* freeList;
+    ulong_t numPages;			/* pages taken from the page allocator */
+    ulong_t numAllocated;		/* objects in use */
+    ulong_t numFree;			/* objects on the free list */
+};
+
+#define OBJECT_CACHE_INITIALIZER(name, size) { (name), (size), 0, 0, 0, 0 }
+
+void* Alloc_Object(struct Object_Cache* cache);
+void Free_Object(struct Object_Cache* cache, void* object);
+void Dump_Object_Cache(struct Object_Cache* cache);
+
+#endif  /* GEEKOS_SLAB_H */
@@ -17,27 +17,130 @@
  */
 enum { MUTEX_UNLOCKED, MUTEX_LOCKED };
 
+/*
+ * Build with -DLOCK_PROFILING to collect contention statistics
+ * for mutexes.  Statistics are kept per lock name, so all mutexes
+ * initialized with the same name (e.g. one per open file) share
+ * one record.  Without LOCK_PROFILING, none of it is compiled in.
+ */
+#ifdef LOCK_PROFILING
+
+/* Maximum number of distinct lock names profiled */
+#define LOCK_PROFILE_MAX 32
+
+struct Lock_Profile {
+    const char* name;
+    ulong_t acquisitions;
+    ulong_t contended;			/* acquisitions that found it locked */
+    ulong_t yieldAcquired;		/* ... and got it without sleeping */
+    ulong_t sleeps;
+    ulong_t waitTicks;			/* total ticks spent waiting for it */
+    ulong_t maxHoldTicks;		/* longest time it was held */
+    int maxHoldPid;			/* ... and by whom */
+};
+
+#endif
+
 struct Mutex {
     int state;
     struct Kernel_Thread* owner;
     struct Thread_Queue waitQueue;
+
+    /* Link in the owner's list of held mutexes */
+    DEFINE_LINK(Mutex_List, Mutex);
+
+#ifdef LOCK_PROFILING
+    struct Lock_Profile* profile;
+    ulong_t lockTime;			/* tick the owner got it */
+#endif
 };
 
+IMPLEMENT_LIST(Mutex_List, Mutex);
+
+/*
+ * A thread finding a mutex locked by a runnable owner yields to
+ * the owner up to this many times before going to sleep.
+ */
+#define MUTEX_SPIN_YIELDS 3
+
+/* Maximum length of a chain of mutex owners that inherit a priority */
+#define MUTEX_MAX_INHERIT_DEPTH 8
+
 #define MUTEX_INITIALIZER { MUTEX_UNLOCKED, 0, THREAD_QUEUE_INITIALIZER }
 
 struct Condition {
     struct Thread_Queue waitQueue;
 };
 
+/*
+ * Reader/writer lock policies: who gets the lock when both
+ * readers and writers wait for it.
+ *   RW_PREFER_READERS - readers enter whenever no writer holds it
+ *                       (writers may starve)
+ *   RW_PREFER_WRITERS - waiting writers go first (readers may starve)
+ *   RW_FAIR           - readers queue behind waiting writers, and a
+ *                       writer leaving lets waiting readers in first
+ */
+enum { RW_PREFER_READERS, RW_PREFER_WRITERS, RW_FAIR };
+
+struct RW_Lock {
+    int policy;
+    int readers;			/* number of readers holding it */
+    struct Kernel_Thread* writer;	/* writer holding it, if any */
+    int waitingWriters;
+    ulong_t readGrant;			/* bumped when waiting readers are let in */
+    struct Thread_Queue readQueue;
+    struct Thread_Queue writeQueue;
+};
+
+#define RW_LOCK_INITIALIZER(policy) \
+    { (policy), 0, 0, 0, 0, { 0, 0 }, { 0, 0 } }
+
+#define RW_IS_WRITE_HELD(lock) ((lock)->writer == g_currentThread)
+#define RW_IS_LOCKED(lock) ((lock)->readers > 0 || (lock)->writer != 0)
+
+/*
+ * Sequence lock: readers don't lock, but retry if a writer was
+ * active while they read.  Writers must be serialized by some
+ * other lock, and run with interrupts disabled, so they must not
+ * block.  Data read under a sequence lock must stay valid
+ * memory (e.g. list nodes which are never freed).
+ */
+struct Seq_Lock {
+    volatile ulong_t sequence;		/* odd while a writer is active */
+    bool iflag;				/* writer's interrupt state */
+};
+
+#define SEQ_LOCK_INITIALIZER { 0, false }
+
 void Mutex_Init(struct Mutex* mutex);
 void Mutex_Lock(struct Mutex* mutex);
 void Mutex_Unlock(struct Mutex* mutex);
 
+#ifdef LOCK_PROFILING
+void Mutex_Init_Named(struct Mutex* mutex, const char* name);
+void Dump_Lock_Profile(void);
+#else
+#define Mutex_Init_Named(mutex, name) Mutex_Init(mutex)
+#endif
+
 void Cond_Init(struct Condition* cond);
 void Cond_Wait(struct Condition* cond, struct Mutex* mutex);
 void Cond_Signal(struct Condition* cond);
 void Cond_Broadcast(struct Condition* cond);
 
+void RW_Lock_Init(struct RW_Lock* lock, int policy);
+void RW_Read_Lock(struct RW_Lock* lock);
+void RW_Read_Unlock(struct RW_Lock* lock);
+void RW_Write_Lock(struct RW_Lock* lock);
+void RW_Write_Unlock(struct RW_Lock* lock);
+
+void Seq_Lock_Init(struct Seq_Lock* lock);
+ulong_t Seq_Read_Begin(struct Seq_Lock* lock);
+bool Seq_Read_Retry(struct Seq_Lock* lock, ulong_t start);
+void Seq_Write_Begin(struct Seq_Lock* lock);
+void Seq_Write_End(struct Seq_Lock* lock);
+
 #define IS_HELD(mutex) \
     ((mutex)->state == MUTEX_LOCKED && (mutex)->owner == g_currentThread)
 
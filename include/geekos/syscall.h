@@ -19,7 +19,6 @@
 
 struct Interrupt_State;
 
-int DestroySemaphore(int sem_id, struct Kernel_Thread* kthread);
 
 
 /*
@@ -88,6 +87,10 @@ enum {
     SYS_SET_SET_UID,            /* set user identification  */
     SYS_SET_EFFECTIVE_UID,      /* set effective user identification  */
     SYS_GET_UID,         /* get user identification  */
+    SYS_CREATERAMDISK,   /* Create RAM disk system call  */
+    SYS_SETREALTIME,     /* Set real-time scheduling class system call  */
+    SYS_CREATETHREAD,    /* Create thread in same user context system call  */
+    SYS_FUTEX,           /* Futex wait/wake system call  */
 };
 
 /*
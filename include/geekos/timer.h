@@ -36,6 +36,26 @@ int Start_Timer(int ticks, timerCallback);
 int Get_Remaing_Timer_Ticks(int id);
 int Cancel_Timer(int id);
 
+/*
+ * One-shot timers with microsecond resolution.
+ */
+int Start_Timer_Micros(ulong_t micros, timerCallback cb);
+int Cancel_Timer_Micros(int id);
+void Micro_Sleep(ulong_t micros);
+
+/*
+ * Read the processor's time stamp counter.
+ * Used for timing intervals much shorter than a tick.
+ */
+static __inline__ unsigned long long Read_Cycle_Counter(void)
+{
+    unsigned long long cycles;
+    __asm__ __volatile__ ("rdtsc" : "=A" (cycles));
+    return cycles;
+}
+
+ulong_t Cycles_To_Micros(unsigned long long cycles);
+
 void Micro_Delay(int us);
 
 #endif  /* GEEKOS_TIMER_H */
@@ -10,6 +10,15 @@
 #ifndef GEEKOS_TRAP_H
 #define GEEKOS_TRAP_H
 
+struct Kernel_Thread;
+
+/* Size and alignment of a saved FPU state (fxsave area) */
+#define FPU_STATE_SIZE 512
+
+/* Thread whose state is in the FPU registers (0 if none) */
+extern struct Kernel_Thread* g_fpuOwner;
+
 void Init_Traps(void);
+void Release_FPU_State(struct Kernel_Thread* kthread);
 
 #endif  /* GEEKOS_TRAP_H */
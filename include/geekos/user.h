@@ -25,6 +25,14 @@ struct File;
 
 #define INITIAL_HEAP_SIZE	0x00001000
 
+/*
+ * Threads sharing a user context each get a stack slot of
+ * USER_THREAD_STACK_SIZE bytes below the main stack (slot 0).
+ * The lowest page of each slot in use is a guard page.
+ */
+#define USER_MAX_THREADS	32
+#define USER_THREAD_STACK_SIZE	0x00010000
+
 /* Number of files user process can have open. */
 #define USER_MAX_FILES		20
 
@@ -73,12 +81,12 @@ struct User_Context {
     /* Initial stack pointer */
     ulong_t stackPointerAddr;
 
-    /*
-     * May use this in future to allow multiple threads
-     * in the same user context
-     */
+    /* Number of threads sharing this user context */
     int refCount;
 
+    /* Bitmap of stack slots in use (bit 0 is the main stack) */
+    ulong_t threadStacks;
+
     /* the open files */
     struct File* iob[USER_MAX_FILES];
 #if 0
@@ -114,6 +122,8 @@ int Load_User_Program(char *exeFileData, ulong_t exeFileLength,
 bool Copy_From_User(void* destInKernel, ulong_t srcInUser, ulong_t bufSize);
 bool Copy_To_User(ulong_t destInUser, void* srcInKernel, ulong_t bufSize);
 void Switch_To_Address_Space(struct User_Context *userContext);
+int Alloc_User_Thread_Stack(struct User_Context* context, ulong_t* pStackTop);
+void Free_User_Thread_Stack(struct User_Context* context, int slot);
 
 bool __copy_to_user(struct User_Context* context, ulong_t destInUser, void* srcInKernel, ulong_t numBytes);
 bool __copy_from_user(struct User_Context* context, void* destInKernel, ulong_t srcInUser, ulong_t numBytes);
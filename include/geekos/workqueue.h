@@ -0,0 +1,41 @@
+/*
+ * Kernel work queue
+ *
+ * This is free software.  You are permitted to use,
+ * redistribute, and modify it as specified in the file "COPYING".
+ */
+
+#ifndef GEEKOS_WORKQUEUE_H
+#define GEEKOS_WORKQUEUE_H
+
+#include <geekos/ktypes.h>
+#include <geekos/list.h>
+
+/* Minimum and maximum number of worker threads in the pool */
+#define WORK_MIN_WORKERS 1
+#define WORK_MAX_WORKERS 4
+
+typedef void (*Work_Func)(ulong_t arg);
+
+struct Work_Item;
+DEFINE_LIST(Work_List, Work_Item);
+
+/*
+ * A piece of deferred work, run by a worker thread with
+ * interrupts enabled.
+ */
+struct Work_Item {
+    Work_Func func;
+    ulong_t arg;
+    bool pending;			/* queued and not yet started */
+    bool allocated;			/* allocated by Queue_Work() */
+    DEFINE_LINK(Work_List, Work_Item);
+};
+
+void Init_Work_Queue(void);
+void Init_Work_Item(struct Work_Item* item, Work_Func func, ulong_t arg);
+void Schedule_Work(struct Work_Item* item);
+int Queue_Work(Work_Func func, ulong_t arg);
+void Dump_Work_Queue_Info(void);
+
+#endif  /* GEEKOS_WORKQUEUE_H */
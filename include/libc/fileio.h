@@ -29,6 +29,7 @@ int Mount(const char *dev, const char *prefix, const char *fstype);
 int Seek(int fd, int pos);
 int Delete(const char *path);
 int Create_Pipe(int *readfd, int *writefd);
+int Create_Ram_Disk(int numBlocks);
 
 #endif  /* FILEIO_H */
 
@@ -14,6 +14,10 @@
 
 #define SYS_INFO_PAGING		1
 #define SYS_INFO_SCHEDULER	2
+#define SYS_INFO_BLOCKDEV	4
+#define SYS_INFO_THREADS	8
+#define SYS_INFO_LOCKS		16
+#define SYS_INFO_SEMAPHORES	32
 
 int Print_System_Info (int flags);
 int Select_Paging_Algorithm (int alg);
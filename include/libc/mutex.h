@@ -0,0 +1,48 @@
+/*
+ * User mode mutexes and condition variables, built on futexes
+ *
+ * This is free software.  You are permitted to use,
+ * redistribute, and modify it as specified in the file "COPYING".
+ */
+
+#ifndef MUTEX_H
+#define MUTEX_H
+
+#include <geekos/futex.h>
+
+/*
+ * Mutex states: unlocked, locked, and locked with
+ * (possibly) threads waiting in the kernel.
+ */
+enum { MUTEX_UNLOCKED, MUTEX_LOCKED, MUTEX_CONTENDED };
+
+struct Mutex {
+    volatile int state;
+};
+
+#define MUTEX_INITIALIZER { MUTEX_UNLOCKED }
+
+/*
+ * A condition variable is a sequence number, bumped whenever
+ * it is signaled.
+ */
+struct Condition {
+    volatile int seq;
+};
+
+#define COND_INITIALIZER { 0 }
+
+int Futex_Wait(volatile int *addr, int val);
+int Futex_Wake(volatile int *addr, int count);
+
+void Mutex_Init(struct Mutex *mutex);
+void Mutex_Lock(struct Mutex *mutex);
+int Mutex_Try_Lock(struct Mutex *mutex);
+void Mutex_Unlock(struct Mutex *mutex);
+
+void Cond_Init(struct Condition *cond);
+void Cond_Wait(struct Condition *cond, struct Mutex *mutex);
+void Cond_Signal(struct Condition *cond);
+void Cond_Broadcast(struct Condition *cond);
+
+#endif  /* MUTEX_H */
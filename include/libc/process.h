@@ -18,5 +18,6 @@ int Spawn_With_Path(const char *program, const char *command, int stdinFd, int s
 int Wait(int pid);
 int Get_PID(void);
 int Print_ProcessList(void);
+int Create_Thread(void (*startFunc)(void *arg), void *arg);
 
 #endif  /* PROCESS_H */
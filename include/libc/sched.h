@@ -11,7 +11,11 @@
 #ifndef SCHED_H
 #define SCHED_H
 
+#include <geekos/scheduler.h>
+
 int Set_Scheduling_Policy(int policy, int quantum);
+int Set_Scheduling_Aging(int policy, int quantum, int agingTicks);
+int Set_Real_Time(int pid, int rtClass, int param, int budget);
 int Get_Time_Of_Day(void);
 
 #endif  /* SCHED_H */
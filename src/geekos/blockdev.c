@@ -14,6 +14,7 @@
 #include <geekos/int.h>
 #include <geekos/kthread.h>
 #include <geekos/synch.h>
+#include <geekos/timer.h>
 #include <geekos/blockdev.h>
 
 /*#define BLOCKDEV_DEBUG */
@@ -30,7 +31,7 @@
 /*
  * Lock protecting access/modification of block device list.
  */
-static struct Mutex s_blockdevLock;
+static struct RW_Lock s_blockdevLock = RW_LOCK_INITIALIZER(RW_FAIR);
 
 /*
  * List datatype for list of block devices.
@@ -44,22 +45,295 @@ IMPLEMENT_LIST(Block_Device_List, Block_Device);
  */
 static struct Block_Device_List s_deviceList;
 
+/*
+ * Name of the I/O scheduler used for newly initialized request queues.
+ */
+#define BLOCKDEV_DEFAULT_SCHEDULER "deadline"
+
+/*
+ * Number of ticks a read or write request may wait before
+ * the deadline scheduler dispatches it out of order
+ * (roughly 0.5 and 5 seconds at 18 ticks per second).
+ */
+#define BLOCK_READ_EXPIRE_TICKS  9
+#define BLOCK_WRITE_EXPIRE_TICKS 90
+
+/*
+ * Number of blocks covered by a request chain.
+ */
+#define CHAIN_END(request) ((request)->blockNum + (request)->mergeBlocks)
+
+/*
+ * Return true if request a should be dispatched before request b
+ * in a sweep over the disk, i.e., if it is at a lower position.
+ */
+static __inline__ bool Is_Before(struct Block_Request *a, struct Block_Request *b)
+{
+    if (a->dev->unit != b->dev->unit)
+	return a->dev->unit < b->dev->unit;
+    return a->blockNum < b->blockNum;
+}
+
+/*
+ * Return true if the given request is at or after the
+ * current head position of the queue.
+ */
+static __inline__ bool Is_Ahead_Of_Head(struct Block_Request_Queue *queue, struct Block_Request *request)
+{
+    if (request->dev->unit != queue->headUnit)
+	return request->dev->unit > queue->headUnit;
+    return request->blockNum >= queue->headBlock;
+}
+
+/*
+ * Insert a request into the dispatch list before given position.
+ */
+static void Insert_Before_In_List(struct Block_Request_List *list, struct Block_Request *pos,
+    struct Block_Request *request)
+{
+    struct Block_Request *prev = Get_Prev_In_Block_Request_List(pos);
+
+    if (prev == 0) {
+	Add_To_Front_Of_Block_Request_List(list, request);
+	return;
+    }
+    Set_Prev_In_Block_Request_List(request, prev);
+    Set_Next_In_Block_Request_List(request, pos);
+    Set_Next_In_Block_Request_List(prev, request);
+    Set_Prev_In_Block_Request_List(pos, request);
+}
+
+/*
+ * Insert a request into the deadline fifo, keeping it sorted by
+ * deadline.  Reads expire sooner than writes, so a new read may go
+ * ahead of writes posted before it.
+ */
+static void Insert_By_Deadline(struct Block_Request_Fifo *fifo, struct Block_Request *request)
+{
+    struct Block_Request *pos = Get_Back_Of_Block_Request_Fifo(fifo);
+
+    while (pos != 0 && (long) (pos->deadline - request->deadline) > 0)
+	pos = Get_Prev_In_Block_Request_Fifo(pos);
+
+    if (pos == 0)
+	Add_To_Front_Of_Block_Request_Fifo(fifo, request);
+    else
+	Insert_After_In_Block_Request_Fifo(fifo, pos, request);
+}
+
+/*
+ * Insert a request into the dispatch list, keeping it
+ * sorted by unit and block number.
+ */
+static void Insert_Sorted(struct Block_Request_Queue *queue, struct Block_Request *request)
+{
+    struct Block_Request *pos = Get_Front_Of_Block_Request_List(&queue->requestList);
+
+    while (pos != 0 && !Is_Before(request, pos))
+	pos = Get_Next_In_Block_Request_List(pos);
+
+    if (pos == 0)
+	Add_To_Back_Of_Block_Request_List(&queue->requestList, request);
+    else
+	Insert_Before_In_List(&queue->requestList, pos, request);
+}
+
+/*
+ * Choose the first request at or after the head position,
+ * wrapping around to the lowest request when the sweep is done
+ * (C-LOOK).  The dispatch list must be sorted.
+ */
+static struct Block_Request *CLook_Next(struct Block_Request_Queue *queue)
+{
+    struct Block_Request *request = Get_Front_Of_Block_Request_List(&queue->requestList);
+
+    while (request != 0 && !Is_Ahead_Of_Head(queue, request))
+	request = Get_Next_In_Block_Request_List(request);
+
+    return request != 0 ? request : Get_Front_Of_Block_Request_List(&queue->requestList);
+}
+
+/*
+ * noop scheduler: dispatch requests in order of arrival.
+ */
+static void Noop_Add_Request(struct Block_Request_Queue *queue, struct Block_Request *request)
+{
+    Add_To_Back_Of_Block_Request_List(&queue->requestList, request);
+}
+
+static struct Block_Request *Noop_Next_Request(struct Block_Request_Queue *queue)
+{
+    return Get_Front_Of_Block_Request_List(&queue->requestList);
+}
+
+/*
+ * elevator scheduler: one-directional sweep over the disk (C-LOOK).
+ */
+static struct Block_Request *Elevator_Next_Request(struct Block_Request_Queue *queue)
+{
+    return CLook_Next(queue);
+}
+
+/*
+ * deadline scheduler: C-LOOK, except that a request which has waited
+ * longer than its expiry time is dispatched first.  The sweep then
+ * continues from the position of that request.
+ */
+static struct Block_Request *Deadline_Next_Request(struct Block_Request_Queue *queue)
+{
+    struct Block_Request *earliest = Get_Front_Of_Block_Request_Fifo(&queue->fifo);
+
+    if (earliest != 0 && (long) (g_numTicks - earliest->deadline) >= 0)
+	return earliest;
+    return CLook_Next(queue);
+}
+
+/*
+ * Table of available I/O schedulers.
+ */
+static struct Block_Scheduler s_schedulerTable[] = {
+    { "noop", Noop_Add_Request, Noop_Next_Request },
+    { "elevator", Insert_Sorted, Elevator_Next_Request },
+    { "deadline", Insert_Sorted, Deadline_Next_Request },
+};
+#define NUM_SCHEDULERS (sizeof(s_schedulerTable) / sizeof(s_schedulerTable[0]))
+
+static struct Block_Scheduler *Lookup_Scheduler(const char *name)
+{
+    unsigned int i;
+
+    for (i = 0; i < NUM_SCHEDULERS; ++i) {
+	if (strcmp(s_schedulerTable[i].name, name) == 0)
+	    return &s_schedulerTable[i];
+    }
+    return 0;
+}
+
+/*
+ * Append the chain starting at request to the chain of head.
+ */
+static void Append_Chain(struct Block_Request *head, struct Block_Request *request)
+{
+    head->mergeTail->mergeNext = request;
+    head->mergeTail = request->mergeTail;
+    head->mergeBlocks += request->mergeBlocks;
+}
+
+/*
+ * Try to merge given request into a queued request chain
+ * for the adjacent blocks.  Returns true if the request was merged.
+ * Must be called with interrupts disabled.
+ */
+static bool Merge_Request(struct Block_Request_Queue *queue, struct Block_Request *request)
+{
+    struct Block_Request *pos = Get_Front_Of_Block_Request_List(&queue->requestList);
+
+    KASSERT(!Interrupts_Enabled());
+
+    while (pos != 0) {
+	if (pos->dev == request->dev && pos->type == request->type &&
+	    pos->mergeBlocks + request->mergeBlocks <= BLOCK_MAX_MERGE_BLOCKS) {
+	    if (CHAIN_END(pos) == request->blockNum) {
+		/* Back merge: request continues the chain */
+		Debug("Back merge of block %d\n", request->blockNum);
+		Append_Chain(pos, request);
+		return true;
+	    }
+	    if (CHAIN_END(request) == pos->blockNum) {
+		/* Front merge: request becomes the new chain head */
+		Debug("Front merge of block %d\n", request->blockNum);
+		Insert_Before_In_List(&queue->requestList, pos, request);
+		Remove_From_Block_Request_List(&queue->requestList, pos);
+		Remove_From_Block_Request_Fifo(&queue->fifo, pos);
+		if ((long) (pos->deadline - request->deadline) < 0)
+		    request->deadline = pos->deadline;
+		Insert_By_Deadline(&queue->fifo, request);
+		Append_Chain(request, pos);
+		return true;
+	    }
+	}
+	pos = Get_Next_In_Block_Request_List(pos);
+    }
+
+    return false;
+}
+
+/*
+ * Add a request to the queue, merging it with an adjacent
+ * request if possible.
+ * Must be called with interrupts disabled.
+ */
+static void Queue_Request(struct Block_Request_Queue *queue, struct Block_Request *request)
+{
+    KASSERT(!Interrupts_Enabled());
+
+    if (Merge_Request(queue, request))
+	return;
+
+    queue->sched->Add_Request(queue, request);
+    Insert_By_Deadline(&queue->fifo, request);
+}
+
 /*
  * Perform a block IO request.
+ * The request lives on the caller's stack, so no memory
+ * is allocated.
  * Returns 0 if successful, error code on failure.
  */
-static int Do_Request(struct Block_Device *dev, enum Request_Type type, int blockNum, void *buf)
+static int Do_Request(struct Block_Device *dev, enum Request_Type type, int blockNum,
+    int numBlocks, void *buf)
 {
-    struct Block_Request *request;
-    int rc;
+    struct Block_Request request;
 
-    request = Create_Request(dev, type, blockNum, buf);
-    if (request == 0)
-	return ENOMEM;
-    Post_Request_And_Wait(request);
-    rc = request->errorCode;
-    Free(request);
-    return rc;
+    Init_Request(&request, dev, type, blockNum, numBlocks, buf);
+    Post_Request(&request);
+    return Wait_For_Request(&request);
+}
+
+/*
+ * Account for a request being posted to its device.
+ * Must be called with interrupts disabled.
+ */
+static void Account_Post(struct Block_Request *request)
+{
+    struct Block_Device_Stats *stats = &request->dev->stats;
+
+    KASSERT(!Interrupts_Enabled());
+
+    if (request->type == BLOCK_READ) {
+	++stats->reads;
+	stats->blocksRead += request->numBlocks;
+    } else {
+	++stats->writes;
+	stats->blocksWritten += request->numBlocks;
+    }
+
+    ++stats->queueDepth;
+    if (stats->queueDepth > stats->maxQueueDepth)
+	stats->maxQueueDepth = stats->queueDepth;
+}
+
+/*
+ * Account for the completion of a request, recording the time
+ * since it was posted in the latency histogram of its device.
+ * Must be called with interrupts disabled.
+ */
+static void Account_Completion(struct Block_Request *request, enum Request_State state)
+{
+    struct Block_Device_Stats *stats = &request->dev->stats;
+    ulong_t latency = Cycles_To_Micros(Read_Cycle_Counter() - request->postCycles);
+    int bucket = 0;
+
+    KASSERT(!Interrupts_Enabled());
+
+    while (bucket < BLOCK_LATENCY_BUCKETS - 1 && (latency >> (bucket + 1)) != 0)
+	++bucket;
+
+    --stats->queueDepth;
+    stats->totalLatency += latency;
+    ++stats->latencyHist[bucket];
+    if (state == ERROR)
+	++stats->errors;
 }
 
 /* ----------------------------------------------------------------------
@@ -70,23 +344,39 @@ static int Do_Request(struct Block_Device *dev, enum Request_Type type, int bloc
  * Register a block device.
  * This should be called by device drivers in their Init
  * functions to register all detected devices.
+ * A device without a wait queue and request queue (such as the
+ * RAM disk) has its requests carried out synchronously by
+ * the Transfer operation when they are posted.
  * Returns 0 if successful, error code otherwise.
  */
 int Register_Block_Device(const char *name, struct Block_Device_Ops *ops,
     int unit, void *driverData, struct Thread_Queue *waitQueue,
-    struct Block_Request_List *requestQueue)
+    struct Block_Request_Queue *requestQueue)
 {
     struct Block_Device *dev;
+    int i;
 
     KASSERT(ops != 0);
-    KASSERT(waitQueue != 0);
-    KASSERT(requestQueue != 0);
+    KASSERT((waitQueue == 0) == (requestQueue == 0));
+    KASSERT(requestQueue != 0 || ops->Transfer != 0);
 
     dev = (struct Block_Device*) Malloc(sizeof(*dev));
     if (dev == 0)
 	return ENOMEM;
 
+    /* Preallocate the requests for the device. */
+    dev->requestPool = (struct Block_Request*)
+	Malloc(BLOCK_REQUEST_POOL_SIZE * sizeof(struct Block_Request));
+    if (dev->requestPool == 0) {
+	Free(dev);
+	return ENOMEM;
+    }
+    Clear_Block_Request_List(&dev->freeRequests);
+    for (i = 0; i < BLOCK_REQUEST_POOL_SIZE; ++i)
+	Add_To_Back_Of_Block_Request_List(&dev->freeRequests, &dev->requestPool[i]);
+
     strcpy(dev->name, name);
+    memset(&dev->stats, '\0', sizeof(dev->stats));
     dev->ops = ops;
     dev->unit = unit;
     dev->inUse = false;
@@ -94,11 +384,11 @@ int Register_Block_Device(const char *name, struct Block_Device_Ops *ops,
     dev->waitQueue = waitQueue;
     dev->requestQueue = requestQueue;
 
-    Mutex_Lock(&s_blockdevLock);
+    RW_Write_Lock(&s_blockdevLock);
     /* FIXME: handle name conflict with existing device */
     Debug("Registering block device %s\n", dev->name);
     Add_To_Back_Of_Block_Device_List(&s_deviceList, dev);
-    Mutex_Unlock(&s_blockdevLock);
+    RW_Write_Unlock(&s_blockdevLock);
 
     return 0;
 }
@@ -112,7 +402,7 @@ int Open_Block_Device(const char *name, struct Block_Device **pDev)
     struct Block_Device *dev;
     int rc = 0;
 
-    Mutex_Lock(&s_blockdevLock);
+    RW_Write_Lock(&s_blockdevLock);
 
     dev = Get_Front_Of_Block_Device_List(&s_deviceList);
     while (dev != 0) {
@@ -133,7 +423,7 @@ int Open_Block_Device(const char *name, struct Block_Device **pDev)
 	}
     }
 
-    Mutex_Unlock(&s_blockdevLock);
+    RW_Write_Unlock(&s_blockdevLock);
 
     return rc;
 }
@@ -146,94 +436,266 @@ int Close_Block_Device(struct Block_Device *dev)
 {
     int rc;
 
-    Mutex_Lock(&s_blockdevLock);
+    RW_Write_Lock(&s_blockdevLock);
 
     KASSERT(dev->inUse);
     rc = dev->ops->Close(dev);
     if (rc == 0)
 	dev->inUse = false;
 
-    Mutex_Unlock(&s_blockdevLock);
+    RW_Write_Unlock(&s_blockdevLock);
+
+    return rc;
+}
+
+/*
+ * Initialize a driver's request queue.
+ * The queue uses the default I/O scheduler.
+ */
+void Init_Block_Request_Queue(struct Block_Request_Queue *requestQueue)
+{
+    Clear_Block_Request_List(&requestQueue->requestList);
+    Clear_Block_Request_Fifo(&requestQueue->fifo);
+    requestQueue->sched = Lookup_Scheduler(BLOCKDEV_DEFAULT_SCHEDULER);
+    requestQueue->headUnit = 0;
+    requestQueue->headBlock = 0;
+    KASSERT(requestQueue->sched != 0);
+}
+
+/*
+ * Select the I/O scheduler of given request queue.
+ * Pending requests are re-queued in the order of the new scheduler.
+ * Returns 0 if successful, error code on error.
+ */
+int Set_Block_Scheduler(struct Block_Request_Queue *requestQueue, const char *schedName)
+{
+    struct Block_Scheduler *sched = Lookup_Scheduler(schedName);
+    struct Block_Request_Fifo pending;
+    struct Block_Request *request;
+    bool iflag;
+
+    if (sched == 0)
+	return EINVALID;
+
+    iflag = Begin_Int_Atomic();
+    pending = requestQueue->fifo;
+    Clear_Block_Request_List(&requestQueue->requestList);
+    Clear_Block_Request_Fifo(&requestQueue->fifo);
+    requestQueue->sched = sched;
+    while (!Is_Block_Request_Fifo_Empty(&pending)) {
+	request = Remove_From_Front_Of_Block_Request_Fifo(&pending);
+	sched->Add_Request(requestQueue, request);
+	Add_To_Back_Of_Block_Request_Fifo(&requestQueue->fifo, request);
+    }
+    End_Int_Atomic(iflag);
+
+    return 0;
+}
+
+/*
+ * Select the I/O scheduler used by the named block device.
+ * Note that the scheduler applies to the driver's request queue,
+ * and so to all units sharing it.
+ * Returns 0 if successful, error code on error.
+ */
+int Set_IO_Scheduler(const char *devName, const char *schedName)
+{
+    struct Block_Device *dev;
+    int rc = ENODEV;
+
+    RW_Read_Lock(&s_blockdevLock);
+    dev = Get_Front_Of_Block_Device_List(&s_deviceList);
+    while (dev != 0) {
+	if (strcmp(dev->name, devName) == 0) {
+	    rc = dev->requestQueue != 0
+		? Set_Block_Scheduler(dev->requestQueue, schedName)
+		: EUNSUPPORTED;
+	    break;
+	}
+	dev = Get_Next_In_Block_Device_List(dev);
+    }
+    RW_Read_Unlock(&s_blockdevLock);
 
     return rc;
 }
 
 /*
- * Create a block device request to transfer a single block.
+ * Initialize a block device request to transfer numBlocks
+ * consecutive blocks, using storage provided by the caller
+ * (e.g., on its stack).  The storage must remain valid until
+ * the request has completed.
+ */
+void Init_Request(struct Block_Request *request, struct Block_Device *dev,
+    enum Request_Type type, int blockNum, int numBlocks, void *buf)
+{
+    KASSERT(numBlocks > 0 && numBlocks <= BLOCK_MAX_MERGE_BLOCKS);
+
+    request->dev = dev;
+    request->type = type;
+    request->blockNum = blockNum;
+    request->numBlocks = numBlocks;
+    request->buf = buf;
+    request->state = PENDING;
+    request->errorCode = 0;
+    request->pooled = false;
+    Clear_Thread_Queue(&request->waitQueue);
+}
+
+/*
+ * Create a block device request to transfer numBlocks
+ * consecutive blocks.  The request is taken from the device's
+ * request pool, and must be released with Free_Request().
+ * Returns a null pointer if the pool is exhausted.
  */
 struct Block_Request *Create_Request(struct Block_Device *dev, enum Request_Type type,
-    int blockNum, void *buf)
+    int blockNum, int numBlocks, void *buf)
 {
-    struct Block_Request *request = Malloc(sizeof(*request));
+    struct Block_Request *request = 0;
+    bool iflag;
+
+    iflag = Begin_Int_Atomic();
+    if (!Is_Block_Request_List_Empty(&dev->freeRequests))
+	request = Remove_From_Front_Of_Block_Request_List(&dev->freeRequests);
+    End_Int_Atomic(iflag);
+
     if (request != 0) {
-	request->dev = dev;
-	request->type = type;
-	request->blockNum = blockNum;
-	request->buf = buf;
-	request->state = PENDING;
-	Clear_Thread_Queue(&request->waitQueue);
+	Init_Request(request, dev, type, blockNum, numBlocks, buf);
+	request->pooled = true;
     }
     return request;
 }
 
 /*
- * Send a block IO request to a device and wait for it to be handled.
- * Returns when the driver completes the requests or signals
- * an error.
+ * Return a request created by Create_Request() to its pool.
  */
-void Post_Request_And_Wait(struct Block_Request *request)
+void Free_Request(struct Block_Request *request)
+{
+    bool iflag;
+
+    KASSERT(request->pooled);
+    KASSERT(request->state != PENDING);
+
+    iflag = Begin_Int_Atomic();
+    Add_To_Front_Of_Block_Request_List(&request->dev->freeRequests, request);
+    End_Int_Atomic(iflag);
+}
+
+/*
+ * Send a block IO request to a device without waiting for it.
+ * May be called with interrupts disabled, which allows a caller
+ * to post a batch of requests that the I/O scheduler can sort
+ * and merge before the driver sees any of them.
+ */
+void Post_Request(struct Block_Request *request)
 {
     struct Block_Device *dev;
+    bool iflag;
 
     KASSERT(request != 0);
 
     dev = request->dev;
     KASSERT(dev != 0);
 
+    /* The request starts out as a chain of its own */
+    request->mergeNext = 0;
+    request->mergeTail = request;
+    request->mergeBlocks = request->numBlocks;
+    request->deadline = g_numTicks + (request->type == BLOCK_READ
+	? BLOCK_READ_EXPIRE_TICKS : BLOCK_WRITE_EXPIRE_TICKS);
+
+    request->postCycles = Read_Cycle_Counter();
+
+    /* Devices without a request queue complete the request right away */
+    if (dev->requestQueue == 0) {
+	int rc = dev->ops->Transfer(dev, request);
+
+	iflag = Begin_Int_Atomic();
+	Account_Post(request);
+	request->errorCode = rc;
+	request->state = rc == 0 ? COMPLETED : ERROR;
+	Account_Completion(request, request->state);
+	End_Int_Atomic(iflag);
+	return;
+    }
+
     /* Send request to the driver */
     Debug("Posting block device request [@%x]...\n", request);
-    Disable_Interrupts();
-    Add_To_Back_Of_Block_Request_List(dev->requestQueue, request);
+    iflag = Begin_Int_Atomic();
+    Account_Post(request);
+    Queue_Request(dev->requestQueue, request);
     Wake_Up(dev->waitQueue);
-    Enable_Interrupts();
+    End_Int_Atomic(iflag);
+}
 
-    /* Wait for request to be processed */
+/*
+ * Wait for a posted request to be handled.
+ * Returns 0 if successful, error code on error.
+ */
+int Wait_For_Request(struct Block_Request *request)
+{
     Disable_Interrupts();
     while (request->state == PENDING) {
 	Debug("Waiting, state=%d\n", request->state);
-	Wait(&request->waitQueue);
+	Wait_For(&request->waitQueue, WAIT_BLOCK_IO);
     }
     Debug("Wait completed!\n");
     Enable_Interrupts();
+
+    return request->state == COMPLETED ? 0 : request->errorCode;
+}
+
+/*
+ * Send a block IO request to a device and wait for it to be handled.
+ * Returns when the driver completes the requests or signals
+ * an error.
+ */
+void Post_Request_And_Wait(struct Block_Request *request)
+{
+    Post_Request(request);
+    Wait_For_Request(request);
 }
 
 /*
  * Wait for a block request to arrive.
+ * The request returned is chosen by the queue's I/O scheduler,
+ * and may be the head of a chain of merged requests (see mergeNext).
  */
-struct Block_Request *Dequeue_Request(struct Block_Request_List *requestQueue,
+struct Block_Request *Dequeue_Request(struct Block_Request_Queue *requestQueue,
     struct Thread_Queue *waitQueue)
 {
     struct Block_Request *request;
 
     Disable_Interrupts();
-    while (Is_Block_Request_List_Empty(requestQueue))
-	Wait(waitQueue);
-    request = Get_Front_Of_Block_Request_List(requestQueue);
-    Remove_From_Front_Of_Block_Request_List(requestQueue);
+    while (Is_Block_Request_List_Empty(&requestQueue->requestList))
+	Wait_For(waitQueue, WAIT_DEVICE);
+    request = requestQueue->sched->Next_Request(requestQueue);
+    KASSERT(request != 0);
+    Remove_From_Block_Request_List(&requestQueue->requestList, request);
+    Remove_From_Block_Request_Fifo(&requestQueue->fifo, request);
+    requestQueue->headUnit = request->dev->unit;
+    requestQueue->headBlock = CHAIN_END(request);
     Enable_Interrupts();
 
     return request;
 }
 
 /*
- * Signal the completion of a block request.
+ * Signal the completion of a block request,
+ * and of all requests merged behind it.
  */
 void Notify_Request_Completion(struct Block_Request *request, enum Request_State state, int errorCode)
 {
+    struct Block_Request *next;
+
     Disable_Interrupts();
-    request->state = state;
-    request->errorCode = errorCode;
-    Wake_Up(&request->waitQueue);
+    while (request != 0) {
+	next = request->mergeNext;
+	Account_Completion(request, state);
+	request->state = state;
+	request->errorCode = errorCode;
+	Wake_Up(&request->waitQueue);
+	request = next;
+    }
     Enable_Interrupts();
 }
 
@@ -243,7 +705,7 @@ void Notify_Request_Completion(struct Block_Request *request, enum Request_State
  */
 int Block_Read(struct Block_Device *dev, int blockNum, void *buf)
 {
-    return Do_Request(dev, BLOCK_READ, blockNum, buf);
+    return Do_Request(dev, BLOCK_READ, blockNum, 1, buf);
 }
 
 /*
@@ -252,7 +714,25 @@ int Block_Read(struct Block_Device *dev, int blockNum, void *buf)
  */
 int Block_Write(struct Block_Device *dev, int blockNum, void *buf)
 {
-    return Do_Request(dev, BLOCK_WRITE, blockNum, buf);
+    return Do_Request(dev, BLOCK_WRITE, blockNum, 1, buf);
+}
+
+/*
+ * Read consecutive blocks from given device into buf.
+ * Return 0 if successful, error code on error.
+ */
+int Block_Read_Multiple(struct Block_Device *dev, int blockNum, int numBlocks, void *buf)
+{
+    return Do_Request(dev, BLOCK_READ, blockNum, numBlocks, buf);
+}
+
+/*
+ * Write consecutive blocks from buf to given device.
+ * Return 0 if successful, error code on error.
+ */
+int Block_Write_Multiple(struct Block_Device *dev, int blockNum, int numBlocks, void *buf)
+{
+    return Do_Request(dev, BLOCK_WRITE, blockNum, numBlocks, buf);
 }
 
 /*
@@ -262,3 +742,43 @@ int Get_Num_Blocks(struct Block_Device *dev)
 {
     return dev->ops->Get_Num_Blocks(dev);
 }
+
+/*
+ * Print the I/O statistics of all block devices.
+ */
+void Dump_Block_Device_Info(void)
+{
+    struct Block_Device *dev;
+    bool iflag;
+    int i;
+
+    iflag = Begin_Int_Atomic();
+
+    for (dev = Get_Front_Of_Block_Device_List(&s_deviceList); dev != 0;
+	 dev = Get_Next_In_Block_Device_List(dev)) {
+	struct Block_Device_Stats *stats = &dev->stats;
+	ulong_t completed = stats->reads + stats->writes - stats->queueDepth;
+
+	Print("%s: reads %lu (%lu blocks), writes %lu (%lu blocks), errors %lu\n",
+	    dev->name, stats->reads, stats->blocksRead, stats->writes,
+	    stats->blocksWritten, stats->errors);
+	Print("    queue depth %d (max %d), average latency %lu us\n",
+	    stats->queueDepth, stats->maxQueueDepth,
+	    completed > 0 ? stats->totalLatency / completed : 0);
+	if (completed == 0)
+	    continue;
+
+	Print("    latency (us):");
+	for (i = 0; i < BLOCK_LATENCY_BUCKETS; ++i) {
+	    if (stats->latencyHist[i] == 0)
+		continue;
+	    if (i == BLOCK_LATENCY_BUCKETS - 1)
+		Print(" >=%lu:%lu", 1UL << i, stats->latencyHist[i]);
+	    else
+		Print(" <%lu:%lu", 1UL << (i + 1), stats->latencyHist[i]);
+	}
+	Print("\n");
+    }
+
+    End_Int_Atomic(iflag);
+}
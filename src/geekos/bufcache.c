@@ -9,6 +9,7 @@
 
 #include <geekos/errno.h>
 #include <geekos/kassert.h>
+#include <geekos/int.h>
 #include <geekos/mem.h>
 #include <geekos/malloc.h>
 #include <geekos/blockdev.h>
@@ -26,6 +27,18 @@
 int bufCacheDebug = 0;
 #define Debug(args...) if (bufCacheDebug) Print(args)
 
+/*
+ * Atomically clear flags of a buffer.  Release_FS_Buffer() clears the
+ * in-use flag without the cache lock, so a plain read-modify-write
+ * of the flags preempted midway could lose the update.
+ */
+static void Clear_Buffer_Flags(struct FS_Buffer *buf, uint_t flags)
+{
+    bool iflag = Begin_Int_Atomic();
+    buf->flags &= ~(flags);
+    End_Int_Atomic(iflag);
+}
+
 /* XXX */
 int noEvict = 0;
 
@@ -40,26 +53,15 @@ static uint_t Get_Num_Sectors_Per_FS_Block(struct FS_Buffer_Cache *cache)
 
 /*
  * Read or write a filesystem buffer.
+ * All sectors of the block are transferred by a single request.
  */
 static int Do_Buffer_IO(struct FS_Buffer_Cache *cache, struct FS_Buffer *buf,
-    int (*IO_Func)(struct Block_Device *dev, int blockNum, void *buf))
+    int (*IO_Func)(struct Block_Device *dev, int blockNum, int numBlocks, void *buf))
 {
-    uint_t offset;
-    int sectorCount = 0;
-    int blockNum = buf->fsBlockNum * Get_Num_Sectors_Per_FS_Block(cache);
-    char *ptr = (char*) buf->data;
-
-    for (offset = 0; offset < cache->fsBlockSize; offset += SECTOR_SIZE) {
-	int rc = IO_Func(cache->dev, blockNum, ptr + offset);
-	if (rc != 0)
-	    return rc;
-	++sectorCount;
-	++blockNum;
-    }
-    KASSERT(offset == cache->fsBlockSize);
-    KASSERT(sectorCount == Get_Num_Sectors_Per_FS_Block(cache));
+    uint_t numSectors = Get_Num_Sectors_Per_FS_Block(cache);
+    int blockNum = buf->fsBlockNum * numSectors;
 
-    return 0;
+    return IO_Func(cache->dev, blockNum, numSectors, buf->data);
 }
 
 /*
@@ -69,11 +71,11 @@ static int Sync_Buffer(struct FS_Buffer_Cache *cache, struct FS_Buffer *buf)
 {
     int rc = 0;
 
-    KASSERT(IS_HELD(&cache->lock));
+    KASSERT(RW_IS_LOCKED(&cache->lock));
 
     if (buf->flags & FS_BUFFER_DIRTY) {
-	if ((rc = Do_Buffer_IO(cache, buf, Block_Write)) == 0)
-	    buf->flags &= ~(FS_BUFFER_DIRTY);
+	if ((rc = Do_Buffer_IO(cache, buf, Block_Write_Multiple)) == 0)
+	    Clear_Buffer_Flags(buf, FS_BUFFER_DIRTY);
     }
 
     return rc;
@@ -89,9 +91,63 @@ static void Move_To_Front(struct FS_Buffer_Cache *cache, struct FS_Buffer *buf)
     Add_To_Front_Of_FS_Buffer_List(&cache->bufferList, buf);
 }
 
+/*
+ * Mark a buffer found in the cache as in use.
+ * Returns false if some other thread is using it.
+ */
+static bool Try_Acquire_Buffer(struct FS_Buffer *buf)
+{
+    bool acquired = false;
+    bool iflag = Begin_Int_Atomic();
+
+    if (!(buf->flags & FS_BUFFER_INUSE)) {
+	buf->flags |= FS_BUFFER_INUSE;
+	acquired = true;
+    }
+
+    End_Int_Atomic(iflag);
+    return acquired;
+}
+
+/*
+ * Drop the cache lock and wait until given buffer is released.
+ * The caller must look the block up again afterwards, since
+ * the buffer may have been reused for another block meanwhile.
+ */
+static void Wait_For_Buffer(struct FS_Buffer_Cache *cache, struct FS_Buffer *buf, bool write)
+{
+    bool iflag = Begin_Int_Atomic();
+
+    if (write)
+	RW_Write_Unlock(&cache->lock);
+    else
+	RW_Read_Unlock(&cache->lock);
+
+    if (buf->flags & FS_BUFFER_INUSE) {
+	Debug("Waiting for block %lu\n", buf->fsBlockNum);
+	Wait_For(&cache->waitQueue, WAIT_BLOCK_IO);
+    }
+
+    End_Int_Atomic(iflag);
+}
+
+/*
+ * Look for a cached buffer for given block.
+ */
+static struct FS_Buffer *Find_Buffer(struct FS_Buffer_Cache *cache, ulong_t fsBlockNum)
+{
+    struct FS_Buffer *buf = Get_Front_Of_FS_Buffer_List(&cache->bufferList);
+
+    while (buf != 0 && buf->fsBlockNum != fsBlockNum)
+	buf = Get_Next_In_FS_Buffer_List(buf);
+    return buf;
+}
+
 /*
  * Get buffer for given block, and mark it in use.
- * Must be called with cache mutex held.
+ * Must be called with the cache write lock held.
+ * If the block is cached but in use, returns EBUSY
+ * and sets *pBuf to the buffer.
  */
 static int Get_Buffer(struct FS_Buffer_Cache *cache, ulong_t fsBlockNum, struct FS_Buffer **pBuf)
 {
@@ -100,7 +156,7 @@ static int Get_Buffer(struct FS_Buffer_Cache *cache, ulong_t fsBlockNum, struct
 
     Debug("Request block %lu\n", fsBlockNum);
 
-    KASSERT(IS_HELD(&cache->lock));
+    KASSERT(RW_IS_WRITE_HELD(&cache->lock));
 
     /*
      * Look for existing buffer.
@@ -110,10 +166,10 @@ static int Get_Buffer(struct FS_Buffer_Cache *cache, ulong_t fsBlockNum, struct
     buf = Get_Front_Of_FS_Buffer_List(&cache->bufferList);
     while (buf != 0) {
 	if (buf->fsBlockNum == fsBlockNum) {
-	    /* If buffer is in use, wait until it is available. */
-	    while (buf->flags & FS_BUFFER_INUSE) {
-		Debug("Waiting for block %lu\n", fsBlockNum);
-		Cond_Wait(&cache->cond, &cache->lock);
+	    /* If buffer is in use, the caller must wait for it. */
+	    if (buf->flags & FS_BUFFER_INUSE) {
+		*pBuf = buf;
+		return EBUSY;
 	    }
 	    goto done;
 	}
@@ -139,6 +195,7 @@ static int Get_Buffer(struct FS_Buffer_Cache *cache, ulong_t fsBlockNum, struct
 		/* Successful creation */
 		buf->fsBlockNum = fsBlockNum;
 		buf->flags = 0;
+		buf->request = 0;
 		Add_To_Front_Of_FS_Buffer_List(&cache->bufferList, buf);
 		++cache->numCached;
 		goto readAndAcquire;
@@ -174,7 +231,7 @@ readAndAcquire:
     KASSERT(Get_Front_Of_FS_Buffer_List(&cache->bufferList) == buf);
 
     /* Read block data into buffer. */
-    if ((rc = Do_Buffer_IO(cache, buf, Block_Read)) != 0)
+    if ((rc = Do_Buffer_IO(cache, buf, Block_Read_Multiple)) != 0)
 	return rc;
 
 done:
@@ -189,19 +246,65 @@ done:
 
 /*
  * Synchronize cache with disk.
+ * The writes for dirty buffers are posted in batches,
+ * so that the I/O scheduler can sort and merge them before
+ * they reach the disk.  A batch is limited by the number of
+ * requests available in the device's request pool.
  */
 static int Sync_Cache(struct FS_Buffer_Cache *cache)
 {
-    int rc = 0;
-    struct FS_Buffer *buf;
+    int rc = 0, writeRc;
+    struct FS_Buffer *buf, *batch, *next;
+    uint_t numSectors = Get_Num_Sectors_Per_FS_Block(cache);
+    bool iflag;
+
+    KASSERT(RW_IS_WRITE_HELD(&cache->lock));
+
+    next = Get_Front_Of_FS_Buffer_List(&cache->bufferList);
+    while (next != 0 && rc == 0) {
+	/* Create write requests until the pool runs dry. */
+	batch = next;
+	for (buf = batch; buf != 0; buf = Get_Next_In_FS_Buffer_List(buf)) {
+	    buf->request = 0;
+	    if (buf->flags & FS_BUFFER_DIRTY) {
+		buf->request = Create_Request(cache->dev, BLOCK_WRITE,
+		    buf->fsBlockNum * numSectors, numSectors, buf->data);
+		if (buf->request == 0)
+		    break;
+	    }
+	}
+	next = buf;
 
-    KASSERT(IS_HELD(&cache->lock));
+	/* Post the batch at once. */
+	iflag = Begin_Int_Atomic();
+	for (buf = batch; buf != next; buf = Get_Next_In_FS_Buffer_List(buf)) {
+	    if (buf->request != 0)
+		Post_Request(buf->request);
+	}
+	End_Int_Atomic(iflag);
+
+	/* Wait for completion. */
+	for (buf = batch; buf != next; buf = Get_Next_In_FS_Buffer_List(buf)) {
+	    if (buf->request != 0) {
+		writeRc = Wait_For_Request(buf->request);
+		if (writeRc == 0)
+		    Clear_Buffer_Flags(buf, FS_BUFFER_DIRTY);
+		else if (rc == 0)
+		    rc = writeRc;
+		Free_Request(buf->request);
+		buf->request = 0;
+	    }
+	}
 
-    buf = Get_Front_Of_FS_Buffer_List(&cache->bufferList);
-    while (buf != 0) {
-	if ((rc = Sync_Buffer(cache, buf)) != 0)
-	    break;
-	buf = Get_Next_In_FS_Buffer_List(buf);
+	/*
+	 * If not even one request could be created, write
+	 * the buffer synchronously to make progress.
+	 */
+	if (next == batch) {
+	    if ((rc = Sync_Buffer(cache, next)) != 0)
+		break;
+	    next = Get_Next_In_FS_Buffer_List(next);
+	}
     }
 
     return rc;
@@ -245,8 +348,8 @@ struct FS_Buffer_Cache *Create_FS_Buffer_Cache(struct Block_Device *dev, uint_t
     cache->fsBlockSize = fsBlockSize;
     cache->numCached = 0;
     Clear_FS_Buffer_List(&cache->bufferList);
-    Mutex_Init(&cache->lock);
-    Cond_Init(&cache->cond);
+    RW_Lock_Init(&cache->lock, RW_FAIR);
+    Clear_Thread_Queue(&cache->waitQueue);
 
     return cache;
 }
@@ -259,9 +362,9 @@ int Sync_FS_Buffer_Cache(struct FS_Buffer_Cache *cache)
 {
     int rc;
 
-    Mutex_Lock(&cache->lock);
+    RW_Write_Lock(&cache->lock);
     rc = Sync_Cache(cache);
-    Mutex_Unlock(&cache->lock);
+    RW_Write_Unlock(&cache->lock);
 
     return rc;
 }
@@ -276,7 +379,7 @@ int Destroy_FS_Buffer_Cache(struct FS_Buffer_Cache *cache)
     int rc;
     struct FS_Buffer *buf;
 
-    Mutex_Lock(&cache->lock);
+    RW_Write_Lock(&cache->lock);
 
     /* Flush all contents back to disk. */
     rc = Sync_Cache(cache);
@@ -290,7 +393,7 @@ int Destroy_FS_Buffer_Cache(struct FS_Buffer_Cache *cache)
     }
     Clear_FS_Buffer_List(&cache->bufferList);
 
-    Mutex_Unlock(&cache->lock);
+    RW_Write_Unlock(&cache->lock);
 
     /* Free the cache object itself. */
     Free(cache);
@@ -300,13 +403,40 @@ int Destroy_FS_Buffer_Cache(struct FS_Buffer_Cache *cache)
 
 /*
  * Get a buffer for given filesystem block.
+ * Cache hits only need the read lock, so threads using
+ * different cached blocks don't serialize on the cache.
+ * Misses take the write lock to change the buffer list
+ * and read the block.
  */
 int Get_FS_Buffer(struct FS_Buffer_Cache *cache, ulong_t fsBlockNum, struct FS_Buffer **pBuf)
 {
+    struct FS_Buffer *buf;
     int rc;
-    Mutex_Lock(&cache->lock);
-    rc = Get_Buffer(cache, fsBlockNum, pBuf);
-    Mutex_Unlock(&cache->lock);
+
+    for (;;) {
+	RW_Read_Lock(&cache->lock);
+	buf = Find_Buffer(cache, fsBlockNum);
+	if (buf == 0)
+	    break;
+	if (Try_Acquire_Buffer(buf)) {
+	    RW_Read_Unlock(&cache->lock);
+	    Debug("Acquired block %lu\n", fsBlockNum);
+	    *pBuf = buf;
+	    return 0;
+	}
+	Wait_For_Buffer(cache, buf, false);
+    }
+    RW_Read_Unlock(&cache->lock);
+
+    /* Not cached: another thread may read it in before we get the lock. */
+    for (;;) {
+	RW_Write_Lock(&cache->lock);
+	rc = Get_Buffer(cache, fsBlockNum, pBuf);
+	if (rc != EBUSY)
+	    break;
+	Wait_For_Buffer(cache, *pBuf, true);
+    }
+    RW_Write_Unlock(&cache->lock);
 
     return rc;
 }
@@ -330,9 +460,9 @@ int Sync_FS_Buffer(struct FS_Buffer_Cache *cache, struct FS_Buffer *buf)
 
     KASSERT(buf->flags & FS_BUFFER_INUSE);
 
-    Mutex_Lock(&cache->lock);
+    RW_Read_Lock(&cache->lock);
     rc = Sync_Buffer(cache, buf);
-    Mutex_Unlock(&cache->lock);
+    RW_Read_Unlock(&cache->lock);
 
     return rc;
 }
@@ -343,22 +473,22 @@ int Sync_FS_Buffer(struct FS_Buffer_Cache *cache, struct FS_Buffer *buf)
 int Release_FS_Buffer(struct FS_Buffer_Cache *cache, struct FS_Buffer *buf)
 {
 	int rc = 0;
+    bool iflag;
     KASSERT(buf->flags & FS_BUFFER_INUSE);
 
-    Mutex_Lock(&cache->lock);
-
     /*
      * If the buffer is OK to release,
      * mark it as no longer in use and notify any
-     * thread waiting to use it.
+     * thread waiting to use it.  No cache lock is needed:
+     * the in-use flag is only tested and set atomically.
      */
     if (rc == 0) {
+	iflag = Begin_Int_Atomic();
 	buf->flags &= ~(FS_BUFFER_INUSE);
-	Cond_Broadcast(&cache->cond);
+	Wake_Up(&cache->waitQueue);
+	End_Int_Atomic(iflag);
     }
     Debug("Released block %lu\n", buf->fsBlockNum);
 
-    Mutex_Unlock(&cache->lock);
-
     return rc;
 }
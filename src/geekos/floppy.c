@@ -17,6 +17,7 @@
 #include <geekos/io.h>
 #include <geekos/timer.h>
 #include <geekos/kthread.h>
+#include <geekos/scheduler.h>
 #include <geekos/blockdev.h>
 #include <geekos/floppy.h>
 
@@ -46,6 +47,9 @@
  * History:
  * 23-Oct-2003: Works under Bochs 2.0 for read transfers.
  * 12-Nov-2003: Modified to use block device API.
+ * Reads fetch a whole track by DMA into a track cache, writes move
+ * runs of sectors within a track with one command, and the motor is
+ * turned off by a timer once the drive has been idle for a while.
  */
 
 /* ----------------------------------------------------------------------
@@ -123,6 +127,25 @@
 
 enum { FLOPPY_READ, FLOPPY_WRITE };
 
+/*
+ * Most sectors per track of any supported floppy type,
+ * and the size of the track buffer.
+ */
+#define FLOPPY_MAX_TRACK_SECTORS	18
+#define FLOPPY_TRACK_BUF_SIZE		(FLOPPY_MAX_TRACK_SECTORS * SECTOR_SIZE)
+
+/*
+ * The DMA controller cannot cross a 64K boundary.
+ */
+#define FLOPPY_DMA_BOUNDARY		0x10000UL
+
+/*
+ * Idle time after which the motor is turned off (about 2 seconds),
+ * and time to wait after turning it on.
+ */
+#define FLOPPY_MOTOR_OFF_TICKS		36
+#define FLOPPY_SPIN_UP_USEC		8000
+
 /*#define FLOPPY_DEBUG */
 #ifdef FLOPPY_DEBUG
 #  define Debug(args...) Print(args)
@@ -167,6 +190,9 @@ static struct Floppy_Parameters s_floppyParamsTable[] = {
  */
 struct Floppy_Drive {
     struct Floppy_Parameters *params;
+    int cylinder;		/* cylinder the head is on, -1 if unknown */
+    bool motorOn;
+    int motorTimerId;		/* timer turning the motor off, -1 if none */
 };
 
 /*
@@ -181,14 +207,25 @@ struct Floppy_Drive s_driveTable[2];
 static struct Thread_Queue s_floppyInterruptWaitQueue;
 
 /*
- * Page of memory used for floppy DMA.
+ * Buffer used for floppy DMA; it holds one full track.
+ */
+static uchar_t *s_trackBuf;
+
+/*
+ * The track whose contents are in s_trackBuf, if valid.
  */
-static uchar_t *s_transferBuf;
+struct Floppy_Track_Cache {
+    bool valid;
+    int drive;
+    int cylinder;
+    int head;
+};
+static struct Floppy_Track_Cache s_trackCache;
 
 /*
  * Queue of floppy block I/O requests.
  */
-static struct Block_Request_List s_floppyRequestQueue;
+static struct Block_Request_Queue s_floppyRequestQueue;
 
 /*
  * Thread queue where request processing thread sleeps waiting for
@@ -235,6 +272,8 @@ static int Floppy_Get_Num_Blocks(struct Block_Device *dev)
     return params->cylinders * params->heads * params->sectors;
 }
 
+static int Floppy_Transfer_Request(struct Block_Device *dev, struct Block_Request *request);
+
 /*
  * Block_Device_Ops for floppy driver.
  */
@@ -242,6 +281,7 @@ static struct Block_Device_Ops s_floppyDeviceOps = {
     Floppy_Open,
     Floppy_Close,
     Floppy_Get_Num_Blocks,
+    Floppy_Transfer_Request,
 };
 
 /*
@@ -273,7 +313,11 @@ static void Setup_Drive_Parameters(int drive, int type)
 	snprintf(devname, sizeof(devname), "fd%d", drive);
 	Print("    %s: cyl=%d, heads=%d, sectors=%d\n", devname,
 		 params->cylinders, params->heads, params->sectors);
+	KASSERT(params->sectors <= FLOPPY_MAX_TRACK_SECTORS);
 	s_driveTable[drive].params = params;
+	s_driveTable[drive].cylinder = -1;
+	s_driveTable[drive].motorOn = false;
+	s_driveTable[drive].motorTimerId = -1;
 
 	/* Register the block device. */
 	rc = Register_Block_Device(devname, &s_floppyDeviceOps, drive, 0,
@@ -339,12 +383,12 @@ static void Floppy_Out(uchar_t val)
  * Wait for the controller to issue an interrupt.
  * Must be called with interrupts disabled.
  */
-static void Wait_For_Interrupt(void)
+static void Wait_For_Floppy_Interrupt(void)
 {
     KASSERT(!Interrupts_Enabled());
 
     /* Wait for interrupt */
-    Wait(&s_floppyInterruptWaitQueue);
+    Wait_For(&s_floppyInterruptWaitQueue, WAIT_DEVICE);
 }
 
 static void Sense_Interrupt_Status(uchar_t* st0, uchar_t *pcn)
@@ -369,7 +413,7 @@ static bool Calibrate(int drive)
 	/* Issue the calibrate command */
 	Floppy_Out(FDC_COMMAND_CALIBRATE);
 	Floppy_Out((uchar_t) drive);
-	Wait_For_Interrupt();
+	Wait_For_Floppy_Interrupt();
 
 	/* Check interrupt status, to see if calibrate succeeded */
 	Sense_Interrupt_Status(&st0, &pcn);
@@ -389,6 +433,7 @@ static void Start_Motor(int drive)
     Debug("Start Motor %d\n", drive);
     Out_Byte(FDC_DOR_REG,
   	FDC_DOR_MOTOR(drive) | FDC_DOR_DMA_ENABLE | FDC_DOR_RESET_DISABLE | FDC_DOR_DRIVE_SELECT(drive));
+    s_driveTable[drive].motorOn = true;
 }
 
 static void Stop_Motor(int drive)
@@ -396,6 +441,71 @@ static void Stop_Motor(int drive)
     Debug("Stop Motor %d\n", drive);
     Out_Byte(FDC_DOR_REG,
 	FDC_DOR_DMA_ENABLE | FDC_DOR_RESET_DISABLE | FDC_DOR_DRIVE_SELECT(drive));
+    s_driveTable[drive].motorOn = false;
+}
+
+/*
+ * Timer callback which turns off the motor of an idle drive.
+ * Called from the timer interrupt handler.
+ */
+static void Motor_Off_Callback(int id)
+{
+    int drive;
+
+    for (drive = 0; drive < 2; ++drive) {
+	if (s_driveTable[drive].motorTimerId == id) {
+	    Cancel_Timer(id);
+	    s_driveTable[drive].motorTimerId = -1;
+	    Stop_Motor(drive);
+	}
+    }
+}
+
+/*
+ * Make sure the motor is running before a command,
+ * waiting for it to spin up if it was off.
+ * Must be called with interrupts disabled.
+ */
+static void Motor_On(int drive)
+{
+    struct Floppy_Drive *d = &s_driveTable[drive];
+
+    KASSERT(!Interrupts_Enabled());
+
+    if (d->motorTimerId >= 0) {
+	Cancel_Timer(d->motorTimerId);
+	d->motorTimerId = -1;
+    }
+
+    if (!d->motorOn) {
+	Start_Motor(drive);
+
+	/*
+	 * According to The Undocumented PC, we should wait 8 millis
+	 * before attempting a read or write.
+	 * Let other threads run in the meantime.
+	 */
+	Micro_Sleep(FLOPPY_SPIN_UP_USEC);
+    }
+}
+
+/*
+ * Let the motor keep running for a while after a request,
+ * so that a following request does not have to wait for it
+ * to spin up again.
+ */
+static void Schedule_Motor_Off(int drive)
+{
+    struct Floppy_Drive *d = &s_driveTable[drive];
+    bool iflag;
+
+    iflag = Begin_Int_Atomic();
+    if (d->motorOn && d->motorTimerId < 0) {
+	d->motorTimerId = Start_Timer(FLOPPY_MOTOR_OFF_TICKS, Motor_Off_Callback);
+	if (d->motorTimerId < 0)
+	    Stop_Motor(drive);	/* no timer available */
+    }
+    End_Int_Atomic(iflag);
 }
 
 /*
@@ -415,6 +525,7 @@ static bool Reset_Controller(void)
     Start_Motor(0);
     bool cal = Calibrate(0);
     Stop_Motor(0);
+    s_driveTable[0].cylinder = cal ? 0 : -1;
     return cal;
 }
 
@@ -426,24 +537,25 @@ static bool Floppy_Seek(int drive, int cylinder, int head)
 
     Debug("Floppy_Seek(%d,%d,%d)\n", drive, cylinder, head);
 
-    while (numAttempts-- > 0) {
-	Start_Motor(drive);
-	/*Micro_Delay(1000); */
+    /* No need to move the head if it is already there */
+    if (s_driveTable[drive].cylinder == cylinder)
+	return true;
 
+    while (numAttempts-- > 0) {
 	Disable_Interrupts();
 
+	Motor_On(drive);
+
 	Floppy_Out(FDC_COMMAND_SEEK);
 	Floppy_Out((head << 2) | (drive & 3));
 	Floppy_Out(cylinder & 0xFF);
 
 	Debug("Seek: waiting for interrupt\n");
-	Wait_For_Interrupt();
+	Wait_For_Floppy_Interrupt();
 	Debug("Seek: got interrupt\n");
 
 	Enable_Interrupts();
 
-	Stop_Motor(drive);
-
 	Sense_Interrupt_Status(&st0, &pcn);
 	if (st0 & FDC_ST0_SEEK_END) {
 	    /* Make sure we arrived at the desired cylinder */
@@ -457,14 +569,20 @@ static bool Floppy_Seek(int drive, int cylinder, int head)
 	}
     }
 
+    s_driveTable[drive].cylinder = success ? cylinder : -1;
     return success;
 }
 
-static int Floppy_Transfer(int direction, int driveNum, int blockNum, char *buf)
+/*
+ * Transfer numSectors consecutive sectors of one track, starting at
+ * the given sector, between the disk and the corresponding part
+ * of the track buffer.
+ */
+static int Floppy_Transfer(int direction, int driveNum, int cylinder, int head,
+    int sector, int numSectors)
 {
     struct Floppy_Drive *drive = &s_driveTable[driveNum];
     struct Floppy_Parameters *params = drive->params;
-    int cylinder, head, sector;
     enum DMA_Direction dmaDirection =
 	direction == FLOPPY_READ ? DMA_READ : DMA_WRITE;
     uchar_t command;
@@ -474,8 +592,7 @@ static int Floppy_Transfer(int direction, int driveNum, int blockNum, char *buf)
     KASSERT(driveNum == 0);  /* FIXME */
     KASSERT(direction == FLOPPY_READ || direction == FLOPPY_WRITE);
     KASSERT(params != 0);
-
-    LBA_To_CHS(&s_driveTable[driveNum], blockNum, &cylinder, &head, &sector);
+    KASSERT(sector > 0 && numSectors > 0 && sector + numSectors - 1 <= params->sectors);
 
     if (!Floppy_Seek(driveNum, cylinder, head))
 	return -1;
@@ -483,16 +600,11 @@ static int Floppy_Transfer(int direction, int driveNum, int blockNum, char *buf)
     Disable_Interrupts();
 
     /* Set up DMA for transfer */
-    Setup_DMA(dmaDirection, FDC_DMA, s_transferBuf, SECTOR_SIZE);
-
-    /* Turn the floppy motor on */
-    Start_Motor(driveNum);
+    Setup_DMA(dmaDirection, FDC_DMA, s_trackBuf + (sector - 1) * SECTOR_SIZE,
+	numSectors * SECTOR_SIZE);
 
-    /*
-     * According to The Undocumented PC, we should wait 8 millis
-     * before attempting a read or write.
-     */
-    Micro_Delay(8000);
+    /* Make sure the floppy motor is on */
+    Motor_On(driveNum);
 
     if (direction == FLOPPY_READ)
 	command = FDC_COMMAND_READ_SECTOR | FDC_MFM | FDC_SKIP_DELETED;
@@ -506,12 +618,12 @@ static int Floppy_Transfer(int direction, int driveNum, int blockNum, char *buf)
     Floppy_Out(head);
     Floppy_Out(sector);
     Floppy_Out(params->sectorSizeCode);
-    Floppy_Out(params->sectors);
+    Floppy_Out(sector + numSectors - 1);  /* EOT: last sector to transfer */
     Floppy_Out(params->gapLengthCode);
     Floppy_Out(0xFF);  /* DTL */
 
     /* Controller will issue an interrupt when the command is complete */
-    Wait_For_Interrupt();
+    Wait_For_Floppy_Interrupt();
     Debug("Floppy_Transfer: received interrupt!\n");
 
     /* Read results */
@@ -523,11 +635,12 @@ static int Floppy_Transfer(int direction, int driveNum, int blockNum, char *buf)
     Floppy_In();  /* sector number */
     Floppy_In();  /* sector size */
 
-    Stop_Motor(driveNum);
-
     if (FDC_ST0_IS_SUCCESS(st0)) {
 	Debug("Floppy_Transfer: successful transfer!\n");
 	result = 0;
+    } else {
+	/* Don't trust the head position after an error */
+	drive->cylinder = -1;
     }
 
     Enable_Interrupts();
@@ -536,36 +649,115 @@ static int Floppy_Transfer(int direction, int driveNum, int blockNum, char *buf)
     return result;
 }
 
-static int Floppy_Read(int driveNum, int blockNum, char *buffer)
+/*
+ * Return true if the track cache holds given track.
+ */
+static bool Is_Track_Cached(int driveNum, int cylinder, int head)
 {
-    int rc;
+    return s_trackCache.valid && s_trackCache.drive == driveNum &&
+	s_trackCache.cylinder == cylinder && s_trackCache.head == head;
+}
 
-    Debug("Floppy_Read(%d,%d,%x)\n", driveNum, blockNum, (uint_t)buffer);
+/*
+ * Make sure given track is in the track cache,
+ * reading all of its sectors with a single command if necessary.
+ */
+static int Floppy_Read_Track(int driveNum, int cylinder, int head)
+{
+    int rc;
 
-#ifndef NDEBUG
-    memset(buffer, (char) 0xcd, SECTOR_SIZE);
-    memset(s_transferBuf, (char) 0xcd, SECTOR_SIZE);
-#endif
+    if (Is_Track_Cached(driveNum, cylinder, head))
+	return 0;
 
-    rc = Floppy_Transfer(FLOPPY_READ, driveNum, blockNum, buffer);
+    Debug("Floppy_Read_Track(%d,%d,%d)\n", driveNum, cylinder, head);
 
+    s_trackCache.valid = false;
+    rc = Floppy_Transfer(FLOPPY_READ, driveNum, cylinder, head, 1,
+	s_driveTable[driveNum].params->sectors);
     if (rc == 0) {
-	/*
-	 * Successful transfer!
-	 * Copy data from transfer buffer into caller's buffer.
-	 */
-	memcpy(buffer, s_transferBuf, SECTOR_SIZE);
+	s_trackCache.valid = true;
+	s_trackCache.drive = driveNum;
+	s_trackCache.cylinder = cylinder;
+	s_trackCache.head = head;
     }
 
     return rc;
 }
 
-static int Floppy_Write(int driveNum, int blockNum, char *buffer)
+/*
+ * Write a run of consecutive sectors of one track,
+ * which have been copied to their place in the track buffer.
+ */
+static int Floppy_Write_Run(int driveNum, int cylinder, int head, int sector, int numSectors)
+{
+    int rc;
+
+    Debug("Floppy_Write_Run(%d,%d,%d,%d,%d)\n", driveNum, cylinder, head, sector, numSectors);
+
+    rc = Floppy_Transfer(FLOPPY_WRITE, driveNum, cylinder, head, sector, numSectors);
+    if (rc != 0)
+	s_trackCache.valid = false;
+
+    return rc;
+}
+
+/*
+ * Perform the I/O for every request of a merged chain.
+ * Reads are served from the track cache; writes go through
+ * the track buffer (keeping the cached track up to date),
+ * one command per run of sectors within a track.
+ */
+static int Floppy_Transfer_Request(struct Block_Device *dev, struct Block_Request *request)
 {
-    Debug("Floppy_Write(%d,%d,%x)\n", driveNum, blockNum, (uint_t)buffer);
+    int driveNum = dev->unit;
+    struct Floppy_Drive *drive = &s_driveTable[driveNum];
+    struct Block_Request *r;
+    int cylinder, head, sector;
+    int runCylinder = -1, runHead = -1, runSector = 0, runLength = 0;
+    int rc = 0, i;
+
+    for (r = request; r != 0 && rc == 0; r = r->mergeNext) {
+	for (i = 0; i < r->numBlocks && rc == 0; i++) {
+	    char *buf = (char *) r->buf + i * SECTOR_SIZE;
+
+	    LBA_To_CHS(drive, r->blockNum + i, &cylinder, &head, &sector);
+
+	    if (r->type == BLOCK_READ) {
+		rc = Floppy_Read_Track(driveNum, cylinder, head);
+		if (rc == 0)
+		    memcpy(buf, s_trackBuf + (sector - 1) * SECTOR_SIZE, SECTOR_SIZE);
+		continue;
+	    }
+
+	    /* Write out the current run when the next sector is on another track */
+	    if (runLength > 0 && (cylinder != runCylinder || head != runHead)) {
+		rc = Floppy_Write_Run(driveNum, runCylinder, runHead, runSector, runLength);
+		runLength = 0;
+		if (rc != 0)
+		    break;
+	    }
+
+	    if (runLength == 0) {
+		/* The track buffer will no longer hold the cached track */
+		if (!Is_Track_Cached(driveNum, cylinder, head))
+		    s_trackCache.valid = false;
+		runCylinder = cylinder;
+		runHead = head;
+		runSector = sector;
+	    }
+
+	    KASSERT(sector == runSector + runLength);
+	    memcpy(s_trackBuf + (sector - 1) * SECTOR_SIZE, buf, SECTOR_SIZE);
+	    ++runLength;
+	}
+    }
+
+    if (rc == 0 && runLength > 0)
+	rc = Floppy_Write_Run(driveNum, runCylinder, runHead, runSector, runLength);
+
+    Schedule_Motor_Off(driveNum);
 
-    memcpy(s_transferBuf, buffer, SECTOR_SIZE);
-    return Floppy_Transfer(FLOPPY_WRITE, driveNum, blockNum, buffer);
+    return rc;
 }
 
 /*
@@ -586,11 +778,8 @@ static void Floppy_Request_Thread(ulong_t arg)
 	Debug("FRQ: Got a floppy request [@%x]\n", (uint_t)request);
 	KASSERT(request->type == BLOCK_READ || request->type == BLOCK_WRITE);
 
-	/* Perform the I/O. */
-	if (request->type == BLOCK_READ)
-	    rc = Floppy_Read(request->dev->unit, request->blockNum, request->buf);
-	else
-	    rc = Floppy_Write(request->dev->unit, request->blockNum, request->buf);
+	/* Perform the I/O */
+	rc = Floppy_Transfer_Request(request->dev, request);
 
 	/* Notify the requesting thread of the outcome of the I/O. */
 	Debug("FRQ: Notifying requesting thread...\n");
@@ -614,8 +803,20 @@ void Init_Floppy(void)
 
     Print("Initializing floppy controller...\n");
 
-    /* Allocate memory for DMA transfers */
-    s_transferBuf = (uchar_t*) Alloc_Page();
+    Init_Block_Request_Queue(&s_floppyRequestQueue);
+
+    /*
+     * Allocate memory for DMA transfers.  Twice the size of the
+     * track buffer guarantees that one half does not cross a 64K boundary.
+     */
+    s_trackBuf = (uchar_t*) Malloc(2 * FLOPPY_TRACK_BUF_SIZE);
+    if (s_trackBuf == 0) {
+	Print("  Failed to allocate track buffer\n");
+	goto done;
+    }
+    if (((ulong_t) s_trackBuf & ~(FLOPPY_DMA_BOUNDARY - 1)) !=
+	(((ulong_t) s_trackBuf + FLOPPY_TRACK_BUF_SIZE) & ~(FLOPPY_DMA_BOUNDARY - 1)))
+	s_trackBuf = (uchar_t*) (((ulong_t) s_trackBuf + FLOPPY_DMA_BOUNDARY) & ~(FLOPPY_DMA_BOUNDARY - 1));
 
     /* Use CMOS to get floppy configuration */
     Out_Byte(CMOS_OUT, CMOS_FLOPPY_INDEX);
@@ -647,12 +848,14 @@ void Init_Floppy(void)
      * Start the request processing thread.
      */
     ready = true;
-#ifdef FLOPPY_DEBUG
     struct Kernel_Thread* floppy = 
-#endif
-    Start_Kernel_Thread(Floppy_Request_Thread, 0, PRIORITY_NORMAL, true);
+	Start_Kernel_Thread(Floppy_Request_Thread, 0, PRIORITY_NORMAL, true, "Floppy Requests");
     Debug ("Started floppy request thread, pid=%d\n", floppy->pid);
 
+    /* Serve requests with bounded delay */
+    if (floppy != 0)
+	Set_Real_Time(floppy, RT_FIFO, RT_PRIORITY_DEVICE, 0);
+
 done:
     if (!ready)
 	Print("  Floppy controller initialization FAILED\n");
@@ -0,0 +1,129 @@
+/*
+ * Fast user-space synchronization (futexes)
+ *
+ * A futex is an aligned word in user memory.  User code changes
+ * the word with atomic instructions, and only enters the kernel
+ * to sleep until the word changes, or to wake up sleepers.
+ *
+ * This is free software.  You are permitted to use,
+ * redistribute, and modify it as specified in the file "COPYING".
+ */
+
+#include <geekos/kassert.h>
+#include <geekos/defs.h>
+#include <geekos/errno.h>
+#include <geekos/int.h>
+#include <geekos/kthread.h>
+#include <geekos/list.h>
+#include <geekos/user.h>
+#include <geekos/futex.h>
+
+/*
+ * A thread sleeping on a futex.  Lives on the stack of the
+ * sleeping thread, in the hash bucket of its key.
+ */
+struct Futex_Waiter;
+DEFINE_LIST(Futex_Waiter_List, Futex_Waiter);
+
+struct Futex_Waiter {
+    struct User_Context* context;
+    ulong_t uaddr;
+    struct Thread_Queue waitQueue;
+    DEFINE_LINK(Futex_Waiter_List, Futex_Waiter);
+};
+
+IMPLEMENT_LIST(Futex_Waiter_List, Futex_Waiter);
+
+#define FUTEX_HASH_SIZE 32
+
+static struct Futex_Waiter_List s_futexHash[FUTEX_HASH_SIZE];
+
+/*
+ * Hash bucket of the futex at given address in given context.
+ */
+static struct Futex_Waiter_List* Futex_Bucket(struct User_Context* context, ulong_t uaddr)
+{
+    ulong_t key = (uaddr >> 2) ^ ((ulong_t) context >> 4);
+
+    return &s_futexHash[(key ^ (key >> 5)) % FUTEX_HASH_SIZE];
+}
+
+/*
+ * Wait until woken by Futex_Wake(), unless the word at
+ * user address uaddr no longer holds val.
+ * Returns 0 if woken, EBUSY if the word holds another value,
+ * or EINVALID if the address is not valid.
+ */
+int Futex_Wait(ulong_t uaddr, int val)
+{
+    struct User_Context* context = g_currentThread->userContext;
+    struct Futex_Waiter waiter;
+    struct Futex_Waiter_List* bucket;
+    int current;
+    bool iflag;
+
+    KASSERT(context != 0);
+    if (uaddr & 3)
+	return EINVALID;
+
+    iflag = Begin_Int_Atomic();
+
+    /*
+     * The word is read with interrupts disabled, and stays
+     * disabled until we sleep, so a waker which changes the
+     * word after we read it is sure to find us.
+     */
+    if (!__copy_from_user(context, &current, uaddr, sizeof(current))) {
+	End_Int_Atomic(iflag);
+	return EINVALID;
+    }
+    if (current != val) {
+	End_Int_Atomic(iflag);
+	return EBUSY;
+    }
+
+    waiter.context = context;
+    waiter.uaddr = uaddr;
+    Clear_Thread_Queue(&waiter.waitQueue);
+    bucket = Futex_Bucket(context, uaddr);
+    Add_To_Back_Of_Futex_Waiter_List(bucket, &waiter);
+
+    Wait_For(&waiter.waitQueue, WAIT_FUTEX);
+
+    End_Int_Atomic(iflag);
+    return 0;
+}
+
+/*
+ * Wake up to count threads waiting on the futex at user address
+ * uaddr, in the order they started waiting.
+ * Returns the number of threads woken up.
+ */
+int Futex_Wake(ulong_t uaddr, int count)
+{
+    struct User_Context* context = g_currentThread->userContext;
+    struct Futex_Waiter_List* bucket;
+    struct Futex_Waiter* waiter;
+    int woken = 0;
+    bool iflag;
+
+    KASSERT(context != 0);
+
+    iflag = Begin_Int_Atomic();
+
+    bucket = Futex_Bucket(context, uaddr);
+    waiter = Get_Front_Of_Futex_Waiter_List(bucket);
+    while (waiter != 0 && woken < count) {
+	struct Futex_Waiter* next = Get_Next_In_Futex_Waiter_List(waiter);
+
+	if (waiter->context == context && waiter->uaddr == uaddr) {
+	    Remove_From_Futex_Waiter_List(bucket, waiter);
+	    Wake_Up(&waiter->waitQueue);
+	    ++woken;
+	}
+	waiter = next;
+    }
+
+    End_Int_Atomic(iflag);
+    return woken;
+}
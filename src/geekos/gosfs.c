@@ -19,7 +19,6 @@
 #include <geekos/bufcache.h>
 #include <geekos/gosfs.h>
 #include <geekos/user.h>
-#include <libc/sched.h>
 
 #ifdef DEBUG
 #ifndef FS_DEBUG
@@ -1674,7 +1673,7 @@ static int GOSFS_Mount(struct Mount_Point *mountPoint)
         goto finish;
     }
     // 初始化mutex
-    Mutex_Init(&instance->lock);
+    Mutex_Init_Named(&instance->lock, "gosfs");
     instance->buffercache = gosfs_cache;
     bwritten = 0;
     superblock = &(instance->superblock);
@@ -12,21 +12,41 @@
  * NOTES:
  * 12/22/03 - Converted to use new block device layer with queued requests
  *  1/20/04 - Changed probing of drives to work on Bochs 2.0 with 2 drives
+ *           - Transfers are interrupt driven: the request thread sleeps
+ *             until the drive raises IRQ 14, instead of polling the
+ *             status register with interrupts disabled
+ *           - LBA28 addressing, and one READ/WRITE MULTIPLE command
+ *             per chain of merged requests
+ *           - PCI bus master DMA (PIIX style) when the controller and
+ *             drive support it, falling back to PIO otherwise
+ */
+
+/*
+ * Information sources:
+ * - Programming Interface for Bus Master IDE Controller, rev 1.0
+ *   (Intel, 1994)
  */
 
 #include <geekos/ktypes.h>
 #include <geekos/kassert.h>
 #include <geekos/errno.h>
 #include <geekos/malloc.h>
+#include <geekos/mem.h>
 #include <geekos/string.h>
 #include <geekos/io.h>
 #include <geekos/int.h>
+#include <geekos/irq.h>
 #include <geekos/screen.h>
 #include <geekos/timer.h>
 #include <geekos/kthread.h>
+#include <geekos/scheduler.h>
 #include <geekos/blockdev.h>
+#include <geekos/pci.h>
 #include <geekos/ide.h>
 
+/* Primary controller IRQ */
+#define IDE_IRQ				14
+
 /* Registers */
 #define IDE_DATA_REGISTER		0x1f0
 #define IDE_ERROR_REGISTER		0x1f1
@@ -53,6 +73,11 @@
 #define IDE_COMMAND_WRITE_BUFFER	0xE8
 #define IDE_COMMAND_DIAGNOSTIC		0x90
 #define IDE_COMMAND_ATAPI_IDENT_DRIVE	0xA1
+#define IDE_COMMAND_READ_MULTIPLE	0xC4
+#define IDE_COMMAND_WRITE_MULTIPLE	0xC5
+#define IDE_COMMAND_SET_MULTIPLE	0xC6
+#define IDE_COMMAND_READ_DMA		0xC8
+#define IDE_COMMAND_WRITE_DMA		0xCA
 
 /* Results words from Identify Drive Request */
 #define	IDE_INDENTIFY_NUM_CYLINDERS	0x01
@@ -60,6 +85,51 @@
 #define	IDE_INDENTIFY_NUM_BYTES_TRACK	0x04
 #define	IDE_INDENTIFY_NUM_BYTES_SECTOR	0x05
 #define	IDE_INDENTIFY_NUM_SECTORS_TRACK	0x06
+#define	IDE_INDENTIFY_MAX_MULTIPLE	0x2F
+#define	IDE_INDENTIFY_CAPABILITIES	0x31
+#define	IDE_INDENTIFY_LBA_SECTORS	0x3C
+
+/* Bits of the capabilities word */
+#define IDE_CAPABILITY_DMA		0x0100
+#define IDE_CAPABILITY_LBA		0x0200
+
+/* Drive/head register bit selecting LBA addressing */
+#define IDE_DRIVE_HEAD_LBA		0x40
+
+/* Most sectors a single command may transfer (sector count 0 means 256) */
+#define IDE_MAX_SECTORS_PER_COMMAND	256
+
+/* Most sectors per interrupt we ask for in multiple mode */
+#define IDE_MAX_MULTIPLE		16
+
+/* Bus master registers of the primary channel (offsets from BAR4) */
+#define IDE_BM_COMMAND_REGISTER		0x0
+#define IDE_BM_STATUS_REGISTER		0x2
+#define IDE_BM_PRD_TABLE_REGISTER	0x4
+
+/* Bits of the bus master command register */
+#define IDE_BM_COMMAND_START		0x01
+#define IDE_BM_COMMAND_READ		0x08	/* drive to memory */
+
+/* Bits of the bus master status register */
+#define IDE_BM_STATUS_ACTIVE		0x01
+#define IDE_BM_STATUS_ERROR		0x02
+#define IDE_BM_STATUS_INTERRUPT		0x04
+
+/*
+ * Physical Region Descriptor: one contiguous piece of memory
+ * in a bus master transfer.  A region may not cross a 64K
+ * boundary, and a byte count of 0 means 64K.
+ */
+struct IDE_PRD {
+    ulong_t addr;
+    ushort_t count;
+    ushort_t flags;
+};
+
+#define IDE_PRD_END_OF_TABLE		0x8000
+#define IDE_PRD_BOUNDARY		0x10000UL
+#define IDE_MAX_PRDS			(PAGE_SIZE / sizeof(struct IDE_PRD))
 
 /* bits of Status Register */
 #define IDE_STATUS_DRIVE_BUSY		0x80
@@ -81,6 +151,12 @@
 #define	IDE_ERROR_INVALID_BLOCK	-2
 #define	IDE_ERROR_DRIVE_ERROR	-3
 
+/*
+ * Status register reads to wait for DRQ before a write.  Each read
+ * takes about a microsecond on the ISA bus, so this is about a second.
+ */
+#define IDE_DRQ_TIMEOUT_READS	1000000
+
 /* Control register bits */
 #define IDE_CONTROL_REGISTER		0x3F6
 #define IDE_CONTROL_SOFTWARE_RESET	0x04
@@ -102,6 +178,10 @@ typedef struct {
     short num_Heads;
     short num_SectorsPerTrack;
     short num_BytesPerSector;
+    int num_Blocks;		/* total number of addressable sectors */
+    bool lba;			/* use LBA28 instead of CHS addressing */
+    int multiple;		/* sectors per interrupt in multiple mode, 0 if unsupported */
+    bool dma;			/* use bus master DMA */
 } ideDisk;
 
 int ideDebug = 0;
@@ -109,7 +189,23 @@ static int numDrives;
 static ideDisk drives[IDE_MAX_DRIVES];
 
 struct Thread_Queue s_ideWaitQueue;
-struct Block_Request_List s_ideRequestQueue;
+struct Block_Request_Queue s_ideRequestQueue;
+
+/*
+ * Thread queue where the request thread waits for the
+ * drive to raise an interrupt, the flag set by the interrupt
+ * handler, and the drive status read by the handler.
+ */
+static struct Thread_Queue s_ideInterruptWaitQueue;
+static volatile bool s_ideInterruptPending;
+static volatile int s_ideInterruptStatus;
+
+/*
+ * Bus master I/O base of the primary channel (0 if there is
+ * no bus master controller), and its table of PRDs.
+ */
+static ushort_t s_ideBusMasterBase;
+static struct IDE_PRD *s_idePrdTable;
 
 /*
  * return the number of logical blocks for a particular drive.
@@ -121,161 +217,371 @@ static int IDE_getNumBlocks(int driveNum)
         return IDE_ERROR_BAD_DRIVE;
     }
 
-    return (drives[driveNum].num_Heads * 
-            drives[driveNum].num_SectorsPerTrack *
-	    drives[driveNum].num_Cylinders);
+    return drives[driveNum].num_Blocks;
 }
 
 /*
- * Read a block at the logical block number indicated.
+ * Interrupt handler.
+ * Reading the status register acknowledges the interrupt
+ * to the drive.
  */
-static int IDE_Read(int driveNum, int blockNum, char *buffer)
+static void IDE_Interrupt_Handler(struct Interrupt_State* state)
 {
-    int i;
-    int head;
-    int sector;
-    int cylinder;
-    short *bufferW;
-    int reEnable = 0;
+    Begin_IRQ(state);
+    s_ideInterruptStatus = In_Byte(IDE_STATUS_REGISTER);
+    s_ideInterruptPending = true;
+    Wake_Up(&s_ideInterruptWaitQueue);
+    End_IRQ(state);
+}
 
-    if (driveNum < 0 || driveNum > (numDrives-1)) {
-	if (ideDebug) Print("ide: invalid drive %d\n", driveNum);
-        return IDE_ERROR_BAD_DRIVE;
-    }
+/*
+ * Wait for the drive to raise an interrupt.
+ * Must be called with interrupts disabled; other threads
+ * run while the calling thread is waiting.
+ * Returns the drive status at the time of the interrupt.
+ */
+static int IDE_Wait_For_Interrupt(void)
+{
+    KASSERT(!Interrupts_Enabled());
 
-    if (blockNum < 0 || blockNum >= IDE_getNumBlocks(driveNum)) {
-	if (ideDebug) Print("ide: invalid block %d\n", blockNum);
-        return IDE_ERROR_INVALID_BLOCK;
-    }
+    while (!s_ideInterruptPending)
+	Wait_For(&s_ideInterruptWaitQueue, WAIT_DEVICE);
+    s_ideInterruptPending = false;
 
-    if (Interrupts_Enabled()) {
-	Disable_Interrupts();
-	reEnable = 1;
-    }
+    return s_ideInterruptStatus;
+}
 
-    /* now compute the head, cylinder, and sector */
-    sector = blockNum % drives[driveNum].num_SectorsPerTrack + 1;
-    cylinder = blockNum / (drives[driveNum].num_Heads * 
-     	drives[driveNum].num_SectorsPerTrack);
-    head = (blockNum / drives[driveNum].num_SectorsPerTrack) % 
-        drives[driveNum].num_Heads;
-
-    if (ideDebug >= 2) {
-	Print ("request to read block %d\n", blockNum);
-	Print ("    head %d\n", head);
-	Print ("    cylinder %d\n", cylinder);
-	Print ("    sector %d\n", sector);
-    }
+/*
+ * Program the task file registers for a transfer of numBlocks
+ * (at most IDE_MAX_SECTORS_PER_COMMAND) sectors starting at blockNum,
+ * and issue the command.
+ * Must be called with interrupts disabled.
+ */
+static void IDE_Issue_Command(int driveNum, int blockNum, int numBlocks, int command)
+{
+    int driveSelect = (driveNum == 0) ? IDE_DRIVE_0 : IDE_DRIVE_1;
+
+    KASSERT(!Interrupts_Enabled());
+    KASSERT(numBlocks > 0 && numBlocks <= IDE_MAX_SECTORS_PER_COMMAND);
+
+    if (ideDebug >= 2)
+	Print ("request for %d blocks at block %d\n", numBlocks, blockNum);
+
+    /* Forget interrupts left over from earlier commands */
+    s_ideInterruptPending = false;
+
+    /* A sector count of 0 means 256 sectors */
+    Out_Byte(IDE_SECTOR_COUNT_REGISTER, numBlocks & 0xff);
+
+    if (drives[driveNum].lba) {
+	Out_Byte(IDE_SECTOR_NUMBER_REGISTER, blockNum & 0xff);
+	Out_Byte(IDE_CYLINDER_LOW_REGISTER, (blockNum >> 8) & 0xff);
+	Out_Byte(IDE_CYLINDER_HIGH_REGISTER, (blockNum >> 16) & 0xff);
+	Out_Byte(IDE_DRIVE_HEAD_REGISTER,
+	    driveSelect | IDE_DRIVE_HEAD_LBA | ((blockNum >> 24) & 0x0f));
+    } else {
+	int head;
+	int sector;
+	int cylinder;
+
+	/* now compute the head, cylinder, and sector */
+	sector = blockNum % drives[driveNum].num_SectorsPerTrack + 1;
+	cylinder = blockNum / (drives[driveNum].num_Heads * 
+	    drives[driveNum].num_SectorsPerTrack);
+	head = (blockNum / drives[driveNum].num_SectorsPerTrack) % 
+	    drives[driveNum].num_Heads;
+
+	if (ideDebug >= 2) {
+	    Print ("    head %d\n", head);
+	    Print ("    cylinder %d\n", cylinder);
+	    Print ("    sector %d\n", sector);
+	}
 
-    Out_Byte(IDE_SECTOR_COUNT_REGISTER, 1);
-    Out_Byte(IDE_SECTOR_NUMBER_REGISTER, sector);
-    Out_Byte(IDE_CYLINDER_LOW_REGISTER, LOW_BYTE(cylinder));
-    Out_Byte(IDE_CYLINDER_HIGH_REGISTER, HIGH_BYTE(cylinder));
-    if (driveNum == 0) {
-	Out_Byte(IDE_DRIVE_HEAD_REGISTER, IDE_DRIVE_0 | head);
-    } else if (driveNum == 1) {
-	Out_Byte(IDE_DRIVE_HEAD_REGISTER, IDE_DRIVE_1 | head);
+	Out_Byte(IDE_SECTOR_NUMBER_REGISTER, sector);
+	Out_Byte(IDE_CYLINDER_LOW_REGISTER, LOW_BYTE(cylinder));
+	Out_Byte(IDE_CYLINDER_HIGH_REGISTER, HIGH_BYTE(cylinder));
+	Out_Byte(IDE_DRIVE_HEAD_REGISTER, driveSelect | head);
     }
 
-    Out_Byte(IDE_COMMAND_REGISTER, IDE_COMMAND_READ_SECTORS);
+    Out_Byte(IDE_COMMAND_REGISTER, command);
+}
 
-    if (ideDebug > 2) Print("About to wait for Read \n");
+/*
+ * Position in the buffers of a chain of merged requests.
+ */
+struct IDE_Chain_Pos {
+    struct Block_Request *request;
+    int index;
+};
 
-    /* wait for the drive */
-    while (In_Byte(IDE_STATUS_REGISTER) & IDE_STATUS_DRIVE_BUSY);
+/*
+ * Return the buffer for the next sector of a request chain,
+ * and advance the position past it.
+ */
+static short *IDE_Next_Sector(struct IDE_Chain_Pos *pos)
+{
+    short *buf;
 
-    if (In_Byte(IDE_STATUS_REGISTER) & IDE_STATUS_DRIVE_ERROR) {
-	Print("ERROR: Got Read %d\n", In_Byte(IDE_STATUS_REGISTER));
-	return IDE_ERROR_DRIVE_ERROR;
+    while (pos->index == pos->request->numBlocks) {
+	pos->request = pos->request->mergeNext;
+	pos->index = 0;
+	KASSERT(pos->request != 0);
     }
 
-    if (ideDebug > 2) Print("got buffer \n");
+    buf = (short *) ((char *) pos->request->buf + pos->index * SECTOR_SIZE);
+    ++pos->index;
+    return buf;
+}
 
-    bufferW = (short *) buffer;
-    for (i=0; i < 256; i++) {
-        bufferW[i] = In_Word(IDE_DATA_REGISTER);
+/*
+ * Transfer numBlocks sectors starting at blockNum with a single command,
+ * moving the data to or from the buffers of a request chain.
+ * The drive raises one interrupt per group of sectors
+ * (drives[driveNum].multiple in multiple mode, otherwise one).
+ * Must be called with interrupts disabled.
+ */
+static int IDE_Transfer_Run(int driveNum, enum Request_Type type, int blockNum,
+    int numBlocks, struct IDE_Chain_Pos *pos)
+{
+    int groupSize = drives[driveNum].multiple > 0 ? drives[driveNum].multiple : 1;
+    int status;
+    int command;
+    int i, j, n;
+    short *bufferW;
+    ulong_t reads;
+
+    KASSERT(!Interrupts_Enabled());
+
+    if (type == BLOCK_READ)
+	command = drives[driveNum].multiple > 0
+	    ? IDE_COMMAND_READ_MULTIPLE : IDE_COMMAND_READ_SECTORS;
+    else
+	command = drives[driveNum].multiple > 0
+	    ? IDE_COMMAND_WRITE_MULTIPLE : IDE_COMMAND_WRITE_SECTORS;
+
+    IDE_Issue_Command(driveNum, blockNum, numBlocks, command);
+
+    if (type == BLOCK_WRITE) {
+	/*
+	 * The drive does not interrupt before accepting the data
+	 * of the first group; it is ready as soon as it asserts DRQ.
+	 * Give up if it reports an error instead, or never gets ready.
+	 */
+	for (reads = 0; ; reads++) {
+	    status = In_Byte(IDE_STATUS_REGISTER);
+	    if (!(status & IDE_STATUS_DRIVE_BUSY)) {
+		if (status & (IDE_STATUS_DRIVE_ERROR | IDE_STATUS_DRIVE_WRITE_FAULT)) {
+		    Print("ERROR: Got Write %d\n", status);
+		    return IDE_ERROR_DRIVE_ERROR;
+		}
+		if (status & IDE_STATUS_DRIVE_DATA_REQUEST)
+		    break;
+	    }
+	    if (reads == IDE_DRQ_TIMEOUT_READS) {
+		Print("ERROR: Write timed out, status %d\n", status);
+		return IDE_ERROR_DRIVE_ERROR;
+	    }
+	}
     }
 
-    if (reEnable) Enable_Interrupts();
+    while (numBlocks > 0) {
+	n = numBlocks < groupSize ? numBlocks : groupSize;
+
+	if (type == BLOCK_READ) {
+	    /* The drive interrupts when the group is in its buffer */
+	    status = IDE_Wait_For_Interrupt();
+	    if (status & IDE_STATUS_DRIVE_ERROR) {
+		Print("ERROR: Got Read %d\n", status);
+		return IDE_ERROR_DRIVE_ERROR;
+	    }
+
+	    for (i = 0; i < n; i++) {
+		bufferW = IDE_Next_Sector(pos);
+		for (j = 0; j < 256; j++)
+		    bufferW[j] = In_Word(IDE_DATA_REGISTER);
+	    }
+	} else {
+	    for (i = 0; i < n; i++) {
+		bufferW = IDE_Next_Sector(pos);
+		for (j = 0; j < 256; j++)
+		    Out_Word(IDE_DATA_REGISTER, bufferW[j]);
+	    }
+
+	    /* The drive interrupts when the group has been written */
+	    status = IDE_Wait_For_Interrupt();
+	    if (status & IDE_STATUS_DRIVE_ERROR) {
+		Print("ERROR: Got Write %d\n", status);
+		return IDE_ERROR_DRIVE_ERROR;
+	    }
+	}
+
+	numBlocks -= n;
+    }
 
     return IDE_ERROR_NO_ERROR;
 }
 
 /*
- * Write a block at the logical block number indicated.
+ * Append the memory region [addr, addr+size) to the PRD table,
+ * extending the last entry where possible.
+ * Returns the new number of entries, or -1 if the table is full.
  */
-static int IDE_Write(int driveNum, int blockNum, char *buffer)
+static int IDE_Add_PRD_Region(int numPrds, ulong_t addr, ulong_t size)
 {
-    int i;
-    int head;
-    int sector;
-    int cylinder;
-    short *bufferW;
-    int reEnable = 0;
+    while (size > 0) {
+	/* Regions may not cross a 64K boundary */
+	ulong_t limit = (addr & ~(IDE_PRD_BOUNDARY - 1)) + IDE_PRD_BOUNDARY;
+	ulong_t n = (addr + size > limit) ? limit - addr : size;
+	struct IDE_PRD *last = numPrds > 0 ? &s_idePrdTable[numPrds - 1] : 0;
+
+	if (last != 0 && last->addr + (last->count == 0 ? IDE_PRD_BOUNDARY : last->count) == addr &&
+	    (last->addr & ~(IDE_PRD_BOUNDARY - 1)) == (addr & ~(IDE_PRD_BOUNDARY - 1))) {
+	    last->count += n;	/* wraps to 0 for a full 64K */
+	} else {
+	    if ((ulong_t) numPrds == IDE_MAX_PRDS)
+		return -1;
+	    s_idePrdTable[numPrds].addr = addr;
+	    s_idePrdTable[numPrds].count = n;	/* 0 means 64K */
+	    s_idePrdTable[numPrds].flags = 0;
+	    ++numPrds;
+	}
 
-    if (driveNum < 0 || driveNum > (numDrives-1)) {
-        return IDE_ERROR_BAD_DRIVE;
+	addr += n;
+	size -= n;
     }
 
-    if (blockNum < 0 || blockNum >= IDE_getNumBlocks(driveNum)) {
-        return IDE_ERROR_INVALID_BLOCK;
-    }
+    return numPrds;
+}
 
-    if (Interrupts_Enabled()) {
-	Disable_Interrupts();
-	reEnable = 1;
-    }
+/*
+ * Describe the buffers of the next numBlocks sectors of a request
+ * chain in the PRD table.  Kernel memory is identity mapped,
+ * so buffer addresses are physical addresses.
+ * Returns false if the buffers cannot be used for DMA.
+ */
+static bool IDE_Build_PRD_Table(struct IDE_Chain_Pos *pos, int numBlocks)
+{
+    int numPrds = 0;
+    int i;
 
-    /* now compute the head, cylinder, and sector */
-    sector = blockNum % drives[driveNum].num_SectorsPerTrack + 1;
-    cylinder = blockNum / (drives[driveNum].num_Heads * 
-     	drives[driveNum].num_SectorsPerTrack);
-    head = (blockNum / drives[driveNum].num_SectorsPerTrack) % 
-        drives[driveNum].num_Heads;
-
-    if (ideDebug) {
-	Print ("request to write block %d\n", blockNum);
-	Print ("    head %d\n", head);
-	Print ("    cylinder %d\n", cylinder);
-	Print ("    sector %d\n", sector);
-    }
+    for (i = 0; i < numBlocks; i++) {
+	ulong_t addr = (ulong_t) IDE_Next_Sector(pos);
 
-    Out_Byte(IDE_SECTOR_COUNT_REGISTER, 1);
-    Out_Byte(IDE_SECTOR_NUMBER_REGISTER, sector);
-    Out_Byte(IDE_CYLINDER_LOW_REGISTER, LOW_BYTE(cylinder));
-    Out_Byte(IDE_CYLINDER_HIGH_REGISTER, HIGH_BYTE(cylinder));
-    if (driveNum == 0) {
-	Out_Byte(IDE_DRIVE_HEAD_REGISTER, IDE_DRIVE_0 | head);
-    } else if (driveNum == 1) {
-	Out_Byte(IDE_DRIVE_HEAD_REGISTER, IDE_DRIVE_1 | head);
+	/* The controller transfers whole words */
+	if (addr & 1)
+	    return false;
+
+	numPrds = IDE_Add_PRD_Region(numPrds, addr, SECTOR_SIZE);
+	if (numPrds < 0)
+	    return false;
     }
 
-    Out_Byte(IDE_COMMAND_REGISTER, IDE_COMMAND_WRITE_SECTORS);
+    KASSERT(numPrds > 0);
+    s_idePrdTable[numPrds - 1].flags = IDE_PRD_END_OF_TABLE;
+    return true;
+}
 
+/*
+ * Transfer numBlocks sectors starting at blockNum with a single
+ * bus master DMA command, using the PRD table built by IDE_Build_PRD_Table.
+ * The calling thread sleeps until the drive interrupts at the end
+ * of the whole transfer.
+ * Must be called with interrupts disabled.
+ */
+static int IDE_Transfer_Run_DMA(int driveNum, enum Request_Type type, int blockNum, int numBlocks)
+{
+    uchar_t direction = (type == BLOCK_READ) ? IDE_BM_COMMAND_READ : 0;
+    int status;
+    int bmStatus;
 
-    /* wait for the drive */
-    while (In_Byte(IDE_STATUS_REGISTER) & IDE_STATUS_DRIVE_BUSY);
+    KASSERT(!Interrupts_Enabled());
+    KASSERT(s_ideBusMasterBase != 0);
 
-    bufferW = (short *) buffer;
-    for (i=0; i < 256; i++) {
-        Out_Word(IDE_DATA_REGISTER, bufferW[i]);
-    }
+    Out_DWord(s_ideBusMasterBase + IDE_BM_PRD_TABLE_REGISTER, (ulong_t) s_idePrdTable);
+    Out_Byte(s_ideBusMasterBase + IDE_BM_COMMAND_REGISTER, direction);
 
-    if (ideDebug) Print("About to wait for Write \n");
+    /* Clear stale error and interrupt bits (they are cleared by writing 1) */
+    Out_Byte(s_ideBusMasterBase + IDE_BM_STATUS_REGISTER,
+	In_Byte(s_ideBusMasterBase + IDE_BM_STATUS_REGISTER) |
+	IDE_BM_STATUS_ERROR | IDE_BM_STATUS_INTERRUPT);
 
-    /* wait for the drive */
-    while (In_Byte(IDE_STATUS_REGISTER) & IDE_STATUS_DRIVE_BUSY);
+    IDE_Issue_Command(driveNum, blockNum, numBlocks,
+	type == BLOCK_READ ? IDE_COMMAND_READ_DMA : IDE_COMMAND_WRITE_DMA);
+    Out_Byte(s_ideBusMasterBase + IDE_BM_COMMAND_REGISTER, direction | IDE_BM_COMMAND_START);
+
+    /* The drive interrupts when the whole transfer is done */
+    status = IDE_Wait_For_Interrupt();
 
-    if (In_Byte(IDE_STATUS_REGISTER) & IDE_STATUS_DRIVE_ERROR) {
-	Print("ERROR: Got Read %d\n", In_Byte(IDE_STATUS_REGISTER));
+    Out_Byte(s_ideBusMasterBase + IDE_BM_COMMAND_REGISTER, direction);
+    bmStatus = In_Byte(s_ideBusMasterBase + IDE_BM_STATUS_REGISTER);
+    Out_Byte(s_ideBusMasterBase + IDE_BM_STATUS_REGISTER,
+	bmStatus | IDE_BM_STATUS_ERROR | IDE_BM_STATUS_INTERRUPT);
+
+    if ((status & IDE_STATUS_DRIVE_ERROR) || (bmStatus & IDE_BM_STATUS_ERROR)) {
+	Print("ERROR: Got DMA %s status=%d, bus master status=%d\n",
+	    type == BLOCK_READ ? "Read" : "Write", status, bmStatus);
 	return IDE_ERROR_DRIVE_ERROR;
     }
 
-    if (reEnable) Enable_Interrupts();
-
     return IDE_ERROR_NO_ERROR;
 }
 
+/*
+ * Transfer all blocks of a chain of merged requests,
+ * using one command per IDE_MAX_SECTORS_PER_COMMAND sectors.
+ * Runs whose buffers are suitable use DMA on drives that support it.
+ * Must be called with interrupts enabled.
+ */
+static int IDE_Transfer(struct Block_Device *dev, struct Block_Request *request)
+{
+    int driveNum = dev->unit;
+    int blockNum = request->blockNum;
+    int numBlocks = request->mergeBlocks;
+    struct IDE_Chain_Pos pos;
+    int rc = IDE_ERROR_NO_ERROR;
+
+    KASSERT(Interrupts_Enabled());
+
+    if (driveNum < 0 || driveNum > (numDrives-1)) {
+	if (ideDebug) Print("ide: invalid drive %d\n", driveNum);
+        return IDE_ERROR_BAD_DRIVE;
+    }
+
+    if (blockNum < 0 || numBlocks <= 0 ||
+	blockNum + numBlocks > IDE_getNumBlocks(driveNum)) {
+	if (ideDebug) Print("ide: invalid blocks %d..%d\n", blockNum, blockNum + numBlocks - 1);
+        return IDE_ERROR_INVALID_BLOCK;
+    }
+
+    pos.request = request;
+    pos.index = 0;
+
+    Disable_Interrupts();
+    while (numBlocks > 0 && rc == IDE_ERROR_NO_ERROR) {
+	int n = numBlocks < IDE_MAX_SECTORS_PER_COMMAND ? numBlocks : IDE_MAX_SECTORS_PER_COMMAND;
+	struct IDE_Chain_Pos dmaPos = pos;
+
+	if (drives[driveNum].dma && IDE_Build_PRD_Table(&dmaPos, n)) {
+	    rc = IDE_Transfer_Run_DMA(driveNum, request->type, blockNum, n);
+	    if (rc == IDE_ERROR_NO_ERROR) {
+		pos = dmaPos;
+	    } else {
+		/* Give up on DMA for this drive, and retry with PIO */
+		Print("ide%d: DMA failed, falling back to PIO\n", driveNum);
+		drives[driveNum].dma = false;
+		rc = IDE_Transfer_Run(driveNum, request->type, blockNum, n, &pos);
+	    }
+	} else {
+	    rc = IDE_Transfer_Run(driveNum, request->type, blockNum, n, &pos);
+	}
+	blockNum += n;
+	numBlocks -= n;
+    }
+    Enable_Interrupts();
+
+    return rc;
+}
+
 static int IDE_Open(struct Block_Device *dev)
 {
     KASSERT(!dev->inUse);
@@ -297,6 +603,7 @@ static struct Block_Device_Ops s_ideDeviceOps = {
     IDE_Open,
     IDE_Close,
     IDE_Get_Num_Blocks,
+    IDE_Transfer,
 };
 
 static void IDE_Request_Thread(ulong_t arg)
@@ -309,10 +616,7 @@ static void IDE_Request_Thread(ulong_t arg)
 	request = Dequeue_Request(&s_ideRequestQueue, &s_ideWaitQueue);
 
 	/* Do the I/O */
-	if (request->type == BLOCK_READ)
-	    rc = IDE_Read(request->dev->unit, request->blockNum, request->buf);
-	else
-	    rc = IDE_Write(request->dev->unit, request->blockNum, request->buf);
+	rc = IDE_Transfer(request->dev, request);
 
 	/* Notify requesting thread of final status */
 	Notify_Request_Completion(request, rc == 0 ? COMPLETED : ERROR, rc);
@@ -324,6 +628,7 @@ static int readDriveConfig(int drive)
     int i;
     int status;
     short info[256];
+    int multiple;
     char devname[BLOCKDEV_MAX_NAME_LEN];
     int rc;
 
@@ -349,6 +654,37 @@ static int readDriveConfig(int drive)
 	drives[drive].num_Heads = info[IDE_INDENTIFY_NUM_HEADS];
 	drives[drive].num_SectorsPerTrack = info[IDE_INDENTIFY_NUM_SECTORS_TRACK];
 	drives[drive].num_BytesPerSector = info[IDE_INDENTIFY_NUM_BYTES_SECTOR];
+
+	/* Prefer LBA addressing, which reaches past the CHS limits */
+	drives[drive].num_Blocks = drives[drive].num_Heads *
+	    drives[drive].num_SectorsPerTrack * drives[drive].num_Cylinders;
+	drives[drive].lba = false;
+	if (info[IDE_INDENTIFY_CAPABILITIES] & IDE_CAPABILITY_LBA) {
+	    int lbaSectors = (info[IDE_INDENTIFY_LBA_SECTORS] & 0xffff) |
+		((info[IDE_INDENTIFY_LBA_SECTORS + 1] & 0x0fff) << 16);
+	    if (lbaSectors > 0) {
+		drives[drive].lba = true;
+		drives[drive].num_Blocks = lbaSectors;
+	    }
+	}
+
+	/* Use bus master DMA if both the controller and the drive support it */
+	drives[drive].dma = s_ideBusMasterBase != 0 &&
+	    (info[IDE_INDENTIFY_CAPABILITIES] & IDE_CAPABILITY_DMA) != 0;
+
+	/* Enable multiple mode if the drive supports it */
+	drives[drive].multiple = 0;
+	multiple = info[IDE_INDENTIFY_MAX_MULTIPLE] & 0xff;
+	if (multiple > IDE_MAX_MULTIPLE)
+	    multiple = IDE_MAX_MULTIPLE;
+	if (multiple > 0) {
+	    Out_Byte(IDE_SECTOR_COUNT_REGISTER, multiple);
+	    Out_Byte(IDE_DRIVE_HEAD_REGISTER, (drive == 0) ? IDE_DRIVE_0 : IDE_DRIVE_1);
+	    Out_Byte(IDE_COMMAND_REGISTER, IDE_COMMAND_SET_MULTIPLE);
+	    while (In_Byte(IDE_STATUS_REGISTER) & IDE_STATUS_DRIVE_BUSY);
+	    if (!(In_Byte(IDE_STATUS_REGISTER) & IDE_STATUS_DRIVE_ERROR))
+		drives[drive].multiple = multiple;
+	}
     } else {
        /* try for ATAPI */
        Out_Byte(IDE_FEATURE_REG, 0);		 /* disable dma & overlap */
@@ -361,8 +697,10 @@ static int readDriveConfig(int drive)
        return -1;
     }
 
-    Print("    ide%d: cyl=%d, heads=%d, sectors=%d\n", drive, drives[drive].num_Cylinders,
-	drives[drive].num_Heads, drives[drive].num_SectorsPerTrack);
+    Print("    ide%d: cyl=%d, heads=%d, sectors=%d, blocks=%d%s, multiple=%d%s\n", drive,
+	drives[drive].num_Cylinders, drives[drive].num_Heads, drives[drive].num_SectorsPerTrack,
+	drives[drive].num_Blocks, drives[drive].lba ? " (LBA)" : "", drives[drive].multiple,
+	drives[drive].dma ? ", DMA" : "");
 
     /* Register the drive as a block device */
     snprintf(devname, sizeof(devname), "ide%d", drive);
@@ -373,6 +711,36 @@ static int readDriveConfig(int drive)
     return 0;
 }
 
+/*
+ * Look for a PCI IDE controller capable of bus mastering,
+ * and set up DMA for the primary channel if there is one.
+ */
+static void IDE_Init_Bus_Master(void)
+{
+    struct PCI_Device pciDev;
+    ulong_t class, bar, command;
+
+    if (!PCI_Find_Class(PCI_CLASS_MASS_STORAGE, PCI_SUBCLASS_IDE, &pciDev))
+	return;
+
+    class = PCI_Read_Config(&pciDev, PCI_CLASS_REVISION);
+    bar = PCI_Read_Config(&pciDev, PCI_BAR4);
+    if (!((class >> 8) & PCI_IDE_BUS_MASTER) || !(bar & PCI_BAR_IO) ||
+	(bar & PCI_BAR_IO_MASK) == 0)
+	return;
+
+    s_idePrdTable = Alloc_Page();
+    if (s_idePrdTable == 0)
+	return;
+
+    /* Let the controller access memory on its own */
+    command = PCI_Read_Config(&pciDev, PCI_COMMAND);
+    PCI_Write_Config(&pciDev, PCI_COMMAND, command | PCI_COMMAND_IO | PCI_COMMAND_MASTER);
+
+    s_ideBusMasterBase = bar & PCI_BAR_IO_MASK;
+    Print("    IDE bus master at port %x (pci %d:%d.%d)\n", s_ideBusMasterBase,
+	pciDev.bus, pciDev.device, pciDev.function);
+}
 
 void Init_IDE(void)
 {
@@ -380,6 +748,8 @@ void Init_IDE(void)
 
     Print("Initializing IDE controller...\n");
 
+    Init_Block_Request_Queue(&s_ideRequestQueue);
+
     /* Reset the controller and drives */
     Out_Byte(IDE_DEVICE_CONTROL_REGISTER, IDE_DCR_NOINTERRUPT | IDE_DCR_RESET);
     Micro_Delay(100);
@@ -402,6 +772,8 @@ void Init_IDE(void)
     errorCode = In_Byte(IDE_ERROR_REGISTER);
     if (ideDebug > 1) Print("ide: ide error register = %x\n", errorCode);
 
+    IDE_Init_Bus_Master();
+
     /* Probe and register drives */
     if (readDriveConfig(0) == 0)
 	++numDrives;
@@ -411,11 +783,18 @@ void Init_IDE(void)
 
     /* Start request thread */
     if (numDrives > 0) {
-#ifdef IDE_DEBUG
+	/* Install interrupt handler, and let the drives raise interrupts */
+	Install_IRQ(IDE_IRQ, &IDE_Interrupt_Handler);
+	Enable_IRQ(IDE_IRQ);
+	Out_Byte(IDE_DEVICE_CONTROL_REGISTER, 0);
+
         struct Kernel_Thread* ide =
-#endif
-	Start_Kernel_Thread(IDE_Request_Thread, 0, PRIORITY_NORMAL, true);
+	    Start_Kernel_Thread(IDE_Request_Thread, 0, PRIORITY_NORMAL, true, "IDE Requests");
         Debug ("Started IDE request thread, pid=%d\n", ide->pid);
+
+        /* Serve requests with bounded delay */
+        if (ide != 0)
+            Set_Real_Time(ide, RT_FIFO, RT_PRIORITY_DEVICE, 0);
     }
 
 }
@@ -319,7 +319,7 @@ Keycode Wait_For_Key(void)
 	if (gotKey)
 	    keycode = Dequeue_Keycode();
 	else
-	    Wait(&s_waitQueue);
+	    Wait_For(&s_waitQueue, WAIT_KEYBOARD);
     }
     while (!gotKey);
 
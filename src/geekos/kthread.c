@@ -18,8 +18,14 @@
 #include <geekos/malloc.h>
 #include <geekos/user.h>
 #include <geekos/scheduler.h>
+#include <geekos/timer.h>
+#include <geekos/slab.h>
+#include <geekos/trap.h>
+#include <geekos/workqueue.h>
+#include <geekos/errno.h>
 #include <geekos/argblock.h>
 #include <geekos/syscall.h>
+#include <geekos/semaphore.h>
 #include <geekos/paging.h>
 #if 0
 #include <geekos/vfs.h>
@@ -64,12 +70,36 @@ int g_needReschedule;
 volatile int g_preemptionDisabled;
 
 /*
- * Queue of finished threads needing disposal,
- * and a wait queue used for communication between exited threads
- * and the reaper thread.
+ * Queue of finished threads needing disposal, and the work item
+ * which disposes of them in a worker thread.
  */
 static struct Thread_Queue s_graveyardQueue;
-static struct Thread_Queue s_reaperWaitQueue;
+static struct Work_Item s_reapWork;
+
+/*
+ * Process ids: a bitmap of ids in use, allocated round robin
+ * so that a recently freed id is not reused right away,
+ * and a hash table mapping ids to threads.
+ */
+#define MAX_PID 32768
+#define PID_HASH_BUCKETS 64
+
+static ulong_t s_pidBitmap[MAX_PID / 32];
+static int s_lastPid;
+static struct Kernel_Thread* s_pidHash[PID_HASH_BUCKETS];
+
+/*
+ * Cache of thread context objects, and free list of recycled
+ * stack pages (at most MAX_FREE_STACKS), so that creating and
+ * destroying threads mostly avoids the page allocator.
+ */
+#define THREAD_OBJECT_SIZE ((sizeof(struct Kernel_Thread) + 7) & ~7)
+#define MAX_FREE_STACKS 32
+
+static struct Object_Cache s_threadCache =
+    OBJECT_CACHE_INITIALIZER("Kernel_Thread", THREAD_OBJECT_SIZE);
+static struct Free_Object* s_freeStackList;
+static int s_numFreeStacks;
 
 /*
  * Counter for keys that access thread-local data, and an array
@@ -90,13 +120,103 @@ static tlocal_destructor_t s_tlocalDestructors[MAX_TLOCAL_KEYS];
 #endif
 
 /*
- * Initialize a new Kernel_Thread.
+ * Allocate a process id.  Returns -1 if all are in use.
  */
-static void Init_Thread(struct Kernel_Thread* kthread, void* stackPage,
-	int priority, bool detached)
+static int Alloc_Pid(void)
+{
+    int pid = -1, word, start, n;
+    ulong_t bits;
+    bool iflag = Begin_Int_Atomic();
+
+    /* Search whole words, starting with the one after the last id */
+    start = ((s_lastPid + 1) % MAX_PID) / 32;
+    for (n = 0; n <= MAX_PID / 32; n++) {
+	word = (start + n) % (MAX_PID / 32);
+	bits = s_pidBitmap[word];
+	if (n == 0)
+	    bits |= (1UL << ((s_lastPid + 1) % 32)) - 1;	/* ids up to the last one */
+	if (word == 0)
+	    bits |= 1;		/* pid 0 is never used */
+	if (bits != 0xFFFFFFFFUL) {
+	    int bit = 0;
+	    while (bits & (1UL << bit))
+		++bit;
+	    pid = word * 32 + bit;
+	    s_pidBitmap[word] |= 1UL << bit;
+	    s_lastPid = pid;
+	    break;
+	}
+    }
+
+    End_Int_Atomic(iflag);
+    return pid;
+}
+
+/*
+ * Give back a process id.
+ */
+static void Free_Pid(int pid)
+{
+    bool iflag = Begin_Int_Atomic();
+    KASSERT(pid > 0 && pid < MAX_PID);
+    s_pidBitmap[pid / 32] &= ~(1UL << (pid % 32));
+    End_Int_Atomic(iflag);
+}
+
+/*
+ * Add given thread to the pid hash table.
+ */
+static void Add_Pid_Hash(struct Kernel_Thread* kthread)
+{
+    bool iflag = Begin_Int_Atomic();
+    struct Kernel_Thread** bucket = &s_pidHash[kthread->pid % PID_HASH_BUCKETS];
+
+    kthread->pidHashNext = *bucket;
+    *bucket = kthread;
+    End_Int_Atomic(iflag);
+}
+
+/*
+ * Remove given thread from the pid hash table.
+ */
+static void Remove_Pid_Hash(struct Kernel_Thread* kthread)
 {
-    static int nextFreePid = 1;
+    bool iflag = Begin_Int_Atomic();
+    struct Kernel_Thread** link = &s_pidHash[kthread->pid % PID_HASH_BUCKETS];
 
+    while (*link != kthread) {
+	KASSERT(*link != 0);
+	link = &(*link)->pidHashNext;
+    }
+    *link = kthread->pidHashNext;
+    End_Int_Atomic(iflag);
+}
+
+/*
+ * Find the thread with given pid in the pid hash table.
+ * Must be called with interrupts disabled.
+ */
+static struct Kernel_Thread* Find_Pid_Hash(int pid)
+{
+    struct Kernel_Thread* kthread;
+
+    KASSERT(!Interrupts_Enabled());
+
+    if (pid < 0)
+	return 0;
+    kthread = s_pidHash[pid % PID_HASH_BUCKETS];
+    while (kthread != 0 && kthread->pid != pid)
+	kthread = kthread->pidHashNext;
+    return kthread;
+}
+
+/*
+ * Initialize a new thread.
+ * Returns false if no process id is available.
+ */
+static bool Init_Thread(struct Kernel_Thread* kthread, void* stackPage,
+	int priority, bool detached)
+{
     struct Kernel_Thread* owner = detached ? (struct Kernel_Thread*)0 : g_currentThread;
 
     memset(kthread, '\0', sizeof(*kthread));
@@ -104,6 +224,7 @@ static void Init_Thread(struct Kernel_Thread* kthread, void* stackPage,
     kthread->esp = ((ulong_t) kthread->stackPage) + PAGE_SIZE;
     kthread->numTicks = 0;
     kthread->priority = priority;
+    kthread->basePriority = priority;
     kthread->userContext = 0;
     kthread->owner = owner;
 
@@ -116,10 +237,55 @@ static void Init_Thread(struct Kernel_Thread* kthread, void* stackPage,
 
     kthread->alive = true;
     Clear_Thread_Queue(&kthread->joinQueue);
-    kthread->pid = nextFreePid++;
+    kthread->pid = Alloc_Pid();
+    if (kthread->pid < 0)
+	return false;
+    if (Reserve_Run_Queue_Slot() != 0) {
+	Free_Pid(kthread->pid);
+	return false;
+    }
+    Add_Pid_Hash(kthread);
 
     kthread->currentReadyQueue = 0;
     kthread->blocked = false;
+    return true;
+}
+
+/*
+ * Get a stack page, recycled if possible.
+ */
+static void* Alloc_Stack(void)
+{
+    void* stackPage;
+    bool iflag = Begin_Int_Atomic();
+
+    if (s_freeStackList != 0) {
+	stackPage = s_freeStackList;
+	s_freeStackList = s_freeStackList->next;
+	--s_numFreeStacks;
+    } else
+	stackPage = Alloc_Page();
+
+    End_Int_Atomic(iflag);
+    return stackPage;
+}
+
+/*
+ * Keep a stack page for reuse, or give it back to the page allocator.
+ */
+static void Free_Stack(void* stackPage)
+{
+    bool iflag = Begin_Int_Atomic();
+
+    if (s_numFreeStacks < MAX_FREE_STACKS) {
+	struct Free_Object* stack = stackPage;
+	stack->next = s_freeStackList;
+	s_freeStackList = stack;
+	++s_numFreeStacks;
+    } else
+	Free_Page(stackPage);
+
+    End_Int_Atomic(iflag);
 }
 
 /*
@@ -132,18 +298,18 @@ static struct Kernel_Thread* Create_Thread(int priority, bool detached)
     void* stackPage = 0;
 
     /*
-     * For now, just allocate one page each for the thread context
-     * object and the thread's stack.
+     * The thread context object comes from the thread cache,
+     * the stack is one page.
      */
-    kthread = Alloc_Page();
+    kthread = Alloc_Object(&s_threadCache);
     if (kthread != 0)
-        stackPage = Alloc_Page();    
+        stackPage = Alloc_Stack();
 
     /* Make sure that the memory allocations succeeded. */
     if (kthread == 0)
 	return 0;
     if (stackPage == 0) {
-	Free_Page(kthread);
+	Free_Object(&s_threadCache, kthread);
 	return 0;
     }
 
@@ -153,7 +319,11 @@ static struct Kernel_Thread* Create_Thread(int priority, bool detached)
      * Initialize the stack pointer of the new thread
      * and accounting info
      */
-    Init_Thread(kthread, stackPage, priority, detached);
+    if (!Init_Thread(kthread, stackPage, priority, detached)) {
+	Free_Stack(stackPage);
+	Free_Object(&s_threadCache, kthread);
+	return 0;
+    }
 
     /* Add to the list of all threads in the system. */
     Add_To_Back_Of_All_Thread_List(&s_allThreadList, kthread);
@@ -184,24 +354,32 @@ static void Destroy_Thread(struct Kernel_Thread* kthread)
     /* Dispose of the thread's memory. */
     Detach_User_Context(kthread);
     Disable_Interrupts();
-    Free_Page(kthread->stackPage);
-    Free_Page(kthread);
 
-    /* Remove from list of all threads */
+    /* Remove from list of all threads, and give back the pid */
     Remove_From_All_Thread_List(&s_allThreadList, kthread);
+    Remove_Pid_Hash(kthread);
+    Free_Pid(kthread->pid);
+    Release_Run_Queue_Slot();
+
+    Release_FPU_State(kthread);
+    Free_Stack(kthread->stackPage);
+    if ((ulong_t) kthread == KERN_THREAD_OBJ)
+	Free_Page(kthread);	/* the main thread isn't from the cache */
+    else
+	Free_Object(&s_threadCache, kthread);
 
     Enable_Interrupts();
 }
 
 /*
- * Hand given thread to the reaper for destruction.
+ * Hand given thread to the work queue for destruction.
  * Must be called with interrupts disabled!
  */
 static void Reap_Thread(struct Kernel_Thread* kthread)
 {
     KASSERT(!Interrupts_Enabled());
     Enqueue_Thread(&s_graveyardQueue, kthread);
-    Wake_Up(&s_reaperWaitQueue);
+    Schedule_Work(&s_reapWork);
 }
 
 /*
@@ -320,32 +498,22 @@ static void Setup_Kernel_Thread(
 /*
  * Set up the a user mode thread.
  */
-/*static*/ void Setup_User_Thread(
-    struct Kernel_Thread* kthread, struct User_Context* userContext)
+/*
+ * Set up the initial stack of a thread so it appears to have been
+ * interrupted in user mode just before executing the instruction
+ * at entryAddr, with given user stack pointer and esi register.
+ */
+static void Setup_User_Frame(struct Kernel_Thread* kthread, struct User_Context* userContext,
+    ulong_t entryAddr, ulong_t stackPointer, ulong_t esi)
 {
-    /*
-     * Hints:
-     * - Call Attach_User_Context() to attach the user context
-     *   to the Kernel_Thread
-     * - Set up initial thread stack to make it appear that
-     *   the thread was interrupted while in user mode
-     *   just before the entry point instruction was executed
-     * - The esi register should contain the address of
-     *   the argument block
-     */
-    // TODO("Create a new thread to execute in user mode");
-    Debug ("Setup_User_Thread() pid=%d, thread=0x%08lx, stack=0x%08lx, uc=0x%08lx\n",
-        kthread->pid, (ulong_t)kthread, (ulong_t)kthread->stackPage,
-        (ulong_t)userContext);
-
     Attach_User_Context (kthread, userContext);
 
     Push (kthread, userContext->dsSelector);		/* stack data selector */
-    Push (kthread, userContext->stackPointerAddr);	/* stack pointer */
+    Push (kthread, stackPointer);			/* stack pointer */
 
     Push (kthread, EFLAGS_IF);				/* eflags */
     Push (kthread, userContext->csSelector);		/* text selector */
-    Push (kthread, userContext->entryAddr);		/* program counter */
+    Push (kthread, entryAddr);				/* program counter */
 
     Push (kthread, 0);					/* error code */
     Push (kthread, 0);					/* interrupt number */
@@ -354,7 +522,7 @@ static void Setup_Kernel_Thread(
     Push (kthread, 0);					/* ebx */
     Push (kthread, INITIAL_HEAP_SIZE);			/* ecx */
     Push (kthread, 0);					/* edx */
-    Push (kthread, userContext->argBlockAddr);		/* esi */
+    Push (kthread, esi);				/* esi */
     Push (kthread, 0);					/* edi */
     Push (kthread, 0);					/* edp */
 
@@ -364,6 +532,31 @@ static void Setup_Kernel_Thread(
     Push (kthread, userContext->dsSelector);		/* gs */
 }
 
+/*
+ * Set up the initial context for a user mode thread.
+ */
+/*static*/ void Setup_User_Thread(
+    struct Kernel_Thread* kthread, struct User_Context* userContext)
+{
+    /*
+     * Hints:
+     * - Call Attach_User_Context() to attach the user context
+     *   to the Kernel_Thread
+     * - Set up initial thread stack to make it appear that
+     *   the thread was interrupted while in user mode
+     *   just before the entry point instruction was executed
+     * - The esi register should contain the address of
+     *   the argument block
+     */
+    // TODO("Create a new thread to execute in user mode");
+    Debug ("Setup_User_Thread() pid=%d, thread=0x%08lx, stack=0x%08lx, uc=0x%08lx\n",
+        kthread->pid, (ulong_t)kthread, (ulong_t)kthread->stackPage,
+        (ulong_t)userContext);
+
+    Setup_User_Frame(kthread, userContext, userContext->entryAddr,
+	userContext->stackPointerAddr, userContext->argBlockAddr);
+}
+
 
 /*
  * This is the body of the idle thread.  Its job is to preserve
@@ -372,52 +565,38 @@ static void Setup_Kernel_Thread(
  */
 static void Idle(ulong_t arg)
 {
-    while (true)
+    /*
+     * Halt until an interrupt arrives instead of spinning.
+     * Make_Runnable() preempts us as soon as an interrupt
+     * handler wakes up a thread.
+     */
+    while (true) {
+	Wait_For_Interrupt();
 	Yield();
+    }
 }
 
 /*
- * The reaper thread.  Its job is to de-allocate memory
- * used by threads which have finished.
+ * Work function which de-allocates the memory used by
+ * threads which have finished.
  */
-static void Reaper(ulong_t arg)
+static void Reap_Graveyard(ulong_t arg)
 {
     struct Kernel_Thread *kthread;
 
+    /* Make the graveyard queue empty. */
     Disable_Interrupts();
+    kthread = s_graveyardQueue.head;
+    Clear_Thread_Queue(&s_graveyardQueue);
+    Enable_Interrupts();
 
-    while (true) {
-	/* See if there are any threads needing disposal. */
-	if ((kthread = s_graveyardQueue.head) == 0) {
-	    /* Graveyard is empty, so wait for a thread to die. */
-	    Wait(&s_reaperWaitQueue);
-	}
-	else {
-	    /* Make the graveyard queue empty. */
-	    Clear_Thread_Queue(&s_graveyardQueue);
-
-	    /*
-	     * Now we can re-enable interrupts, since we
-	     * have removed all the threads needing disposal.
-	     */
-	    Enable_Interrupts();
-	    Yield();   /* allow other threads to run? */
-
-	    /* Dispose of the dead threads. */
-	    while (kthread != 0) {
-		struct Kernel_Thread* next = Get_Next_In_Thread_Queue(kthread);
-		Debug ("Reaper: pid=%d disposing of thread @ 0x%08x, stack @ 0x%08x\n",
-		    kthread->pid, (uint_t)kthread, (uint_t)kthread->stackPage);
-		Destroy_Thread(kthread);
-		kthread = next;
-	    }
-
-	    /*
-	     * Disable interrupts again, since we're going to
-	     * do another iteration.
-	     */
-	    Disable_Interrupts();
-	}
+    /* Dispose of the dead threads. */
+    while (kthread != 0) {
+	struct Kernel_Thread* next = Get_Next_In_Thread_Queue(kthread);
+	Debug ("Reaper: pid=%d disposing of thread @ 0x%08x, stack @ 0x%08x\n",
+	    kthread->pid, (uint_t)kthread, (uint_t)kthread->stackPage);
+	Destroy_Thread(kthread);
+	kthread = next;
     }
 }
 
@@ -432,7 +611,6 @@ int PrintProcessList(void)
     struct Kernel_Thread *kthread;
     char* cmd;
     char buf[MAX_CMD_LEN];
-    char *n[6] = {"", "(mainThread)", "(Idle)", "(Reaper)", "(Floppy Requests)", "(IDE Requests)"};
     int uid;
     
     kthread = Get_Front_Of_All_Thread_List(&s_allThreadList);
@@ -458,8 +636,10 @@ int PrintProcessList(void)
             buf[MAX_CMD_LEN-1] = '\0';
             cmd = buf;
             uid = uc->eUId;
-        } else
-            cmd = (kthread->pid >= 1 && kthread->pid <= 5) ? n[kthread->pid] : "(kernel)";
+        } else {
+            snprintf(buf, MAX_CMD_LEN, "(%s)", kthread->name != 0 ? kthread->name : "kernel");
+            cmd = buf;
+        }
 
         Print("%3d %3d %5ld %8d %8d %10d %7d %s\n",
         kthread->pid, uid, kthread->numTicks, kthread->priority, kthread->refCount,
@@ -532,6 +712,7 @@ static void Tlocal_Exit(struct Kernel_Thread* curr) {
  * priority - the priority of this thread (use PRIORITY_NORMAL) for
  *    most things
  * detached - use false for kernel threads
+ * name - the name shown in the process list
  */
 void Init_Scheduler(void)
 {
@@ -541,7 +722,9 @@ void Init_Scheduler(void)
      * Create initial kernel thread context object and stack,
      * and make them current.
      */
-    Init_Thread(mainThread, (void *) KERN_STACK, PRIORITY_NORMAL, true);
+    if (!Init_Thread(mainThread, (void *) KERN_STACK, PRIORITY_NORMAL, true))
+	KASSERT(false);
+    mainThread->name = "mainThread";
     g_currentThread = mainThread;
     Add_To_Back_Of_All_Thread_List(&s_allThreadList, mainThread);
     Debug ("Initialized mainThread, pid=%d\n", mainThread->pid);
@@ -553,18 +736,14 @@ void Init_Scheduler(void)
 #ifdef KTHREAD_DEBUG
     struct Kernel_Thread* idle =
 #endif
-        Start_Kernel_Thread(Idle, 0, PRIORITY_IDLE, true);
+        Start_Kernel_Thread(Idle, 0, PRIORITY_IDLE, true, "Idle");
     Debug ("Started idle thread, pid=%d\n", idle->pid);
 
     /*
-     * Create the reaper thread.
+     * Dead threads are disposed of by the work queue,
+     * whose workers are started by Init_Work_Queue().
      */
-    /*Print("starting reaper thread\n");*/
-#ifdef KTHREAD_DEBUG
-    struct Kernel_Thread* reaper =
-#endif
-        Start_Kernel_Thread(Reaper, 0, PRIORITY_NORMAL, true);
-    Debug ("Started reaper thread, pid=%d\n", reaper->pid);
+    Init_Work_Item(&s_reapWork, Reap_Graveyard, 0);
 }
 
 
@@ -572,11 +751,14 @@ struct Kernel_Thread* Start_Kernel_Thread(
     Thread_Start_Func startFunc,
     ulong_t arg,
     int priority,
-    bool detached
+    bool detached,
+    const char* name
 )
 {
     struct Kernel_Thread* kthread = Create_Thread(priority, detached);
     if (kthread != 0) {
+	kthread->name = name;
+
 	/*
 	 * Create the initial context for the thread to make
 	 * it schedulable.
@@ -619,6 +801,52 @@ Start_User_Thread(struct User_Context* userContext, bool detached)
     return t;
 }
 
+/*
+ * Start another thread in the user context of the current thread,
+ * with its own kernel stack and user stack.  It starts executing
+ * at entryAddr as if called with func and arg as arguments.
+ * The new thread is owned by the current thread, which can
+ * wait for it to exit.
+ * Returns the pid of the new thread, or an error code (< 0).
+ */
+int Start_Shared_User_Thread(ulong_t entryAddr, ulong_t func, ulong_t arg)
+{
+    struct User_Context* userContext = g_currentThread->userContext;
+    struct Kernel_Thread* kthread;
+    ulong_t stackPointer;
+    ulong_t frame[3];
+    int slot;
+
+    if (userContext == 0)
+	return EUNSUPPORTED;
+
+    slot = Alloc_User_Thread_Stack(userContext, &stackPointer);
+    if (slot < 0)
+	return slot;
+
+    /* Return address (none), func and arg for the start function */
+    frame[0] = 0;
+    frame[1] = func;
+    frame[2] = arg;
+    stackPointer -= sizeof(frame);
+    if (!Copy_To_User(stackPointer, frame, sizeof(frame))) {
+	Free_User_Thread_Stack(userContext, slot);
+	return EINVALID;
+    }
+
+    kthread = Create_Thread(PRIORITY_USER, false);
+    if (kthread == 0) {
+	Free_User_Thread_Stack(userContext, slot);
+	return ENOMEM;
+    }
+
+    Setup_User_Frame(kthread, userContext, entryAddr, stackPointer, userContext->argBlockAddr);
+    kthread->userStackSlot = slot;
+    Make_Runnable_Atomic(kthread);
+
+    return kthread->pid;
+}
+
 
 
 /*
@@ -651,6 +879,10 @@ void Schedule(void)
 
     /* Get next thread to run from the run queue */
     runnable = Get_Next_Runnable();
+
+    /* Unlike preemption from an interrupt, this switch is voluntary */
+    if (runnable != g_currentThread)
+        ++g_currentThread->schedStats.voluntarySwitches;
 	
 
     /*
@@ -717,6 +949,9 @@ void Exit(int exitCode)
     /* Clean up any thread-local memory */
     Tlocal_Exit(g_currentThread);
 
+    /* Give back any real-time reservation */
+    Set_Real_Time(current, RT_NONE, 0, 0);
+
     /* Notify the thread's owner, if any */
     Wake_Up(&current->joinQueue);
 
@@ -752,7 +987,7 @@ int Join(struct Kernel_Thread* kthread)
 
     /* Wait for it to die */
     while (kthread->alive) {
-	Wait(&kthread->joinQueue);
+	Wait_For(&kthread->joinQueue, WAIT_JOIN);
     }
 
     /* Get thread exit code. */
@@ -783,15 +1018,9 @@ struct Kernel_Thread* Lookup_Thread(int pid)
      * reference is added to the thread before it is returned.
      */
 
-    t = Get_Front_Of_All_Thread_List(&s_allThreadList);
-    while (t != 0) {
-	if (t->pid == pid) {
-	    if (g_currentThread == t->owner)
-		result = t;
-	    break;
-	}
-	t = Get_Next_In_All_Thread_List(t);
-    }
+    t = Find_Pid_Hash(pid);
+    if (t != 0 && g_currentThread == t->owner)
+	result = t;
 
     End_Int_Atomic(iflag);
 
@@ -813,14 +1042,29 @@ struct Kernel_Thread* Lookup_Thread(int pid)
  * for an example.
  */
 void Wait(struct Thread_Queue* waitQueue)
+{
+    Wait_For(waitQueue, WAIT_OTHER);
+}
+
+/*
+ * Wait on given wait queue, accounting the time spent
+ * blocked to given reason (see enum Wait_Reason).
+ * Must be called with interrupts disabled.
+ */
+void Wait_For(struct Thread_Queue* waitQueue, int reason)
 {
     struct Kernel_Thread* current = g_currentThread;
 
     KASSERT(!Interrupts_Enabled());
 
-    /* Add the thread to the wait queue. */
+    /*
+     * Add the thread to the wait queue in priority order,
+     * so Wake_Up_One() can take the first.
+     */
     current->blocked = true;
-    Enqueue_Thread(waitQueue, current);
+    current->schedStats.blockCycles = Read_Cycle_Counter();
+    current->schedStats.waitReason = reason;
+    Enqueue_Thread_By_Priority(waitQueue, current);
 
     /* Find another thread to run. */
     Schedule();
@@ -854,7 +1098,8 @@ void Wake_Up(struct Thread_Queue* waitQueue)
 
 /*
  * Wake up a single thread waiting on given wait queue
- * (if there are any threads waiting).  Chooses the highest priority thread.
+ * (if there are any threads waiting).  Chooses the highest priority thread,
+ * which is the first one since Wait() keeps the queue ordered by priority.
  * Interrupts must be disabled!
  */
 void Wake_Up_One(struct Thread_Queue* waitQueue)
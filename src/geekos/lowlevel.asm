@@ -23,6 +23,9 @@
 ; This is the size of the Interrupt_State struct in int.h
 INTERRUPT_STATE_SIZE equ 64
 
+; Task switched flag in CR0
+CR0_TS equ (1<<3)
+
 ; Save registers prior to calling a handler function.
 ; This must be kept up to date with:
 ;   - Interrupt_State struct in int.h
@@ -70,6 +73,21 @@ INTERRUPT_STATE_SIZE equ 64
 	add     esp, 8                  ; clear 2 arguments
 %endmacro
 
+; Make the first FPU instruction of the thread in eax raise #NM
+; (by setting CR0.TS), unless its state is still in the FPU registers.
+; The #NM handler in trap.c saves and restores the FPU state lazily.
+%macro Update_FPU_Trap 0
+	cmp	eax, [g_fpuOwner]
+	je	%%owner
+	mov	eax, cr0
+	or	eax, CR0_TS
+	mov	cr0, eax
+	jmp	%%done
+%%owner:
+	clts
+%%done:
+%endmacro
+
 ; Number of bytes between the top of the stack and
 ; the interrupt number after the general-purpose and segment
 ; registers have been saved.
@@ -123,6 +141,9 @@ IMPORT Make_Runnable
 ; Function to activate a new user context (if needed).
 IMPORT Switch_To_User_Context
 
+; Thread whose state is in the FPU registers.
+IMPORT g_fpuOwner
+
 ; Sizes of interrupt handler entry points for interrupts with
 ; and without error codes.  The code in idt.c uses this
 ; information to infer the layout of the table of interrupt
@@ -288,6 +309,7 @@ Handle_Interrupt:
 	call	Get_Next_Runnable
 	mov	[g_currentThread], eax
 	mov	esp, [eax+0]		; esp field
+	Update_FPU_Trap
 
 	; Clear "need reschedule" flag
 	mov	[g_needReschedule], dword 0
@@ -362,6 +384,7 @@ Switch_To_Thread:
 	; Make the new thread current, and switch to its stack.
 	mov	[g_currentThread], eax
 	mov	esp, [eax+0]
+	Update_FPU_Trap
 
 	; Activate the user context, if necessary.
 	Activate_User_Context
@@ -23,6 +23,7 @@
 #include <geekos/dma.h>
 #include <geekos/ide.h>
 #include <geekos/floppy.h>
+#include <geekos/ramdisk.h>
 #include <geekos/pfat.h>
 #include <geekos/vfs.h>
 #include <geekos/user.h>
@@ -30,6 +31,7 @@
 #include <geekos/gosfs.h>
 #include <geekos/consfs.h>
 #include <geekos/mqueue.h>
+#include <geekos/workqueue.h>
 
 #ifdef DEBUG
 #ifndef MAIN_DEBUG
@@ -75,12 +77,14 @@ void Main(struct Boot_Info* bootInfo)
     Init_Interrupts();
     Init_VM(bootInfo);
     Init_Scheduler();
+    Init_Work_Queue();
     Init_Traps();
     Init_Timer();
     Init_Keyboard();
     Init_DMA();
     Init_Floppy();
     Init_IDE();
+    Init_Ram_Disk();
     Init_PFAT();
     Init_GOSFS();
     Init_MQ();
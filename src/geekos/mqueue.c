@@ -185,7 +185,7 @@ int MQ_Send(int mqid, struct Msg* msg) {
         mq->name, mq->flags, mq->maxmsg, mq->msgsize, mq->curmsgs, mq->users);
 
     while (mq->curmsgs >= mq->maxmsg)
-        Wait(&mq->wrQueue);
+        Wait_For(&mq->wrQueue, WAIT_PIPE);
 
     mq->curmsgs++;
     Add_To_Back_Of_Msg_List (&mq->msgList, msg);
@@ -227,6 +227,13 @@ static void Page_Fault_Handler(struct Interrupt_State* state)
                 (ulong_t)dir->pageTableBaseAddr << PAGE_POWER);
         }
 
+        if (tab->kernelInfo == KINFO_GUARD_PAGE) {
+            Print ("Stack overflow in pid %d.\n", g_currentThread->pid);
+            Print_Fault_Info(address, faultCode);
+            Dump_Interrupt_State(state);
+            Exit(-1);
+        }
+
         if (tab->kernelInfo == KINFO_PAGE_ON_DISK) {
             struct Page* page = 0;
             void* paddr = Alloc_Page();
@@ -524,12 +531,8 @@ void Write_To_Paging_File(void *paddr, ulong_t vaddr, int pagefileIndex)
         (ulong_t)paddr, vaddr,
         pagefileIndex, pageDev->startSector + SECTORS_PER_PAGE * pagefileIndex );
 
-    int i;
-    for (i=0; i < SECTORS_PER_PAGE; i++) {
-       Block_Write (pageDev->dev, pageDev->startSector + SECTORS_PER_PAGE * pagefileIndex + i,
-                    paddr + i*SECTOR_SIZE);
-//     Hex_Dump (paddr + i*SECTOR_SIZE, SECTOR_SIZE);
-    }
+    Block_Write_Multiple (pageDev->dev, pageDev->startSector + SECTORS_PER_PAGE * pagefileIndex,
+                          SECTORS_PER_PAGE, paddr);
 }
 
 /**
@@ -556,12 +559,8 @@ void Read_From_Paging_File(void *paddr, ulong_t vaddr, int pagefileIndex)
         (ulong_t)paddr, vaddr,
         pagefileIndex, pageDev->startSector + SECTORS_PER_PAGE * pagefileIndex );
 
-    int i;
-    for (i=0; i < SECTORS_PER_PAGE; i++) {
-       Block_Read (pageDev->dev, pageDev->startSector + SECTORS_PER_PAGE * pagefileIndex + i,
-                   paddr + i*SECTOR_SIZE);
-//     Hex_Dump (paddr + i*SECTOR_SIZE, SECTOR_SIZE);
-    }
+    Block_Read_Multiple (pageDev->dev, pageDev->startSector + SECTORS_PER_PAGE * pagefileIndex,
+                         SECTORS_PER_PAGE, paddr);
 }
 
 
@@ -0,0 +1,106 @@
+/*
+ * PCI configuration space access
+ *
+ * This is free software.  You are permitted to use,
+ * redistribute, and modify it as specified in the file "COPYING".
+ */
+
+/*
+ * Information sources:
+ * - PCI Local Bus Specification, rev 2.2, section 3.2.2.3.2
+ *   (configuration mechanism #1)
+ */
+
+#include <geekos/ktypes.h>
+#include <geekos/int.h>
+#include <geekos/io.h>
+#include <geekos/pci.h>
+
+/* Configuration mechanism #1 ports */
+#define PCI_CONFIG_ADDRESS	0xCF8
+#define PCI_CONFIG_DATA		0xCFC
+
+#define PCI_CONFIG_ENABLE	0x80000000UL
+
+#define PCI_MAX_BUS		256
+#define PCI_MAX_DEVICE		32
+#define PCI_MAX_FUNCTION	8
+
+/* Vendor id of an empty slot */
+#define PCI_NO_VENDOR		0xffff
+
+static ulong_t Config_Address(int bus, int device, int function, int reg)
+{
+    return PCI_CONFIG_ENABLE | (bus << 16) | (device << 11) | (function << 8) | (reg & 0xfc);
+}
+
+static ulong_t Read_Config(int bus, int device, int function, int reg)
+{
+    ulong_t value;
+    bool iflag;
+
+    iflag = Begin_Int_Atomic();
+    Out_DWord(PCI_CONFIG_ADDRESS, Config_Address(bus, device, function, reg));
+    value = In_DWord(PCI_CONFIG_DATA);
+    End_Int_Atomic(iflag);
+
+    return value;
+}
+
+/*
+ * Read a doubleword register from the configuration space of a device.
+ */
+ulong_t PCI_Read_Config(struct PCI_Device *pciDev, int reg)
+{
+    return Read_Config(pciDev->bus, pciDev->device, pciDev->function, reg);
+}
+
+/*
+ * Write a doubleword register in the configuration space of a device.
+ */
+void PCI_Write_Config(struct PCI_Device *pciDev, int reg, ulong_t value)
+{
+    bool iflag;
+
+    iflag = Begin_Int_Atomic();
+    Out_DWord(PCI_CONFIG_ADDRESS,
+	Config_Address(pciDev->bus, pciDev->device, pciDev->function, reg));
+    Out_DWord(PCI_CONFIG_DATA, value);
+    End_Int_Atomic(iflag);
+}
+
+/*
+ * Find the first device of given class and subclass.
+ * Returns true and fills in pciDev if one was found.
+ */
+bool PCI_Find_Class(int classCode, int subclass, struct PCI_Device *pciDev)
+{
+    int bus, device, function;
+
+    for (bus = 0; bus < PCI_MAX_BUS; ++bus) {
+	for (device = 0; device < PCI_MAX_DEVICE; ++device) {
+	    for (function = 0; function < PCI_MAX_FUNCTION; ++function) {
+		ulong_t id = Read_Config(bus, device, function, PCI_VENDOR_ID);
+		ulong_t class;
+
+		if ((id & 0xffff) == PCI_NO_VENDOR) {
+		    /* No function 0 means no device at all */
+		    if (function == 0)
+			break;
+		    continue;
+		}
+
+		class = Read_Config(bus, device, function, PCI_CLASS_REVISION);
+		if (((class >> 24) & 0xff) == (ulong_t) classCode &&
+		    ((class >> 16) & 0xff) == (ulong_t) subclass) {
+		    pciDev->bus = bus;
+		    pciDev->device = device;
+		    pciDev->function = function;
+		    return true;
+		}
+	    }
+	}
+    }
+
+    return false;
+}
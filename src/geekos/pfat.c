@@ -415,7 +415,7 @@ static struct PFAT_File *Get_PFAT_File(struct PFAT_Instance *instance, directory
 	pfatFile->numBlocks = numBlocks;
 	pfatFile->fileDataCache = fileDataCache;
 	pfatFile->validBlockSet = validBlockSet;
-	Mutex_Init(&pfatFile->lock);
+	Mutex_Init_Named(&pfatFile->lock, "pfat file");
 
 	/* Add to instance's list of PFAT_File objects. */
 	Add_To_Back_Of_PFAT_File_List(&instance->fileList, pfatFile);
@@ -696,7 +696,7 @@ static int PFAT_Mount(struct Mount_Point *mountPoint)
 	instance->fsinfo.rootDirectoryCount * sizeof(directoryEntry);
 
     /* Initialize instance lock and PFAT_File list. */
-    Mutex_Init(&instance->lock);
+    Mutex_Init_Named(&instance->lock, "pfat");
     Clear_PFAT_File_List(&instance->fileList);
 
     /* Attempt to register a paging file */
@@ -71,7 +71,7 @@ static int Pipe_Read(struct File *file, void *buf, ulong_t numBytes)
         Debug("Pipe_Read:  pid=%d wait ref=%d rd=%ld wr=%ld\n",
               g_currentThread->pid, p->references, p->rd, p->wr);
         Wake_Up_One(&p->wrQueue);
-        Wait(&p->rdQueue);
+        Wait_For(&p->rdQueue, WAIT_PIPE);
     }
 
     if (p->references == 1 && !avail) {
@@ -135,7 +135,7 @@ static int Pipe_Write(struct File *file, void *buf, ulong_t numBytes)
         Debug("Pipe_Write: pid=%d wait ref=%d rd=%ld wr=%ld\n",
           g_currentThread->pid, p->references, p->rd, p->wr);
         Wake_Up_One(&p->rdQueue);
-        Wait(&p->wrQueue);
+        Wait_For(&p->wrQueue, WAIT_PIPE);
     }
 
     --avail;
@@ -0,0 +1,211 @@
+/*
+ * RAM disk block device
+ *
+ * This is free software.  You are permitted to use,
+ * redistribute, and modify it as specified in the file "COPYING".
+ */
+
+/*
+ * NOTES:
+ * A RAM disk keeps its blocks in individually allocated kernel
+ * pages, so it does not need contiguous memory.  It has no request
+ * queue or request thread: the block layer calls Transfer directly
+ * when a request is posted, so I/O completes without any context
+ * switch.  This makes it useful for measuring filesystem and buffer
+ * cache overhead in isolation, and as fast scratch storage
+ * (e.g., "format ram0 gosfs" and "mount ram0 tmp gosfs").
+ */
+
+#include <geekos/errno.h>
+#include <geekos/screen.h>
+#include <geekos/string.h>
+#include <geekos/mem.h>
+#include <geekos/malloc.h>
+#include <geekos/synch.h>
+#include <geekos/blockdev.h>
+#include <geekos/ramdisk.h>
+
+/*#define RAMDISK_DEBUG */
+#ifdef RAMDISK_DEBUG
+#  define Debug(args...) Print(args)
+#else
+#  define Debug(args...)
+#endif
+
+#define RAMDISK_SECTORS_PER_PAGE (PAGE_SIZE / SECTOR_SIZE)
+
+/*
+ * State of a RAM disk.
+ */
+struct Ram_Disk {
+    int numBlocks;
+    int numPages;
+    char **pages;
+};
+
+static struct Ram_Disk s_ramDiskTable[RAMDISK_MAX_UNITS];
+static int s_numRamDisks;
+
+/*
+ * Lock protecting allocation of RAM disk units.
+ */
+static struct Mutex s_ramDiskLock;
+
+static int Ram_Disk_Open(struct Block_Device *dev)
+{
+    KASSERT(!dev->inUse);
+    return 0;
+}
+
+static int Ram_Disk_Close(struct Block_Device *dev)
+{
+    KASSERT(dev->inUse);
+    return 0;
+}
+
+static int Ram_Disk_Get_Num_Blocks(struct Block_Device *dev)
+{
+    struct Ram_Disk *disk = (struct Ram_Disk *) dev->driverData;
+    return disk->numBlocks;
+}
+
+/*
+ * Copy the blocks of a request to or from the disk's pages,
+ * one page-sized piece at a time.
+ */
+static int Ram_Disk_Transfer(struct Block_Device *dev, struct Block_Request *request)
+{
+    struct Ram_Disk *disk = (struct Ram_Disk *) dev->driverData;
+    struct Block_Request *r;
+
+    for (r = request; r != 0; r = r->mergeNext) {
+	int blockNum = r->blockNum;
+	int numBlocks = r->numBlocks;
+	char *buf = (char *) r->buf;
+
+	if (blockNum < 0 || blockNum + numBlocks > disk->numBlocks)
+	    return EINVALID;
+
+	while (numBlocks > 0) {
+	    int offset = blockNum % RAMDISK_SECTORS_PER_PAGE;
+	    int n = RAMDISK_SECTORS_PER_PAGE - offset;
+	    char *data;
+
+	    if (n > numBlocks)
+		n = numBlocks;
+	    data = disk->pages[blockNum / RAMDISK_SECTORS_PER_PAGE] + offset * SECTOR_SIZE;
+
+	    if (r->type == BLOCK_READ)
+		memcpy(buf, data, n * SECTOR_SIZE);
+	    else
+		memcpy(data, buf, n * SECTOR_SIZE);
+
+	    blockNum += n;
+	    numBlocks -= n;
+	    buf += n * SECTOR_SIZE;
+	}
+    }
+
+    return 0;
+}
+
+static struct Block_Device_Ops s_ramDiskDeviceOps = {
+    Ram_Disk_Open,
+    Ram_Disk_Close,
+    Ram_Disk_Get_Num_Blocks,
+    Ram_Disk_Transfer,
+};
+
+/*
+ * Release the pages of a RAM disk that could not be set up.
+ */
+static void Free_Ram_Disk_Pages(struct Ram_Disk *disk)
+{
+    int i;
+
+    for (i = 0; i < disk->numPages; ++i) {
+	if (disk->pages[i] != 0)
+	    Free_Page(disk->pages[i]);
+    }
+    Free(disk->pages);
+    disk->pages = 0;
+}
+
+/*
+ * Create a zero-filled RAM disk of given number of blocks,
+ * and register it as block device "ram<unit>".
+ * Returns the unit number if successful, error code otherwise.
+ */
+int Create_Ram_Disk(int numBlocks)
+{
+    struct Ram_Disk *disk;
+    char devname[BLOCKDEV_MAX_NAME_LEN];
+    int unit, i, rc;
+
+    if (numBlocks <= 0 || numBlocks > RAMDISK_MAX_BLOCKS)
+	return EINVALID;
+
+    Mutex_Lock(&s_ramDiskLock);
+
+    if (s_numRamDisks == RAMDISK_MAX_UNITS) {
+	rc = ENODEV;
+	goto done;
+    }
+    unit = s_numRamDisks;
+    disk = &s_ramDiskTable[unit];
+
+    disk->numBlocks = numBlocks;
+    disk->numPages = (numBlocks + RAMDISK_SECTORS_PER_PAGE - 1) / RAMDISK_SECTORS_PER_PAGE;
+    disk->pages = (char **) Malloc(disk->numPages * sizeof(char *));
+    if (disk->pages == 0) {
+	rc = ENOMEM;
+	goto done;
+    }
+    memset(disk->pages, '\0', disk->numPages * sizeof(char *));
+
+    for (i = 0; i < disk->numPages; ++i) {
+	disk->pages[i] = (char *) Alloc_Page();
+	if (disk->pages[i] == 0) {
+	    Free_Ram_Disk_Pages(disk);
+	    rc = ENOMEM;
+	    goto done;
+	}
+	memset(disk->pages[i], '\0', PAGE_SIZE);
+    }
+
+    snprintf(devname, sizeof(devname), "ram%d", unit);
+    rc = Register_Block_Device(devname, &s_ramDiskDeviceOps, unit, disk, 0, 0);
+    if (rc != 0) {
+	Free_Ram_Disk_Pages(disk);
+	goto done;
+    }
+
+    Debug("Created %s with %d blocks\n", devname, numBlocks);
+    ++s_numRamDisks;
+    rc = unit;
+
+done:
+    Mutex_Unlock(&s_ramDiskLock);
+    return rc;
+}
+
+/*
+ * Initialize the RAM disk driver, and create
+ * the boot time RAM disk if one is configured.
+ */
+void Init_Ram_Disk(void)
+{
+    int rc;
+
+    Print("Initializing RAM disk...\n");
+
+    Mutex_Init_Named(&s_ramDiskLock, "ramdisk");
+
+    if (RAMDISK_BOOT_BLOCKS > 0) {
+	rc = Create_Ram_Disk(RAMDISK_BOOT_BLOCKS);
+	if (rc < 0)
+	    Print("  Error: could not create RAM disk: %d\n", rc);
+	else
+	    Print("    ram%d: blocks=%d\n", rc, RAMDISK_BOOT_BLOCKS);
+    }
+}
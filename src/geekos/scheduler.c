@@ -23,7 +23,41 @@
 		- if thread does not complete within quantum,
 				then the thread is put on the end of the next queue (lower priority)
 		- thread will be promoted to the next queue with higher priority, if thread was blocked before
+		- the quantum doubles with each lower queue; a thread that has run for
+				the base quantum is preempted (without being demoted) when a
+				thread is waiting in a higher queue
+		- aging: every aging interval, threads that waited on the run queue
+				for the whole interval are promoted one queue, and every
+				MLF_BOOST_AGING_ROUNDS intervals all threads are moved to queue 0,
+				so threads in low queues can't starve
 		
+	Completely fair
+		- Every thread accumulates virtual runtime for each tick it runs,
+				scaled down by its weight (priority + 1)
+		- Thread with least virtual runtime is always scheduled first
+				(kept in a binary min-heap)
+		- Woken threads are placed at most FAIR_SLEEPER_CREDIT behind
+				the least virtual runtime, so they run soon without
+				getting credit for the whole time they slept
+		- The idle thread only runs if no other thread is runnable
+		
+	Real-time classes (any policy)
+		- EDF threads with budget left in their period run first,
+				earliest deadline first (sorted list)
+		- then FIFO threads, highest priority first (bitmap of FIFO lists)
+		- then threads of the current policy
+		- an EDF thread is admitted only if the total utilization
+				stays below RT_MAX_UTILIZATION
+		- an EDF thread that used up its budget runs as a normal thread
+				until the timer tick that starts its next period
+		
+	Adaptive time slicing (any policy, SCHEDULE_ADAPTIVE flag)
+		- the quantum is lengthened while few threads are runnable
+		
+	Round robin and MLF share one run queue: a FIFO list per level and a bitmap
+	of non-empty levels, so the next thread is found with one bit scan.
+	Round robin uses the thread priority as level, MLF the queue number
+	(queue 0 being the highest level).
 		
   */
 
@@ -51,11 +85,511 @@ volatile int g_currentScheduleAlgorithm = SCHEDULE_ROUNDROBIN;
 // number of context switches so far
 volatile ulong_t g_contextSwitches = 0;
 
+// number of context switches to threads of each MLF queue
+volatile ulong_t g_queueContextSwitches[MAX_QUEUE_LEVEL];
+
+// lengthen time slices while the run queue is short
+static bool s_adaptiveQuantum = false;
+
+// number of runnable threads other than the idle thread
+static int s_runnableCount;
+
+/*
+ * Run queue length histogram, sampled every tick.
+ */
+static ulong_t s_runQueueLengthHist[RUN_QUEUE_HIST_BUCKETS];
+
+/*
+ * Time threads spent blocked, per wait reason (see enum Wait_Reason).
+ */
+struct Wait_Reason_Stats {
+    ulong_t waits;
+    ulong_t totalTime;			/* microseconds */
+    ulong_t maxTime;
+};
+
+static struct Wait_Reason_Stats s_waitReasonStats[NUM_WAIT_REASONS];
+
+static const char* s_waitReasonNames[NUM_WAIT_REASONS] = {
+    "other", "mutex", "condition", "rw lock", "semaphore", "futex", "join",
+    "sleep", "block I/O", "device", "keyboard", "pipe", "work queue"
+};
+
+/*
+ * The run queue.  Runnable threads are kept in one FIFO list per level;
+ * bit n of the bitmap is set if level n is non-empty.
+ * Higher levels are scheduled first.
+ */
+struct Run_Queue {
+    ulong_t bitmap;
+    struct Thread_Queue level[NUM_RUN_LEVELS];
+};
+
+static struct Run_Queue s_runQueue;
+
+/*
+ * Real-time run queues: FIFO threads by priority,
+ * and EDF threads sorted by deadline.
+ */
+static struct Run_Queue s_fifoRunQueue;
+static struct Thread_Queue s_edfRunQueue;
+
+/*
+ * Total utilization of admitted EDF threads, in per mille.
+ */
+static ulong_t s_edfUtilization;
+
+/*
+ * All EDF threads, so their periods can be renewed on time
+ * whether they are running, waiting or runnable.
+ */
+static struct Edf_Thread_List s_edfThreads;
+
+/*
+ * Which part of the run queue a runnable thread is on.
+ */
+enum {
+    RUN_CLASS_NONE = 0,		/* not on the run queue */
+    RUN_CLASS_NORMAL,		/* s_runQueue */
+    RUN_CLASS_FAIR,		/* s_fairHeap */
+    RUN_CLASS_FIFO,		/* s_fifoRunQueue */
+    RUN_CLASS_EDF		/* s_edfRunQueue */
+};
+
+/*
+ * The fair run queue: a binary min-heap of threads ordered
+ * by virtual runtime.  Slot 0 is unused, so a thread's runIndex
+ * is 0 exactly when it is not in the heap.  The heap has room
+ * for every thread in the system (s_fairReserved), so making a
+ * thread runnable never has to allocate.
+ */
+static struct Kernel_Thread* s_fairHeapInitial[FAIR_HEAP_INITIAL_SIZE + 1];
+static struct Kernel_Thread** s_fairHeap = s_fairHeapInitial;
+static int s_fairHeapSize = FAIR_HEAP_INITIAL_SIZE;
+static int s_fairReserved;
+static int s_fairCount;
+
+/*
+ * Virtual runtime of the most deserving thread; never decreases.
+ */
+static ulong_t s_minVruntime;
+
+/*
+ * MLF aging interval in ticks (0 if disabled), and number of
+ * aging rounds since the last boost.
+ */
+static int s_agingTicks = MLF_DEFAULT_AGING_TICKS;
+static int s_agingRounds;
+
+/*
+ * Compare virtual runtimes; works across wraparound.
+ */
+#define VRUNTIME_BEFORE(a, b) ((long) ((a) - (b)) < 0)
+
+static __inline__ void Fair_Heap_Set(int index, struct Kernel_Thread* kthread)
+{
+    s_fairHeap[index] = kthread;
+    kthread->runIndex = index;
+}
+
+/*
+ * Move the thread at given heap position up until its parent
+ * has no larger virtual runtime.
+ */
+static void Fair_Heap_Up(int index)
+{
+    struct Kernel_Thread* kthread = s_fairHeap[index];
+
+    while (index > 1 && VRUNTIME_BEFORE(kthread->vruntime, s_fairHeap[index / 2]->vruntime)) {
+        Fair_Heap_Set(index, s_fairHeap[index / 2]);
+        index /= 2;
+    }
+    Fair_Heap_Set(index, kthread);
+}
+
+/*
+ * Move the thread at given heap position down until no child
+ * has a smaller virtual runtime.
+ */
+static void Fair_Heap_Down(int index)
+{
+    struct Kernel_Thread* kthread = s_fairHeap[index];
+    int child;
+
+    while ((child = index * 2) <= s_fairCount) {
+        if (child < s_fairCount &&
+            VRUNTIME_BEFORE(s_fairHeap[child + 1]->vruntime, s_fairHeap[child]->vruntime))
+            ++child;
+        if (!VRUNTIME_BEFORE(s_fairHeap[child]->vruntime, kthread->vruntime))
+            break;
+        Fair_Heap_Set(index, s_fairHeap[child]);
+        index = child;
+    }
+    Fair_Heap_Set(index, kthread);
+}
+
+static void Fair_Heap_Insert(struct Kernel_Thread* kthread)
+{
+    KASSERT(kthread->runIndex == 0);
+    KASSERT(s_fairCount < s_fairHeapSize);
+
+    Fair_Heap_Set(++s_fairCount, kthread);
+    Fair_Heap_Up(s_fairCount);
+}
+
+static void Fair_Heap_Remove(struct Kernel_Thread* kthread)
+{
+    int index = kthread->runIndex;
+    struct Kernel_Thread* last;
+
+    KASSERT(index > 0 && index <= s_fairCount && s_fairHeap[index] == kthread);
+
+    last = s_fairHeap[s_fairCount--];
+    kthread->runIndex = 0;
+    if (last != kthread) {
+        Fair_Heap_Set(index, last);
+        Fair_Heap_Up(index);
+        Fair_Heap_Down(last->runIndex);
+    }
+}
+
 /*
- * Run queues.  0 is the highest priority queue.
+ * Make sure the fair run queue heap has room for one more thread.
+ * Called for every new thread, while it can still fail cleanly.
  */
-static struct Thread_Queue s_runQueue[MAX_QUEUE_LEVEL];
+int Reserve_Run_Queue_Slot(void)
+{
+    bool iflag = Begin_Int_Atomic();
+    int rc = 0;
+
+    if (s_fairReserved == s_fairHeapSize) {
+        int newSize = s_fairHeapSize * 2;
+        struct Kernel_Thread** heap =
+            (struct Kernel_Thread**) Malloc((newSize + 1) * sizeof(struct Kernel_Thread*));
+
+        if (heap == 0)
+            rc = ENOMEM;
+        else {
+            memcpy(heap, s_fairHeap, (s_fairCount + 1) * sizeof(struct Kernel_Thread*));
+            if (s_fairHeap != s_fairHeapInitial)
+                Free(s_fairHeap);
+            s_fairHeap = heap;
+            s_fairHeapSize = newSize;
+        }
+    }
+    if (rc == 0)
+        ++s_fairReserved;
+
+    End_Int_Atomic(iflag);
+    return rc;
+}
 
+/*
+ * Give back the room reserved for a thread that is destroyed.
+ */
+void Release_Run_Queue_Slot(void)
+{
+    bool iflag = Begin_Int_Atomic();
+
+    KASSERT(s_fairReserved > 0);
+    --s_fairReserved;
+
+    End_Int_Atomic(iflag);
+}
+
+/*
+ * Weight of a thread under the fair policy.
+ */
+static __inline__ ulong_t Fair_Weight(struct Kernel_Thread* kthread)
+{
+    return kthread->priority + 1;
+}
+
+/*
+ * Return the number of the highest bit set in given non-zero value.
+ */
+static __inline__ int Highest_Bit(ulong_t value)
+{
+    int bit;
+    __asm__ ("bsrl %1, %0" : "=r" (bit) : "rm" (value));
+    return bit;
+}
+
+/*
+ * Get the run queue level of given thread under the current policy.
+ */
+static int Run_Level(struct Kernel_Thread* kthread)
+{
+    int level;
+
+    switch (g_currentScheduleAlgorithm) {
+        case SCHEDULE_MLF:
+            level = MAX_QUEUE_LEVEL - 1 - kthread->currentReadyQueue;
+            break;
+        default:
+            level = kthread->priority;
+            break;
+    }
+
+    KASSERT(level >= 0 && level < NUM_RUN_LEVELS);
+    return level;
+}
+
+/*
+ * Compare deadlines; works across wraparound.
+ */
+#define DEADLINE_BEFORE(a, b) ((long) ((a) - (b)) < 0)
+
+/*
+ * Start a new period for given EDF thread if its deadline has passed.
+ * Periods follow each other without drift; periods the thread
+ * missed altogether are skipped.
+ */
+static void Edf_Replenish(struct Kernel_Thread* kthread)
+{
+    if (!DEADLINE_BEFORE(g_numTicks, kthread->rtDeadline)) {
+        kthread->rtDeadline += ((g_numTicks - kthread->rtDeadline) / kthread->rtPeriod + 1) *
+            kthread->rtPeriod;
+        kthread->rtUsed = 0;
+    }
+}
+
+/*
+ * Is given thread an EDF thread with budget left in its period?
+ */
+static __inline__ bool Edf_Active(struct Kernel_Thread* kthread)
+{
+    return kthread->rtClass == RT_EDF && kthread->rtUsed < kthread->rtBudget;
+}
+
+static void Level_Queue_Add(struct Run_Queue* runQueue, int level, struct Kernel_Thread* kthread)
+{
+    KASSERT(level >= 0 && level < NUM_RUN_LEVELS);
+
+    kthread->runLevel = level;
+    Enqueue_Thread(&runQueue->level[level], kthread);
+    runQueue->bitmap |= (1UL << level);
+}
+
+static void Level_Queue_Remove(struct Run_Queue* runQueue, struct Kernel_Thread* kthread)
+{
+    int level = kthread->runLevel;
+
+    Remove_Thread(&runQueue->level[level], kthread);
+    if (Is_Thread_Queue_Empty(&runQueue->level[level]))
+        runQueue->bitmap &= ~(1UL << level);
+}
+
+/*
+ * Put given EDF thread on the EDF run queue, behind
+ * all threads with the same or an earlier deadline.
+ */
+static void Edf_Queue_Add(struct Kernel_Thread* kthread)
+{
+    struct Kernel_Thread *pos = Get_Back_Of_Thread_Queue(&s_edfRunQueue);
+
+    while (pos != 0 && DEADLINE_BEFORE(kthread->rtDeadline, pos->rtDeadline))
+        pos = Get_Prev_In_Thread_Queue(pos);
+    if (pos == 0)
+        Add_To_Front_Of_Thread_Queue(&s_edfRunQueue, kthread);
+    else
+        Insert_After_In_Thread_Queue(&s_edfRunQueue, pos, kthread);
+}
+
+/*
+ * Put given thread on the run queue: real-time threads on
+ * their own queues, others at the back of their level
+ * (or in the heap under the fair policy).
+ * Must be called with interrupts disabled.
+ */
+static void Run_Queue_Add(struct Kernel_Thread* kthread)
+{
+    KASSERT(kthread->runClass == RUN_CLASS_NONE);
+
+    if (kthread->priority != PRIORITY_IDLE)
+        ++s_runnableCount;
+    kthread->readyTime = g_numTicks;
+    kthread->schedStats.readyCycles = Read_Cycle_Counter();
+
+    if (kthread->rtClass == RT_EDF)
+        Edf_Replenish(kthread);
+
+    if (Edf_Active(kthread)) {
+        kthread->runClass = RUN_CLASS_EDF;
+        Edf_Queue_Add(kthread);
+    } else if (kthread->rtClass == RT_FIFO) {
+        kthread->runClass = RUN_CLASS_FIFO;
+        Level_Queue_Add(&s_fifoRunQueue, kthread->rtPriority, kthread);
+    } else if (g_currentScheduleAlgorithm == SCHEDULE_FAIR && kthread->priority != PRIORITY_IDLE) {
+        /*
+         * Don't let a thread that slept (or is new) catch up on
+         * all the time it did not run.
+         */
+        if (VRUNTIME_BEFORE(kthread->vruntime, s_minVruntime - FAIR_SLEEPER_CREDIT))
+            kthread->vruntime = s_minVruntime - FAIR_SLEEPER_CREDIT;
+        kthread->runClass = RUN_CLASS_FAIR;
+        Fair_Heap_Insert(kthread);
+    } else {
+        kthread->runClass = RUN_CLASS_NORMAL;
+        Level_Queue_Add(&s_runQueue, Run_Level(kthread), kthread);
+    }
+}
+
+/*
+ * Remove given thread from the run queue.
+ * Must be called with interrupts disabled.
+ */
+static void Run_Queue_Remove(struct Kernel_Thread* kthread)
+{
+    if (kthread->priority != PRIORITY_IDLE)
+        --s_runnableCount;
+
+    switch (kthread->runClass) {
+        case RUN_CLASS_NORMAL: Level_Queue_Remove(&s_runQueue, kthread); break;
+        case RUN_CLASS_FAIR: Fair_Heap_Remove(kthread); break;
+        case RUN_CLASS_FIFO: Level_Queue_Remove(&s_fifoRunQueue, kthread); break;
+        case RUN_CLASS_EDF: Remove_Thread(&s_edfRunQueue, kthread); break;
+        default: KASSERT(false);
+    }
+    kthread->runClass = RUN_CLASS_NONE;
+}
+
+/*
+ * Renew the budget of every EDF thread whose period is over.
+ * A runnable thread that ran out of budget waits on the normal
+ * run queue, so it moves back to the EDF run queue.
+ * Called on each timer tick, with interrupts disabled.
+ */
+static void Edf_Start_Periods(void)
+{
+    struct Kernel_Thread* kthread;
+
+    for (kthread = Get_Front_Of_Edf_Thread_List(&s_edfThreads); kthread != 0;
+         kthread = Get_Next_In_Edf_Thread_List(kthread)) {
+        if (DEADLINE_BEFORE(g_numTicks, kthread->rtDeadline))
+            continue;
+        Edf_Replenish(kthread);
+        if (kthread->runClass != RUN_CLASS_NONE && kthread->runClass != RUN_CLASS_EDF) {
+            Run_Queue_Remove(kthread);
+            Run_Queue_Add(kthread);
+        }
+    }
+}
+
+/*
+ * Take the most deserving thread off the run queue: the first
+ * EDF thread, else the first thread of the highest FIFO level,
+ * else the first thread of the highest normal level (or the
+ * top of the heap under the fair policy).
+ * Returns null if the run queue is empty.
+ * Must be called with interrupts disabled.
+ */
+static struct Kernel_Thread* Run_Queue_Remove_Best(void)
+{
+    struct Kernel_Thread* best;
+
+    if (!Is_Thread_Queue_Empty(&s_edfRunQueue))
+        best = Get_Front_Of_Thread_Queue(&s_edfRunQueue);
+    else if (s_fifoRunQueue.bitmap != 0)
+        best = Get_Front_Of_Thread_Queue(&s_fifoRunQueue.level[Highest_Bit(s_fifoRunQueue.bitmap)]);
+    else if (s_fairCount > 0) {
+        /* Under the fair policy, the heap holds every runnable thread but idle */
+        best = s_fairHeap[1];
+        if (VRUNTIME_BEFORE(s_minVruntime, best->vruntime))
+            s_minVruntime = best->vruntime;
+    } else if (s_runQueue.bitmap != 0)
+        best = Get_Front_Of_Thread_Queue(&s_runQueue.level[Highest_Bit(s_runQueue.bitmap)]);
+    else
+        return 0;
+
+    Run_Queue_Remove(best);
+    return best;
+}
+
+/*
+ * Does a runnable real-time thread deserve the CPU more
+ * than given running thread?
+ * Must be called with interrupts disabled.
+ */
+static bool Real_Time_Preempts(struct Kernel_Thread* current)
+{
+    if (!Is_Thread_Queue_Empty(&s_edfRunQueue))
+        return !Edf_Active(current) ||
+            DEADLINE_BEFORE(Get_Front_Of_Thread_Queue(&s_edfRunQueue)->rtDeadline, current->rtDeadline);
+
+    if (s_fifoRunQueue.bitmap != 0) {
+        if (Edf_Active(current))
+            return false;
+        return current->rtClass != RT_FIFO ||
+            Highest_Bit(s_fifoRunQueue.bitmap) > current->rtPriority;
+    }
+
+    return false;
+}
+
+/*
+ * Put all runnable threads back on the run queue at the level
+ * given by the current policy.  Used when the policy or the
+ * queue levels of threads change.
+ * Must be called with interrupts disabled.
+ */
+static void Rebuild_Run_Queue(void)
+{
+    struct Thread_Queue runnable;
+    struct Kernel_Thread* kthread;
+
+    KASSERT(!Interrupts_Enabled());
+
+    Clear_Thread_Queue(&runnable);
+    while ((kthread = Run_Queue_Remove_Best()) != 0)
+        Enqueue_Thread(&runnable, kthread);
+
+    while (!Is_Thread_Queue_Empty(&runnable)) {
+        kthread = Remove_From_Front_Of_Thread_Queue(&runnable);
+        Run_Queue_Add(kthread);
+    }
+}
+
+
+/*
+ * MLF aging: promote threads that waited on the run queue for
+ * a whole aging interval by one queue; every MLF_BOOST_AGING_ROUNDS
+ * intervals, boost all threads to queue 0 instead.
+ * Must be called with interrupts disabled.
+ */
+static void Age_Run_Queue(void)
+{
+    struct Kernel_Thread *kthread, *next;
+    int queue;
+
+    KASSERT(g_currentScheduleAlgorithm == SCHEDULE_MLF);
+
+    if (++s_agingRounds >= MLF_BOOST_AGING_ROUNDS) {
+        s_agingRounds = 0;
+        kthread = Get_FirstOfAllThreads();
+        while (kthread) {
+            if (kthread->priority != PRIORITY_IDLE)
+                kthread->currentReadyQueue = 0;
+            kthread = Get_NextOfAllThreads(kthread);
+        }
+        Rebuild_Run_Queue();
+        return;
+    }
+
+    for (queue = 1; queue < MAX_QUEUE_LEVEL; ++queue) {
+        kthread = Get_Front_Of_Thread_Queue(&s_runQueue.level[MAX_QUEUE_LEVEL - 1 - queue]);
+        while (kthread) {
+            next = Get_Next_In_Thread_Queue(kthread);
+            if (kthread->priority != PRIORITY_IDLE &&
+                g_numTicks - kthread->readyTime >= (ulong_t) s_agingTicks) {
+                Run_Queue_Remove(kthread);
+                kthread->currentReadyQueue--;
+                Run_Queue_Add(kthread);
+            }
+            kthread = next;
+        }
+    }
+}
 
 #ifdef SCHEDULE_DEBUG
 /*
@@ -64,10 +598,12 @@ static struct Thread_Queue s_runQueue[MAX_QUEUE_LEVEL];
 void PrintRunQueues (char *s) {
     struct Kernel_Thread *kthread;
     int laufQ;
-    Print("Printing Queues: %s\n", s);
-    for (laufQ=0; laufQ < MAX_QUEUE_LEVEL; laufQ++) {
-        kthread = Get_Front_Of_Thread_Queue(&s_runQueue[laufQ]);
-        Print("  Queue: %d\n",laufQ);
+    Print("Printing Queues: %s (bitmap %lx, fair %d)\n", s, s_runQueue.bitmap, s_fairCount);
+    for (laufQ=NUM_RUN_LEVELS-1; laufQ >= 0; laufQ--) {
+        kthread = Get_Front_Of_Thread_Queue(&s_runQueue.level[laufQ]);
+        if (kthread == 0)
+            continue;
+        Print("  Level: %d\n",laufQ);
 
         while (kthread)
         {
@@ -97,6 +633,7 @@ void PrintRunQueues (char *s) {
 int Switch2SchedulingPolicy(int policy, int quantum)
 {
     int rc;
+    struct Kernel_Thread *kthread;
 
 #ifdef SCHEDULE_DEBUG
     Print ("About to set policy to %d using %d quantum\n", policy, quantum);
@@ -104,6 +641,16 @@ int Switch2SchedulingPolicy(int policy, int quantum)
 
     if (quantum <= 0)  return EINVALID;
 
+    bool adaptive = (policy & SCHEDULE_ADAPTIVE) != 0;
+    policy &= ~SCHEDULE_ADAPTIVE;
+    if (policy != SCHEDULE_ROUNDROBIN && policy != SCHEDULE_MLF &&
+        policy != SCHEDULE_FAIR)  return EINVALID;
+
+    bool iflag = Begin_Int_Atomic();
+
+    /* Threads are requeued according to the new policy */
+    g_currentScheduleAlgorithm = policy;
+
     switch (policy) {
         case SCHEDULE_ROUNDROBIN:    // switch to round-robin
 #ifdef SCHEDULE_DEBUG
@@ -129,16 +676,66 @@ int Switch2SchedulingPolicy(int policy, int quantum)
 #endif
             break;
 
+        case SCHEDULE_FAIR:    	// switch to fair scheduling
+            // everybody starts out even
+            kthread = Get_FirstOfAllThreads();
+            while (kthread) {
+                kthread->vruntime = s_minVruntime;
+                kthread = Get_NextOfAllThreads(kthread);
+            }
+            Rebuild_Run_Queue();
+            break;
+
         default:
-            return EINVALID;
+            KASSERT(false);
     }
 
-    g_currentScheduleAlgorithm = policy;
+    s_adaptiveQuantum = adaptive;
+
+    End_Int_Atomic(iflag);
+
     g_Quantum = quantum;
     return 0;
 }
 
 
+/*
+ * Set the MLF aging interval in ticks; 0 disables aging.
+ */
+int Set_MLF_Aging(int agingTicks)
+{
+    if (agingTicks < 0)  return EINVALID;
+
+    bool iflag = Begin_Int_Atomic();
+    s_agingTicks = agingTicks;
+    s_agingRounds = 0;
+    End_Int_Atomic(iflag);
+
+    return 0;
+}
+
+
+/*
+ * Account the time given thread, which is being woken up,
+ * spent waiting, to the thread and to the wait queue.
+ */
+static void Account_Blocked_Time(struct Kernel_Thread* kthread)
+{
+    struct Thread_Sched_Stats *stats = &kthread->schedStats;
+    struct Wait_Reason_Stats *reasonStats = &s_waitReasonStats[stats->waitReason];
+    ulong_t micros = Cycles_To_Micros(Read_Cycle_Counter() - stats->blockCycles);
+
+    KASSERT(stats->waitReason >= 0 && stats->waitReason < NUM_WAIT_REASONS);
+
+    stats->blockedTime += micros;
+
+    ++reasonStats->waits;
+    reasonStats->totalTime += micros;
+    if (micros > reasonStats->maxTime)
+        reasonStats->maxTime = micros;
+}
+
+
 /*
  * Add given thread to the run queue, so that it
  * may be scheduled.  Must be called with interrupts disabled!
@@ -148,6 +745,9 @@ void Make_Runnable(struct Kernel_Thread* kthread)
 	int currentQ;
     KASSERT(!Interrupts_Enabled());
 			
+	if (kthread->blocked)
+		Account_Blocked_Time(kthread);
+
 	// for MLF schedulung: promote thread higher priority if thread was blocked before
 	if ((g_currentScheduleAlgorithm ==SCHEDULE_MLF) && (kthread->blocked == true) && (kthread->currentReadyQueue > 0)) 
 	{
@@ -160,7 +760,15 @@ void Make_Runnable(struct Kernel_Thread* kthread)
     currentQ = kthread->currentReadyQueue;
     KASSERT(currentQ >= 0 && currentQ < MAX_QUEUE_LEVEL);
     kthread->blocked = false;
-    Enqueue_Thread(&s_runQueue[currentQ], kthread);
+    Run_Queue_Add(kthread);
+
+    /*
+     * Real-time threads don't wait for the end of the current time slice,
+     * and nobody waits for the idle thread.
+     */
+    if (g_currentThread != 0 && kthread != g_currentThread &&
+        (g_currentThread->priority == PRIORITY_IDLE || Real_Time_Preempts(g_currentThread)))
+        g_needReschedule = true;
 }
 
 
@@ -185,13 +793,13 @@ int Move_All_Threads_To_Wait_Queue(int toQueue)
     Print("Move_All_Threads_To_Wait_Queue(): to=%d\n", toQueue);
 #endif
     struct Kernel_Thread *kthread;
-    int currentWaitQueue;
     
     if (toQueue >= MAX_QUEUE_LEVEL || toQueue < 0)
         return 0;
     
-    kthread = Get_FirstOfAllThreads();
+    bool iflag = Begin_Int_Atomic();
 
+    kthread = Get_FirstOfAllThreads();
     while (kthread) 
     {
 #ifdef SCHEDULE_DEBUG
@@ -199,24 +807,15 @@ int Move_All_Threads_To_Wait_Queue(int toQueue)
                 kthread->pid, kthread->priority, kthread->currentReadyQueue,
                 kthread->blocked, kthread->alive);
 #endif
-        currentWaitQueue = kthread->currentReadyQueue;
-        if (currentWaitQueue != toQueue) {
-            // if thread is in wait-queue then move to another queue
-            if (Is_Member_Of_Thread_Queue(&s_runQueue[currentWaitQueue],kthread))
-            {
-#ifdef SCHEDULE_DEBUG
-                Print ("Moving thread from wait-queue %d to wait-queue %d\n", currentWaitQueue, toQueue);
-#endif
-                bool iflag = Begin_Int_Atomic();
-                Remove_Thread(&s_runQueue[currentWaitQueue], kthread);
-                Enqueue_Thread(&s_runQueue[toQueue], kthread);
-                End_Int_Atomic(iflag);
-            }
-            kthread->currentReadyQueue = toQueue;
-        }
+        kthread->currentReadyQueue = toQueue;
         kthread = Get_NextOfAllThreads(kthread);
     }
 
+    /* Runnable threads move to the level of their new queue */
+    Rebuild_Run_Queue();
+
+    End_Int_Atomic(iflag);
+
     return 1;
 }
 
@@ -227,41 +826,32 @@ int Move_All_Threads_To_Wait_Queue(int toQueue)
 int Move_Idle_To_Queue(int toQueue)
 {
     struct Kernel_Thread *kthread;
-    int laufQ;
 #ifdef SCHEDULE_DEBUG
     Print("move idle thread to queue %d\n", toQueue);
 #endif
 
     if (toQueue >= MAX_QUEUE_LEVEL || toQueue < 0)  return 0;
 
-    // idle-thread must not be blocked, so it should be sufficient to look for
-    // the idle-thread in the run(wait) queues
+    bool iflag = Begin_Int_Atomic();
 
-    for (laufQ=0; laufQ < MAX_QUEUE_LEVEL-1; laufQ++)
+    kthread = Get_FirstOfAllThreads();
+    while (kthread) 
     {
-        kthread = Get_Front_Of_Thread_Queue(&s_runQueue[laufQ]);    
-
-        while (kthread) 
+        if (kthread->priority == PRIORITY_IDLE) 
         {
-            if (kthread->priority == PRIORITY_IDLE) 
-            {
 #ifdef SCHEDULE_DEBUG
-                Print("found idle thread %d in queue %d\n",kthread->pid, laufQ);
+            Print("found idle thread %d in queue %d\n",kthread->pid, kthread->currentReadyQueue);
 #endif
-                if (laufQ == toQueue)  return 1;
-
-                bool iflag = Begin_Int_Atomic();
-                Remove_Thread(&s_runQueue[laufQ], kthread);
-                Enqueue_Thread(&s_runQueue[toQueue], kthread);
-                End_Int_Atomic(iflag);
-                kthread->currentReadyQueue = toQueue;
-                return 1;
-            }
-
-            kthread = Get_Next_In_Thread_Queue(kthread);
+            kthread->currentReadyQueue = toQueue;
         }
+        kthread = Get_NextOfAllThreads(kthread);
     }
 
+    /* The idle thread is runnable, so it moves to the level of its new queue */
+    Rebuild_Run_Queue();
+
+    End_Int_Atomic(iflag);
+
     return 1;
 }
 
@@ -291,6 +881,190 @@ int Set_ThreadWaitQueueByReschedule(struct Kernel_Thread* kthread)
 }
 
 
+/*
+ * Put given thread in a real-time class.
+ * Params:
+ *   rtClass - RT_FIFO, RT_EDF, or RT_NONE to make it a normal thread again
+ *   param - the FIFO priority, or the EDF period in ticks
+ *   budget - the EDF budget in ticks per period
+ * Returns: 0 if successful, EBUSY if the EDF thread can't be
+ *   admitted, EINVALID for bad parameters
+ */
+int Set_Real_Time(struct Kernel_Thread* kthread, int rtClass, int param, int budget)
+{
+    ulong_t utilization = 0, oldUtilization = 0;
+    bool queued;
+    int rc = 0;
+
+    switch (rtClass) {
+        case RT_NONE:
+            break;
+        case RT_FIFO:
+            if (param < 0 || param >= RT_NUM_PRIORITIES)  return EINVALID;
+            break;
+        case RT_EDF:
+            if (param <= 0 || param > RT_MAX_PERIOD || budget <= 0 || budget > param)
+                return EINVALID;
+            utilization = (budget * 1000) / param;
+            break;
+        default:
+            return EINVALID;
+    }
+
+    bool iflag = Begin_Int_Atomic();
+
+    /* An exited thread has given back its reservation for good */
+    if (!kthread->alive && rtClass != RT_NONE) {
+        rc = EINVALID;
+        goto done;
+    }
+
+    /* Admission control */
+    if (kthread->rtClass == RT_EDF)
+        oldUtilization = (kthread->rtBudget * 1000) / kthread->rtPeriod;
+    if (s_edfUtilization - oldUtilization + utilization > RT_MAX_UTILIZATION) {
+        rc = EBUSY;
+        goto done;
+    }
+    s_edfUtilization = s_edfUtilization - oldUtilization + utilization;
+
+    queued = kthread->runClass != RUN_CLASS_NONE;
+    if (queued)
+        Run_Queue_Remove(kthread);
+
+    if (kthread->rtClass == RT_EDF && rtClass != RT_EDF)
+        Remove_From_Edf_Thread_List(&s_edfThreads, kthread);
+    else if (kthread->rtClass != RT_EDF && rtClass == RT_EDF)
+        Add_To_Back_Of_Edf_Thread_List(&s_edfThreads, kthread);
+
+    kthread->rtClass = rtClass;
+    kthread->rtPriority = rtClass == RT_FIFO ? param : 0;
+    kthread->rtPeriod = rtClass == RT_EDF ? param : 0;
+    kthread->rtBudget = rtClass == RT_EDF ? budget : 0;
+    kthread->rtDeadline = g_numTicks + kthread->rtPeriod;
+    kthread->rtUsed = 0;
+
+    if (queued)
+        Run_Queue_Add(kthread);
+    if (Real_Time_Preempts(g_currentThread))
+        g_needReschedule = true;
+
+done:
+    End_Int_Atomic(iflag);
+    return rc;
+}
+
+
+/*
+ * Change the priority of given thread, moving it to its new
+ * place if it is on the run queue.  Under MLF the place depends
+ * on the MLF queue only, so the thread stays where it was.
+ * Must be called with interrupts disabled.
+ */
+void Set_Thread_Priority(struct Kernel_Thread* kthread, int priority)
+{
+    KASSERT(!Interrupts_Enabled());
+    KASSERT(priority > PRIORITY_IDLE && priority < NUM_RUN_LEVELS);
+
+    if (kthread->runClass != RUN_CLASS_NONE) {
+        Run_Queue_Remove(kthread);
+        kthread->priority = priority;
+        Run_Queue_Add(kthread);
+    } else
+        kthread->priority = priority;
+}
+
+/*
+ * Get the time slice of given thread in ticks.
+ */
+int Get_Thread_Quantum(struct Kernel_Thread* kthread)
+{
+    int quantum = g_Quantum;
+
+    /* Lower MLF queues get longer slices */
+    if (g_currentScheduleAlgorithm == SCHEDULE_MLF)
+        quantum <<= kthread->currentReadyQueue;
+
+    /* Switching is pointless while there is little else to run */
+    if (s_adaptiveQuantum) {
+        if (s_runnableCount == 0)
+            quantum *= ADAPTIVE_EMPTY_FACTOR;
+        else if (s_runnableCount < ADAPTIVE_SHORT_QUEUE)
+            quantum *= ADAPTIVE_SHORT_FACTOR;
+    }
+
+    return quantum;
+}
+
+
+/*
+ * Charge a timer tick to given (running) thread.
+ * Called from the timer interrupt handler.
+ */
+void Account_Scheduler_Tick(struct Kernel_Thread* kthread)
+{
+    int rc;
+
+    KASSERT(!Interrupts_Enabled());
+
+    ++kthread->schedStats.cpuTicks;
+    ++s_runQueueLengthHist[s_runnableCount < RUN_QUEUE_HIST_BUCKETS ?
+                           s_runnableCount : RUN_QUEUE_HIST_BUCKETS - 1];
+
+    /* Charge the tick to the budget; run as a normal thread when used up */
+    if (Edf_Active(kthread) && ++kthread->rtUsed >= kthread->rtBudget)
+        g_needReschedule = true;
+    Edf_Start_Periods();
+
+    if (Real_Time_Preempts(kthread))
+        g_needReschedule = true;
+
+    /* FIFO threads and EDF threads within their budget have no time slice */
+    if (kthread->rtClass == RT_FIFO || Edf_Active(kthread))
+        return;
+
+    switch (g_currentScheduleAlgorithm) {
+        case SCHEDULE_MLF:
+            if (s_agingTicks > 0 && g_numTicks % s_agingTicks == 0)
+                Age_Run_Queue();
+
+            /*
+             * Don't make a thread that just woke up in a higher queue
+             * wait for the long slice of a lower queue.
+             */
+            if (kthread->numTicks >= g_Quantum && s_runQueue.bitmap != 0 &&
+                Highest_Bit(s_runQueue.bitmap) > MAX_QUEUE_LEVEL - 1 - kthread->currentReadyQueue)
+                g_needReschedule = true;
+            break;
+
+        case SCHEDULE_FAIR:
+            if (kthread->priority == PRIORITY_IDLE)
+                break;
+
+            kthread->vruntime += FAIR_TICK_VRUNTIME / Fair_Weight(kthread);
+
+            /* Preempt as soon as a runnable thread deserves the CPU more */
+            if (s_fairCount > 0 && VRUNTIME_BEFORE(s_fairHeap[1]->vruntime, kthread->vruntime) &&
+                kthread->numTicks >= FAIR_MIN_TICKS)
+                g_needReschedule = true;
+            break;
+    }
+
+    /*
+     * If thread has been running for an entire quantum,
+     * inform the interrupt return code that we want
+     * to choose a new thread.
+     */
+    if (kthread->numTicks >= Get_Thread_Quantum(kthread)) {
+        g_needReschedule = true;
+
+        /* determine next run/wait-queue for this thread */
+        rc = Set_ThreadWaitQueueByReschedule(kthread);
+        KASSERT(rc == 1);
+    }
+}
+
+
 /*
  * Get the next runnable thread from the run queue.
  * This is the scheduler.
@@ -298,45 +1072,35 @@ int Set_ThreadWaitQueueByReschedule(struct Kernel_Thread* kthread)
 struct Kernel_Thread* Get_Next_Runnable(void)
 {
     struct Kernel_Thread* best = 0;
-    struct Thread_Queue* q = s_runQueue;
 
-    /* Find the best thread from the highest-priority run queue */
-    //TODO("Find a runnable thread from run queues");
+    KASSERT(!Interrupts_Enabled());
 
-    switch (g_currentScheduleAlgorithm) {
-        case SCHEDULE_MLF:	// find next thread for MLF
-            while (q < s_runQueue + MAX_QUEUE_LEVEL) {
-                if ( (best = Find_Next(q)) )     		
-					break;
-                q++;
-            }
+    /* Take the first thread of the highest non-empty run queue level */
+    best = Run_Queue_Remove_Best();
 #ifdef SCHEDULE_DEBUG
-            if (best == 0)  PrintRunQueues("Get_Next_Runnable(): SCHEDULE_MLF best == 0");
-#if 0
-            /* do not activate this, it lasts too long */
-            PrintRunQueues("Get_Next_Runnable(): SCHEDULE_MLF");
-            if (best)  Print("Best found is %d, laufQ=%d\n", best->pid, q - s_runQueue);
+    if (best == 0)  PrintRunQueues("Get_Next_Runnable(): best == 0");
 #endif
-#endif
-            KASSERT(best != 0);
-            break;
+    KASSERT(best != 0);
 
-        default:		// find next thread for round robin
-            // we only need to look at queue 0
-            best = Find_Best(q);
-#ifdef SCHEDULE_DEBUG
-            if (best == 0)  PrintRunQueues("Get_Next_Runnable(): default best == 0");
-#endif
-            KASSERT(best != 0);
-            break;
-    }
+    //Print("Scheduling %x\n", best->pid);
 
-    bool iflag = Begin_Int_Atomic();
-    Remove_Thread(q, best);
-    End_Int_Atomic(iflag);
+    /* A thread yielding with nobody else to run is not switched away from */
+    if (best != g_currentThread) {
+        struct Thread_Sched_Stats *stats = &best->schedStats;
+        ulong_t latency = Cycles_To_Micros(Read_Cycle_Counter() - stats->readyCycles);
 
-    //Print("Scheduling %x\n", best->pid);
-    ++g_contextSwitches;
+        ++g_contextSwitches;
+        if (g_currentThread != 0)
+            ++g_currentThread->schedStats.switches;
+
+        ++stats->runs;
+        stats->totalRunLatency += latency;
+        if (latency > stats->maxRunLatency)
+            stats->maxRunLatency = latency;
+
+        if (g_currentScheduleAlgorithm == SCHEDULE_MLF)
+            ++g_queueContextSwitches[best->currentReadyQueue];
+    }
 
     return best;
 }
@@ -350,10 +1114,72 @@ void Dump_Scheduler_Info(void) {
 
     switch (g_currentScheduleAlgorithm) {
         case SCHEDULE_MLF: alg = "MLF"; break;
+        case SCHEDULE_FAIR: alg = "fair"; break;
         default: alg = "RR"; break;
     }
 
     Print ("Scheduler algorithm %s, quantum %d, context switches %ld\n",
            alg, g_Quantum, g_contextSwitches);
+    Print ("Real-time: EDF utilization %lu/1000, FIFO bitmap %lx\n",
+           s_edfUtilization, s_fifoRunQueue.bitmap);
+    if (s_adaptiveQuantum)
+        Print ("Adaptive time slices, %d runnable threads\n", s_runnableCount);
+    if (g_currentScheduleAlgorithm == SCHEDULE_MLF) {
+        int i;
+
+        Print ("MLF aging interval %d ticks\n", s_agingTicks);
+        for (i = 0; i < MAX_QUEUE_LEVEL; i++)
+            Print ("  queue %d: quantum %d, context switches %ld\n",
+                   i, g_Quantum << i, g_queueContextSwitches[i]);
+    }
 }
 
+/*
+ * Dump the scheduling statistics of all threads, the blocked time
+ * per wait reason and the run queue length histogram to the console
+ */
+void Dump_Thread_Sched_Info(void)
+{
+    struct Kernel_Thread *kthread;
+    struct Thread_Sched_Stats *stats;
+    struct Wait_Reason_Stats *reasonStats;
+    int i;
+
+    bool iflag = Begin_Int_Atomic();
+
+    Print("  pid prio   ticks    runs  avg lat  max lat     vol   invol   blocked\n");
+    kthread = Get_FirstOfAllThreads();
+    while (kthread) {
+        stats = &kthread->schedStats;
+        Print("%5d %4d %7lu %7lu %6luus %6luus %7lu %7lu %7lums\n",
+              kthread->pid, kthread->priority, stats->cpuTicks, stats->runs,
+              stats->runs > 0 ? stats->totalRunLatency / stats->runs : 0,
+              stats->maxRunLatency, stats->voluntarySwitches,
+              stats->switches - stats->voluntarySwitches,
+              stats->blockedTime / 1000);
+        kthread = Get_NextOfAllThreads(kthread);
+    }
+
+    Print("Blocked time per wait reason:\n");
+    for (i = 0; i < NUM_WAIT_REASONS; i++) {
+        reasonStats = &s_waitReasonStats[i];
+        if (reasonStats->waits == 0)
+            continue;
+        Print("  %-10s waits %lu, total %lums, avg %luus, max %luus\n",
+              s_waitReasonNames[i], reasonStats->waits, reasonStats->totalTime / 1000,
+              reasonStats->totalTime / reasonStats->waits, reasonStats->maxTime);
+    }
+
+    Print("Run queue length (ticks):");
+    for (i = 0; i < RUN_QUEUE_HIST_BUCKETS; i++) {
+        if (s_runQueueLengthHist[i] == 0)
+            continue;
+        if (i == RUN_QUEUE_HIST_BUCKETS - 1)
+            Print(" >=%d:%lu", i, s_runQueueLengthHist[i]);
+        else
+            Print(" %d:%lu", i, s_runQueueLengthHist[i]);
+    }
+    Print("\n");
+
+    End_Int_Atomic(iflag);
+}
@@ -0,0 +1,338 @@
+/*
+ * Named user semaphores
+ *
+ * Semaphores are found by name through a hash table, and by id
+ * through a table indexed by id.  Both tables double in size when
+ * they fill up, so there is no fixed limit on the number of
+ * semaphores, and P and V find a semaphore in constant time.
+ *
+ * This is free software.  You are permitted to use,
+ * redistribute, and modify it as specified in the file "COPYING".
+ */
+
+#include <geekos/kassert.h>
+#include <geekos/defs.h>
+#include <geekos/errno.h>
+#include <geekos/int.h>
+#include <geekos/malloc.h>
+#include <geekos/screen.h>
+#include <geekos/string.h>
+#include <geekos/timer.h>
+#include <geekos/kthread.h>
+#include <geekos/semaphore.h>
+
+/*
+ * The semaphore table, indexed by id - 1, and the buckets of
+ * the name hash table.  Both have s_semTableSize entries.
+ * The registry is protected by disabling interrupts.
+ */
+static struct Semaphore** s_semTable;
+static struct Semaphore** s_semNameHash;
+static int s_semTableSize;
+static int s_numSemaphores;
+
+/* All table slots below this one are in use */
+static int s_semFreeHint;
+
+/* ----------------------------------------------------------------------
+ * Private functions
+ * ---------------------------------------------------------------------- */
+
+static uint_t Hash_Name(const char* name)
+{
+    uint_t hash = 0;
+
+    while (*name != '\0')
+	hash = hash * 31 + (uchar_t) *name++;
+    return hash;
+}
+
+/*
+ * Double the size of the semaphore table and the name hash table.
+ * Must be called with interrupts disabled.
+ */
+static int Grow_Semaphore_Tables(void)
+{
+    int newSize = (s_semTableSize == 0) ? SEM_TABLE_MIN_SIZE : s_semTableSize * 2;
+    struct Semaphore** table;
+    struct Semaphore** nameHash;
+    int i;
+
+    KASSERT(!Interrupts_Enabled());
+
+    table = (struct Semaphore**) Malloc(newSize * sizeof(struct Semaphore*));
+    if (table == 0)
+	return ENOMEM;
+    nameHash = (struct Semaphore**) Malloc(newSize * sizeof(struct Semaphore*));
+    if (nameHash == 0) {
+	Free(table);
+	return ENOMEM;
+    }
+    memset(table, '\0', newSize * sizeof(struct Semaphore*));
+    memset(nameHash, '\0', newSize * sizeof(struct Semaphore*));
+
+    /* Copy the ids, and rehash the names */
+    for (i = 0; i < s_semTableSize; ++i) {
+	struct Semaphore* sem = s_semTable[i];
+	if (sem != 0) {
+	    uint_t bucket = Hash_Name(sem->sem_name) % newSize;
+	    table[i] = sem;
+	    sem->nameNext = nameHash[bucket];
+	    nameHash[bucket] = sem;
+	}
+    }
+
+    if (s_semTable != 0) {
+	Free(s_semTable);
+	Free(s_semNameHash);
+    }
+    s_semTable = table;
+    s_semNameHash = nameHash;
+    s_semTableSize = newSize;
+    return 0;
+}
+
+/*
+ * Find the semaphore with given name.
+ * Must be called with interrupts disabled.
+ */
+static struct Semaphore* Find_Semaphore(const char* name)
+{
+    struct Semaphore* sem;
+
+    if (s_semTableSize == 0)
+	return 0;
+
+    sem = s_semNameHash[Hash_Name(name) % s_semTableSize];
+    while (sem != 0 && strcmp(sem->sem_name, name) != 0)
+	sem = sem->nameNext;
+    return sem;
+}
+
+/*
+ * Find the semaphore with given id.
+ * Must be called with interrupts disabled.
+ */
+static struct Semaphore* Lookup_Semaphore(int sem_id)
+{
+    if (sem_id < 1 || sem_id > s_semTableSize)
+	return 0;
+    return s_semTable[sem_id - 1];
+}
+
+/*
+ * Find the registration of given thread for given semaphore.
+ * Must be called with interrupts disabled.
+ */
+static struct ThreadsSemaphore* Find_Registration(struct Kernel_Thread* kthread, struct Semaphore* sem)
+{
+    struct ThreadsSemaphore* kthread_sem =
+	Get_Front_Of_Thread_Semaphore_List(&kthread->SemaphoreList);
+
+    while (kthread_sem != 0 && kthread_sem->semaphore != sem)
+	kthread_sem = Get_Next_In_Thread_Semaphore_List(kthread_sem);
+    return kthread_sem;
+}
+
+/*
+ * Remove a semaphore nobody is registered for any more.
+ * Must be called with interrupts disabled.
+ */
+static void Remove_Semaphore(struct Semaphore* sem)
+{
+    struct Semaphore** pSem = &s_semNameHash[Hash_Name(sem->sem_name) % s_semTableSize];
+    int slot = sem->sem_id - 1;
+
+    KASSERT(sem->registered_users == 0);
+    KASSERT(Is_Thread_Queue_Empty(&sem->semQueue));
+
+    while (*pSem != sem)
+	pSem = &(*pSem)->nameNext;
+    *pSem = sem->nameNext;
+
+    s_semTable[slot] = 0;
+    if (slot < s_semFreeHint)
+	s_semFreeHint = slot;
+    --s_numSemaphores;
+
+    Free(sem);
+}
+
+/* ----------------------------------------------------------------------
+ * Public functions
+ * ---------------------------------------------------------------------- */
+
+/*
+ * Register given thread for the semaphore with given name,
+ * creating the semaphore with given initial count if it
+ * doesn't exist yet.
+ * Returns the semaphore id, or an error code.
+ */
+int Register_Semaphore(const char* name, int initialCount, struct Kernel_Thread* kthread)
+{
+    struct ThreadsSemaphore* kthread_sem;
+    struct Semaphore* sem;
+    int rc = 0;
+    bool iflag;
+
+    KASSERT(strlen(name) <= MAX_SEM_NAME);
+
+    iflag = Begin_Int_Atomic();
+
+    kthread_sem = (struct ThreadsSemaphore*) Malloc(sizeof(struct ThreadsSemaphore));
+    if (kthread_sem == 0) {
+	rc = ENOMEM;
+	goto done;
+    }
+
+    sem = Find_Semaphore(name);
+    if (sem == 0) {
+	/* The semaphore doesn't exist yet, so we create a new one */
+	if (s_numSemaphores == s_semTableSize && (rc = Grow_Semaphore_Tables()) != 0)
+	    goto fail;
+	sem = (struct Semaphore*) Malloc(sizeof(struct Semaphore));
+	if (sem == 0) {
+	    rc = ENOMEM;
+	    goto fail;
+	}
+
+	memset(sem, '\0', sizeof(struct Semaphore));
+	while (s_semTable[s_semFreeHint] != 0)
+	    ++s_semFreeHint;
+	sem->sem_id = s_semFreeHint + 1;
+	sem->sem_count = initialCount;
+	strcpy(sem->sem_name, name);
+	Clear_Thread_Queue(&sem->semQueue);
+
+	s_semTable[s_semFreeHint] = sem;
+	sem->nameNext = s_semNameHash[Hash_Name(name) % s_semTableSize];
+	s_semNameHash[Hash_Name(name) % s_semTableSize] = sem;
+	++s_numSemaphores;
+    }
+
+    /* Add semaphore to the thread's list of available semaphores */
+    ++sem->registered_users;
+    kthread_sem->semaphore = sem;
+    Add_To_Back_Of_Thread_Semaphore_List(&kthread->SemaphoreList, kthread_sem);
+    rc = sem->sem_id;
+    goto done;
+
+fail:
+    Free(kthread_sem);
+done:
+    End_Int_Atomic(iflag);
+    return rc;
+}
+
+/*
+ * Acquire the semaphore with given id for given thread,
+ * waiting until its count is positive.
+ * Returns 0 if successful, or an error code.
+ */
+int Semaphore_P(int sem_id, struct Kernel_Thread* kthread)
+{
+    struct Semaphore* sem;
+    int rc = 0;
+    bool iflag = Begin_Int_Atomic();
+
+    sem = Lookup_Semaphore(sem_id);
+    if (sem == 0)
+	rc = EINVALID;
+    else if (Find_Registration(kthread, sem) == 0)
+	rc = EACCESS;	/* not registered for semaphore */
+    else {
+	++sem->numP;
+	if (sem->sem_count <= 0) {
+	    ulong_t start = g_numTicks, waited;
+
+	    ++sem->numWaits;
+	    while (sem->sem_count <= 0)
+		Wait_For(&sem->semQueue, WAIT_SEMAPHORE);
+
+	    waited = g_numTicks - start;
+	    sem->waitTicks += waited;
+	    if (waited > sem->maxWaitTicks)
+		sem->maxWaitTicks = waited;
+	}
+	--sem->sem_count;
+    }
+
+    End_Int_Atomic(iflag);
+    return rc;
+}
+
+/*
+ * Release the semaphore with given id for given thread.
+ * Returns 0 if successful, or an error code.
+ */
+int Semaphore_V(int sem_id, struct Kernel_Thread* kthread)
+{
+    struct Semaphore* sem;
+    int rc = 0;
+    bool iflag = Begin_Int_Atomic();
+
+    sem = Lookup_Semaphore(sem_id);
+    if (sem == 0)
+	rc = EINVALID;
+    else if (Find_Registration(kthread, sem) == 0)
+	rc = EACCESS;	/* not registered for semaphore */
+    else {
+	++sem->numV;
+	++sem->sem_count;
+	Wake_Up_One(&sem->semQueue);
+    }
+
+    End_Int_Atomic(iflag);
+    return rc;
+}
+
+/*
+ * Unregister given thread from the semaphore with given id.
+ * The semaphore is destroyed when its last user is gone.
+ * Returns 0 if successful, or an error code.
+ */
+int DestroySemaphore(int sem_id, struct Kernel_Thread* kthread)
+{
+    struct ThreadsSemaphore* kthread_sem = 0;
+    struct Semaphore* sem;
+    int rc = 0;
+    bool iflag = Begin_Int_Atomic();
+
+    sem = Lookup_Semaphore(sem_id);
+    if (sem == 0)
+	rc = EINVALID;
+    else if ((kthread_sem = Find_Registration(kthread, sem)) == 0)
+	rc = EACCESS;	/* not registered for semaphore */
+    else {
+	/* Remove semaphore from the thread's list of available semaphores */
+	Remove_From_Thread_Semaphore_List(&kthread->SemaphoreList, kthread_sem);
+	Free(kthread_sem);
+
+	if (--sem->registered_users == 0)	/* no more users left? */
+	    Remove_Semaphore(sem);
+    }
+
+    End_Int_Atomic(iflag);
+    return rc;
+}
+
+/*
+ * Print all semaphores with their wait statistics.
+ */
+void Dump_Semaphore_Info(void)
+{
+    bool iflag = Begin_Int_Atomic();
+    int i;
+
+    Print("%d semaphores (table size %d)\n", s_numSemaphores, s_semTableSize);
+    Print("SemID RegUsr SemCount        P        V    Waits WaitTicks MaxWait SemName\n");
+    for (i = 0; i < s_semTableSize; ++i) {
+	struct Semaphore* sem = s_semTable[i];
+	if (sem != 0)
+	    Print("%5d %6d %8d %8lu %8lu %8lu %9lu %7lu %s\n", sem->sem_id,
+		sem->registered_users, sem->sem_count, sem->numP, sem->numV,
+		sem->numWaits, sem->waitTicks, sem->maxWaitTicks, sem->sem_name);
+    }
+
+    End_Int_Atomic(iflag);
+}
@@ -0,0 +1,94 @@
+/*
+ * Object caches
+ *
+ * This is free software.  You are permitted to use,
+ * redistribute, and modify it as specified in the file "COPYING".
+ */
+
+#include <geekos/kassert.h>
+#include <geekos/defs.h>
+#include <geekos/int.h>
+#include <geekos/mem.h>
+#include <geekos/screen.h>
+#include <geekos/slab.h>
+
+/*
+ * Carve a new page into objects and put them on the free list.
+ * Must be called with interrupts disabled.
+ */
+static bool Grow_Object_Cache(struct Object_Cache* cache)
+{
+    char* page;
+    uint_t offset;
+
+    KASSERT(!Interrupts_Enabled());
+
+    page = Alloc_Page();
+    if (page == 0)
+	return false;
+
+    ++cache->numPages;
+    for (offset = 0; offset + cache->objectSize <= PAGE_SIZE; offset += cache->objectSize) {
+	struct Free_Object* object = (struct Free_Object*) (page + offset);
+	object->next = cache->freeList;
+	cache->freeList = object;
+	++cache->numFree;
+    }
+
+    return true;
+}
+
+/*
+ * Allocate an object from given cache.
+ * Returns a null pointer if there isn't enough memory.
+ */
+void* Alloc_Object(struct Object_Cache* cache)
+{
+    struct Free_Object* object = 0;
+    bool iflag;
+
+    KASSERT(cache->objectSize >= sizeof(struct Free_Object) && cache->objectSize <= PAGE_SIZE);
+
+    iflag = Begin_Int_Atomic();
+
+    if (cache->freeList != 0 || Grow_Object_Cache(cache)) {
+	object = cache->freeList;
+	cache->freeList = object->next;
+	--cache->numFree;
+	++cache->numAllocated;
+    }
+
+    End_Int_Atomic(iflag);
+
+    return object;
+}
+
+/*
+ * Give an object back to the cache it was allocated from.
+ */
+void Free_Object(struct Object_Cache* cache, void* object)
+{
+    struct Free_Object* freeObject = object;
+    bool iflag;
+
+    KASSERT(object != 0);
+
+    iflag = Begin_Int_Atomic();
+
+    KASSERT(cache->numAllocated > 0);
+    freeObject->next = cache->freeList;
+    cache->freeList = freeObject;
+    ++cache->numFree;
+    --cache->numAllocated;
+
+    End_Int_Atomic(iflag);
+}
+
+/*
+ * Print the state of given cache.
+ */
+void Dump_Object_Cache(struct Object_Cache* cache)
+{
+    Print("%s cache: %lu objects of %u bytes in use, %lu free, %lu pages\n",
+	cache->name, cache->numAllocated, cache->objectSize, cache->numFree, cache->numPages);
+}
@@ -11,6 +11,9 @@
 #include <geekos/int.h>
 #include <geekos/kassert.h>
 #include <geekos/screen.h>
+#include <geekos/scheduler.h>
+#include <geekos/string.h>
+#include <geekos/timer.h>
 #include <geekos/synch.h>
 
 /*
@@ -21,12 +24,129 @@
  *   concurrent execution of interrupt handlers.  Mutexes and
  *   condition variables should only be used from kernel threads,
  *   with interrupts enabled.
+ * - A thread waiting for a mutex lends its priority to the owner
+ *   (and to the owner's owner, if the owner waits for another
+ *   mutex), so a low priority owner can't stall it for long.
+ *   This only helps under round robin and the fair scheduler;
+ *   MLF picks the run queue from the thread's MLF queue, not its
+ *   priority, so an inheriting owner keeps its place there.
+ * - Spinning is useless on a single CPU, so a thread finding the
+ *   mutex locked by a runnable owner yields to it a few times
+ *   instead, hoping the critical section is short, before it
+ *   goes to sleep.
  */
 
 /* ----------------------------------------------------------------------
  * Private functions
  * ---------------------------------------------------------------------- */
 
+#ifdef LOCK_PROFILING
+
+/*
+ * Profile records, one per lock name.  The last one collects
+ * the locks whose names didn't fit.  Records are never freed,
+ * so mutexes embedded in freed objects are no problem.
+ */
+static struct Lock_Profile s_lockProfiles[LOCK_PROFILE_MAX];
+static int s_numLockProfiles;
+
+/*
+ * Find or create the profile record for given lock name.
+ */
+static struct Lock_Profile* Get_Lock_Profile(const char* name)
+{
+    struct Lock_Profile* profile = 0;
+    bool iflag = Begin_Int_Atomic();
+    int i;
+
+    for (i = 0; i < s_numLockProfiles; ++i) {
+	if (strcmp(s_lockProfiles[i].name, name) == 0) {
+	    profile = &s_lockProfiles[i];
+	    break;
+	}
+    }
+
+    if (profile == 0) {
+	if (s_numLockProfiles < LOCK_PROFILE_MAX - 1) {
+	    profile = &s_lockProfiles[s_numLockProfiles++];
+	    profile->name = name;
+	} else {
+	    profile = &s_lockProfiles[LOCK_PROFILE_MAX - 1];
+	    profile->name = "(other)";
+	    s_numLockProfiles = LOCK_PROFILE_MAX;
+	}
+    }
+
+    End_Int_Atomic(iflag);
+    return profile;
+}
+
+#define PROFILE(mutex, stmt) do { if ((mutex)->profile != 0) { stmt; } } while (0)
+
+#else
+
+#define PROFILE(mutex, stmt) do { } while (0)
+
+#endif
+
+/*
+ * Lend the priority of the current thread to the owner of given
+ * mutex, and on along the chain of owners waiting for mutexes.
+ * Must be called with interrupts disabled.
+ */
+static void Inherit_Priority(struct Mutex* mutex)
+{
+    int priority = g_currentThread->priority;
+    struct Kernel_Thread* owner = mutex->owner;
+    int depth;
+
+    KASSERT(!Interrupts_Enabled());
+
+    for (depth = 0; depth < MUTEX_MAX_INHERIT_DEPTH; ++depth) {
+	if (owner == 0 || owner->priority >= priority)
+	    break;
+
+	Set_Thread_Priority(owner, priority);
+
+	/*
+	 * Follow the chain only while the owner really sleeps in a
+	 * mutex's wait queue; an owner that was woken is no longer in it.
+	 */
+	mutex = owner->waitingMutex;
+	if (mutex == 0 || !owner->blocked)
+	    break;
+
+	/* Keep the owner's place in the wait queue in priority order */
+	Remove_Thread(&mutex->waitQueue, owner);
+	Enqueue_Thread_By_Priority(&mutex->waitQueue, owner);
+	owner = mutex->owner;
+    }
+}
+
+/*
+ * Drop any priority the current thread inherited through
+ * mutexes it no longer holds.
+ * Must be called with interrupts disabled.
+ */
+static void Restore_Priority(void)
+{
+    struct Kernel_Thread* current = g_currentThread;
+    int priority = current->basePriority;
+    struct Mutex* held;
+
+    KASSERT(!Interrupts_Enabled());
+
+    for (held = Get_Front_Of_Mutex_List(&current->heldMutexes); held != 0;
+	 held = Get_Next_In_Mutex_List(held)) {
+	struct Kernel_Thread* waiter = Get_Front_Of_Thread_Queue(&held->waitQueue);
+	if (waiter != 0 && waiter->priority > priority)
+	    priority = waiter->priority;
+    }
+
+    if (priority != current->priority)
+	Set_Thread_Priority(current, priority);
+}
+
 /*
  * The mutex is currently locked.
  * Atomically reenable preemption and wait in the
@@ -39,7 +159,28 @@ static void Mutex_Wait(struct Mutex *mutex)
 
     Disable_Interrupts();
     g_preemptionDisabled = false;
-    Wait(&mutex->waitQueue);
+    PROFILE(mutex, ++mutex->profile->sleeps);
+    Inherit_Priority(mutex);
+    g_currentThread->waitingMutex = mutex;
+    Wait_For(&mutex->waitQueue, WAIT_MUTEX);
+    g_currentThread->waitingMutex = 0;
+    g_preemptionDisabled = true;
+    Enable_Interrupts();
+}
+
+/*
+ * The mutex is currently locked by a runnable thread.
+ * Give the owner (at our priority at least) the CPU.
+ */
+static void Mutex_Yield(struct Mutex *mutex)
+{
+    KASSERT(g_preemptionDisabled);
+
+    Disable_Interrupts();
+    Inherit_Priority(mutex);
+    g_preemptionDisabled = false;
+    Make_Runnable(g_currentThread);
+    Schedule();
     g_preemptionDisabled = true;
     Enable_Interrupts();
 }
@@ -55,14 +196,37 @@ static __inline__ void Mutex_Lock_Imp(struct Mutex* mutex)
     /* Make sure we're not already holding the mutex */
     KASSERT(!IS_HELD(mutex));
 
-    /* Wait until the mutex is in an unlocked state */
-    while (mutex->state == MUTEX_LOCKED) {
-	Mutex_Wait(mutex);
+    PROFILE(mutex, ++mutex->profile->acquisitions);
+    if (mutex->state == MUTEX_LOCKED) {
+	int yields;
+#ifdef LOCK_PROFILING
+	ulong_t waitStart = g_numTicks;
+#endif
+
+	PROFILE(mutex, ++mutex->profile->contended);
+
+	/* Let a runnable owner finish a short critical section */
+	for (yields = 0; yields < MUTEX_SPIN_YIELDS; ++yields) {
+	    if (mutex->state != MUTEX_LOCKED || mutex->owner->blocked)
+		break;
+	    Mutex_Yield(mutex);
+	}
+	if (mutex->state != MUTEX_LOCKED)
+	    PROFILE(mutex, ++mutex->profile->yieldAcquired);
+
+	/* Wait until the mutex is in an unlocked state */
+	while (mutex->state == MUTEX_LOCKED) {
+	    Mutex_Wait(mutex);
+	}
+
+	PROFILE(mutex, mutex->profile->waitTicks += g_numTicks - waitStart);
     }
 
     /* Now it's ours! */
     mutex->state = MUTEX_LOCKED;
     mutex->owner = g_currentThread;
+    Add_To_Back_Of_Mutex_List(&g_currentThread->heldMutexes, mutex);
+    PROFILE(mutex, mutex->lockTime = g_numTicks);
 }
 
 /*
@@ -76,9 +240,20 @@ static __inline__ void Mutex_Unlock_Imp(struct Mutex* mutex)
     /* Make sure mutex was actually acquired by this thread. */
     KASSERT(IS_HELD(mutex));
 
+#ifdef LOCK_PROFILING
+    if (mutex->profile != 0) {
+	ulong_t held = g_numTicks - mutex->lockTime;
+	if (held > mutex->profile->maxHoldTicks || mutex->profile->maxHoldPid == 0) {
+	    mutex->profile->maxHoldTicks = held;
+	    mutex->profile->maxHoldPid = g_currentThread->pid;
+	}
+    }
+#endif
+
     /* Unlock the mutex. */
     mutex->state = MUTEX_UNLOCKED;
     mutex->owner = 0;
+    Remove_From_Mutex_List(&g_currentThread->heldMutexes, mutex);
 
     /*
      * If there are threads waiting to acquire the mutex,
@@ -87,11 +262,15 @@ static __inline__ void Mutex_Unlock_Imp(struct Mutex* mutex)
      * is disabled, and therefore we know that no thread can
      * concurrently add itself to the queue.
      */
+    Disable_Interrupts();
+    if (g_currentThread->priority != g_currentThread->basePriority)
+	Restore_Priority();
     if (!Is_Thread_Queue_Empty(&mutex->waitQueue)) {
-	Disable_Interrupts();
+	/* The waiter leaves the queue now, not when it next runs */
+	Get_Front_Of_Thread_Queue(&mutex->waitQueue)->waitingMutex = 0;
 	Wake_Up_One(&mutex->waitQueue);
-	Enable_Interrupts();
     }
+    Enable_Interrupts();
 }
 
 /* ----------------------------------------------------------------------
@@ -103,11 +282,26 @@ static __inline__ void Mutex_Unlock_Imp(struct Mutex* mutex)
  */
 void Mutex_Init(struct Mutex* mutex)
 {
+    memset(mutex, '\0', sizeof(*mutex));
     mutex->state = MUTEX_UNLOCKED;
     mutex->owner = 0;
     Clear_Thread_Queue(&mutex->waitQueue);
 }
 
+#ifdef LOCK_PROFILING
+
+/*
+ * Initialize given mutex, and collect its contention
+ * statistics under given name.  The name must stay valid.
+ */
+void Mutex_Init_Named(struct Mutex* mutex, const char* name)
+{
+    Mutex_Init(mutex);
+    mutex->profile = Get_Lock_Profile(name);
+}
+
+#endif
+
 /*
  * Lock given mutex.
  */
@@ -132,6 +326,27 @@ void Mutex_Unlock(struct Mutex* mutex)
     g_preemptionDisabled = false;
 }
 
+#ifdef LOCK_PROFILING
+
+/*
+ * Print the contention statistics of all named mutexes.
+ */
+void Dump_Lock_Profile(void)
+{
+    int i;
+
+    Print("Lock             acquired contended yielded  sleeps wait ticks max hold (pid)\n");
+    for (i = 0; i < s_numLockProfiles; ++i) {
+	struct Lock_Profile* profile = &s_lockProfiles[i];
+	Print("%-16s %8lu %9lu %7lu %7lu %10lu %8lu (%d)\n",
+	    profile->name, profile->acquisitions, profile->contended,
+	    profile->yieldAcquired, profile->sleeps, profile->waitTicks,
+	    profile->maxHoldTicks, profile->maxHoldPid);
+    }
+}
+
+#endif
+
 /*
  * Initialize given condition.
  */
@@ -170,7 +385,7 @@ void Cond_Wait(struct Condition* cond, struct Mutex* mutex)
      */
     Disable_Interrupts();
     g_preemptionDisabled = false;
-    Wait(&cond->waitQueue);
+    Wait_For(&cond->waitQueue, WAIT_CONDITION);
     g_preemptionDisabled = true;
     Enable_Interrupts();
 
@@ -204,3 +419,179 @@ void Cond_Broadcast(struct Condition* cond)
     Wake_Up(&cond->waitQueue);
     Enable_Interrupts();  /* resume scheduling */
 }
+
+/*
+ * Initialize given reader/writer lock with given policy
+ * (RW_PREFER_READERS, RW_PREFER_WRITERS or RW_FAIR).
+ */
+void RW_Lock_Init(struct RW_Lock* lock, int policy)
+{
+    KASSERT(policy == RW_PREFER_READERS || policy == RW_PREFER_WRITERS || policy == RW_FAIR);
+
+    lock->policy = policy;
+    lock->readers = 0;
+    lock->writer = 0;
+    lock->waitingWriters = 0;
+    lock->readGrant = 0;
+    Clear_Thread_Queue(&lock->readQueue);
+    Clear_Thread_Queue(&lock->writeQueue);
+}
+
+/*
+ * Lock given reader/writer lock for reading.
+ * Several readers may hold the lock at the same time.
+ */
+void RW_Read_Lock(struct RW_Lock* lock)
+{
+    bool iflag = Begin_Int_Atomic();
+
+    KASSERT(!RW_IS_WRITE_HELD(lock));
+
+    while (lock->writer != 0 ||
+	   (lock->policy != RW_PREFER_READERS && lock->waitingWriters > 0)) {
+	ulong_t grant = lock->readGrant;
+
+	Wait_For(&lock->readQueue, WAIT_RW_LOCK);
+
+	/* A writer leaving may have let us in already (fair policy) */
+	if (lock->readGrant != grant)
+	    goto done;
+    }
+    ++lock->readers;
+
+done:
+    End_Int_Atomic(iflag);
+}
+
+/*
+ * Unlock given reader/writer lock held for reading.
+ * May be called with interrupts disabled.
+ */
+void RW_Read_Unlock(struct RW_Lock* lock)
+{
+    bool iflag = Begin_Int_Atomic();
+
+    KASSERT(lock->readers > 0);
+
+    --lock->readers;
+    if (lock->readers == 0)
+	Wake_Up_One(&lock->writeQueue);
+
+    End_Int_Atomic(iflag);
+}
+
+/*
+ * Lock given reader/writer lock for writing.
+ */
+void RW_Write_Lock(struct RW_Lock* lock)
+{
+    bool iflag = Begin_Int_Atomic();
+
+    KASSERT(!RW_IS_WRITE_HELD(lock));
+
+    ++lock->waitingWriters;
+    while (RW_IS_LOCKED(lock))
+	Wait_For(&lock->writeQueue, WAIT_RW_LOCK);
+    --lock->waitingWriters;
+    lock->writer = g_currentThread;
+
+    End_Int_Atomic(iflag);
+}
+
+/*
+ * Unlock given reader/writer lock held for writing, and let
+ * the waiting readers or the next writer in, as the policy says.
+ * May be called with interrupts disabled.
+ */
+void RW_Write_Unlock(struct RW_Lock* lock)
+{
+    bool iflag = Begin_Int_Atomic();
+
+    KASSERT(RW_IS_WRITE_HELD(lock));
+
+    lock->writer = 0;
+    if (lock->policy == RW_PREFER_WRITERS && lock->waitingWriters > 0)
+	Wake_Up_One(&lock->writeQueue);
+    else if (!Is_Thread_Queue_Empty(&lock->readQueue)) {
+	/*
+	 * Under the fair policy, readers that queued behind a
+	 * writer get in before the next writer: they are counted
+	 * as holding the lock before they even run.
+	 */
+	if (lock->policy == RW_FAIR) {
+	    struct Kernel_Thread* reader;
+	    for (reader = Get_Front_Of_Thread_Queue(&lock->readQueue); reader != 0;
+		 reader = Get_Next_In_Thread_Queue(reader))
+		++lock->readers;
+	    ++lock->readGrant;
+	}
+	Wake_Up(&lock->readQueue);
+    } else
+	Wake_Up_One(&lock->writeQueue);
+
+    End_Int_Atomic(iflag);
+}
+
+/*
+ * Initialize given sequence lock.
+ */
+void Seq_Lock_Init(struct Seq_Lock* lock)
+{
+    lock->sequence = 0;
+    lock->iflag = false;
+}
+
+/*
+ * Start reading data protected by given sequence lock.
+ * Returns the sequence number to pass to Seq_Read_Retry().
+ */
+ulong_t Seq_Read_Begin(struct Seq_Lock* lock)
+{
+    ulong_t start = lock->sequence;
+
+    /*
+     * Writers can't be preempted, so on one CPU a reader never
+     * finds one active (and waiting for it would never end).
+     */
+    KASSERT(!(start & 1));
+
+    __asm__ __volatile__ ("" : : : "memory");
+    return start;
+}
+
+/*
+ * Check whether data read since Seq_Read_Begin() may be
+ * inconsistent, so the reader must start over.
+ */
+bool Seq_Read_Retry(struct Seq_Lock* lock, ulong_t start)
+{
+    __asm__ __volatile__ ("" : : : "memory");
+    return lock->sequence != start;
+}
+
+/*
+ * Start modifying data protected by given sequence lock.
+ * The caller must exclude other writers.  Interrupts stay
+ * disabled until Seq_Write_End(), so readers can't run
+ * in the middle of the update.
+ */
+void Seq_Write_Begin(struct Seq_Lock* lock)
+{
+    bool iflag = Begin_Int_Atomic();
+
+    KASSERT(!(lock->sequence & 1));
+    lock->iflag = iflag;
+    ++lock->sequence;
+    __asm__ __volatile__ ("" : : : "memory");
+}
+
+/*
+ * Finish modifying data protected by given sequence lock.
+ */
+void Seq_Write_End(struct Seq_Lock* lock)
+{
+    __asm__ __volatile__ ("" : : : "memory");
+    ++lock->sequence;
+    KASSERT(!(lock->sequence & 1));
+    End_Int_Atomic(lock->iflag);
+}
@@ -24,6 +24,9 @@
 #include <geekos/sysinfo.h>
 #include <geekos/mqueue.h>
 #include <geekos/pipefs.h>
+#include <geekos/ramdisk.h>
+#include <geekos/futex.h>
+#include <geekos/semaphore.h>
 
 
 #ifdef DEBUG
@@ -317,6 +320,8 @@ static int Sys_GetPID(struct Interrupt_State* state)
  * Params:
  *   state->ebx - policy,
  *   state->ecx - number of ticks in quantum
+ *   state->edx - MLF aging interval in ticks, 0 to disable aging,
+ *                negative to leave it unchanged
  * Returns: 0 if successful, -1 otherwise
  */
 static int Sys_SetSchedulingPolicy(struct Interrupt_State* state)
@@ -325,13 +330,20 @@ static int Sys_SetSchedulingPolicy(struct Interrupt_State* state)
 
     uint_t  policy;
     uint_t  quantum;
+    int agingTicks;
+    int rc;
 
     policy = state->ebx;
     quantum = state->ecx;
+    agingTicks = (int) state->edx;
 
     KASSERT(!Interrupts_Enabled());
 
-    return Switch2SchedulingPolicy(policy, quantum);
+    rc = Switch2SchedulingPolicy(policy, quantum);
+    if (rc == 0 && agingTicks >= 0)
+        rc = Set_MLF_Aging(agingTicks);
+
+    return rc;
 }
 
 /*
@@ -347,39 +359,6 @@ static int Sys_GetTimeOfDay(struct Interrupt_State* state)
     return g_numTicks;
 }
 
-void PrintAllSemaphores()
-{
-    int k;
-    struct Kernel_Thread* kthread;
-    struct ThreadsSemaphore *kthread_sem;    
-
-    Print("List of Semaphores\nSemID RegUsr SemCount SemName\n");
-    for (k=0; k < MAX_SEM; k++)
-    {
-        if (g_semaphores[k].sem_id) 
-        {
-            Print("%5d %6d %8d %s\n",g_semaphores[k].sem_id, g_semaphores[k].registered_users, 
-                g_semaphores[k].sem_count, g_semaphores[k].sem_name);
-        }
-    }
-
-    Print("looping through threads and looking for assigned semaphores\n");
-    Print("SemQAdr ProcessId SemId\n");
-    kthread = Get_FirstOfAllThreads();
-    while (kthread)
-    {
-        kthread_sem = Get_Front_Of_Thread_Semaphore_List(&(kthread->SemaphoreList));
-        while (kthread_sem)
-        {
-            Print("%7X %9d %5d\n",(unsigned int)&(kthread->SemaphoreList),
-                kthread->pid, kthread_sem->semaphore->sem_id);    
-            kthread_sem = Get_Next_In_Thread_Semaphore_List(kthread_sem);
-        }
-        kthread=Get_NextOfAllThreads(kthread);
-    }
-    Print("\n");
-}
-
 /*
  * Create a semaphore.
  * Params:
@@ -390,83 +369,22 @@ void PrintAllSemaphores()
  */
 static int Sys_CreateSemaphore(struct Interrupt_State* state)
 {
-    //TODO("CreateSemaphore system call");
-    
-    int k = 0;
-    uint_t initial_count = state->edx;
+    int k;
     char sem_name[MAX_SEM_NAME+1];
-    
-#ifdef SEMAPHORE_DEBUG
-    Print("before creating semaphore for thread %d\n",Get_Current()->pid);
-    PrintAllSemaphores();
-#endif
-    
+
     k = state->ecx < MAX_SEM_NAME ? state->ecx : MAX_SEM_NAME;
     if (!Copy_From_User (sem_name, state->ebx, k))
         return EUNSPECIFIED;
     sem_name[k] = '\0';
 
-#ifdef SEMAPHORE_DEBUG
-    Print("Semaphore Name: %s\n", sem_name);
-#endif
-
-    /* determine if the semaphore already exists */
-    for (k=0; k < MAX_SEM; k++)
-        if (g_semaphores[k].sem_id && !strcmp(g_semaphores[k].sem_name, sem_name)) {
-            bool iflag = Begin_Int_Atomic();
-            g_semaphores[k].registered_users++;
-            
-            // add semaphore to threads list of available semaphores
-            struct ThreadsSemaphore* newSemaphore =
-                (struct ThreadsSemaphore*) Malloc(sizeof(struct ThreadsSemaphore));
-            newSemaphore->semaphore = &g_semaphores[k];
-            Add_To_Back_Of_Thread_Semaphore_List(&(Get_Current()->SemaphoreList), newSemaphore);
-            End_Int_Atomic(iflag);
-
-#ifdef SEMAPHORE_DEBUG
-            Print("Found semaphore '%s': id=%d, and added for thread %d\n", sem_name,
-                g_semaphores[k].sem_id, Get_Current()->pid);
-            Print("after creating semaphore\n");
-            PrintAllSemaphores();
-#endif
-            return g_semaphores[k].sem_id;
-        }
-
-    /* the semaphore doesn't exist yet, so we create a new one */
-    bool iflag = Begin_Int_Atomic();
-    for (k=0; k < MAX_SEM; k++)
-        if (!g_semaphores[k].sem_id) {        /* is this a free entry? */
-            g_semaphores[k].sem_id = k+1;
-            g_semaphores[k].registered_users = 1;
-            g_semaphores[k].sem_count = initial_count;
-            strcpy(g_semaphores[k].sem_name, sem_name);
-            // add semaphore to threads list of available semaphores
-            struct ThreadsSemaphore* newSemaphore =
-                (struct ThreadsSemaphore*) Malloc(sizeof(struct ThreadsSemaphore));
-            newSemaphore->semaphore = &g_semaphores[k];
-            Add_To_Back_Of_Thread_Semaphore_List(&(Get_Current()->SemaphoreList), newSemaphore);
-            End_Int_Atomic(iflag);
-
-#ifdef SEMAPHORE_DEBUG
-            Print("Created semaphore '%s', id=%d and added for thread %d, ctr=%d\n", sem_name,
-                k+1, Get_Current()->pid, initial_count);
-#endif
-#ifdef SEMAPHORE_DEBUG
-            Print("after creating semaphore of thread %d\n",Get_Current()->pid);
-            PrintAllSemaphores();
-#endif
-            return g_semaphores[k].sem_id;
-        }
-    End_Int_Atomic(iflag);
-
-    return EUNSPECIFIED; /* all semapore entries are already used */
+    return Register_Semaphore(sem_name, (int) state->edx, Get_Current());
 }
 
 
 /*
  * Acquire a semaphore.
  * Assume that the process has permission to access the semaphore,
- * the call will block until the semaphore count is >= 0.
+ * the call will block until the semaphore count is > 0.
  * Params:
  *   state->ebx - the semaphore id
  *
@@ -474,41 +392,7 @@ static int Sys_CreateSemaphore(struct Interrupt_State* state)
  */
 static int Sys_P(struct Interrupt_State* state)
 {
-    //TODO("P (semaphore acquire) system call");
-
-    uint_t id = state->ebx;
-    if (id < 1 || id > MAX_SEM)
-        return EUNSPECIFIED;    /* invalid semaphore id */
-
-#ifdef SEMAPHORE_DEBUG
-    Print("before P(%d) for thread %d\n",id,Get_Current()->pid);
-    PrintAllSemaphores();
-#endif
-
-    struct Semaphore *sem = g_semaphores + id - 1;
-    
-    // check if process has permission to use this semaphore
-    struct ThreadsSemaphore *kthread_sem =
-        Get_Front_Of_Thread_Semaphore_List(&(Get_Current()->SemaphoreList));
-
-    while (kthread_sem  &&  kthread_sem->semaphore->sem_id != id)
-        kthread_sem = Get_Next_In_Thread_Semaphore_List(kthread_sem);
-
-    if (!kthread_sem)
-        return EUNSPECIFIED;    /* not registered for semaphore */
-    
-    while (sem->sem_count < 0)  Wait(&sem->semQueue);
-        
-    bool iflag = Begin_Int_Atomic();
-    sem->sem_count--;
-    End_Int_Atomic(iflag);
-
-#ifdef SEMAPHORE_DEBUG
-    Print("after P(%d) for thread %d\n",id,Get_Current()->pid);
-    PrintAllSemaphores();
-#endif
-
-    return 0;
+    return Semaphore_P((int) state->ebx, Get_Current());
 }
 
 /*
@@ -520,40 +404,7 @@ static int Sys_P(struct Interrupt_State* state)
  */
 static int Sys_V(struct Interrupt_State* state)
 {
-    //TODO("V (semaphore release) system call");
-    
-    uint_t id = state->ebx;
-    if (id < 1 || id > MAX_SEM)
-        return EUNSPECIFIED;    /* invalid semaphore id */
-#ifdef SEMAPHORE_DEBUG
-    Print("before V(%d) for thread %d\n",id ,Get_Current()->pid);
-    PrintAllSemaphores();
-#endif
-
-    struct Semaphore *sem = g_semaphores + id - 1;
-        
-    // check if process has permission to use this semaphore
-    struct ThreadsSemaphore *kthread_sem =
-        Get_Front_Of_Thread_Semaphore_List(&(Get_Current()->SemaphoreList));
-
-    while (kthread_sem  &&  kthread_sem->semaphore->sem_id != id)
-        kthread_sem = Get_Next_In_Thread_Semaphore_List(kthread_sem);
-
-    if (!kthread_sem)
-        return EUNSPECIFIED;    /* not registered for semaphore */
-    
-    bool iflag = Begin_Int_Atomic();
-    sem->sem_count++;
-    End_Int_Atomic(iflag);
-    if (sem->sem_count <= 0)
-        Wake_Up_One(&sem->semQueue);
-
-#ifdef SEMAPHORE_DEBUG
-    Print("after V(%d) for thread %d\n", id, Get_Current()->pid);
-    PrintAllSemaphores();
-#endif
-
-    return 0;
+    return Semaphore_V((int) state->ebx, Get_Current());
 }
 
 /*
@@ -565,63 +416,7 @@ static int Sys_V(struct Interrupt_State* state)
  */
 static int Sys_DestroySemaphore(struct Interrupt_State* state)
 {
-    //TODO("DestroySemaphore system call");
-    
-    uint_t id = state->ebx;
-    
-    return DestroySemaphore(id, Get_Current());
-}
-
-
-int DestroySemaphore(int sem_id, struct Kernel_Thread* kthread)
-{
-    int id=sem_id;
-    
-    if (id < 1 || id > MAX_SEM)
-        return EUNSPECIFIED;    /* invalid semaphore id */
-
-#ifdef SEMAPHORE_DEBUG
-    Print("before destroy semaphore %d of thread %d\n",id,kthread->pid);
-    PrintAllSemaphores();
-#endif
-
-    struct Semaphore *sem = g_semaphores + id - 1;
-#ifdef SEMAPHORE_DEBUG
-    Print("Trying to Destroy: '%s', id=%d, users=%d\n", 
-        sem->sem_name, id, sem->registered_users);
-#endif
-
-    // check if process has permission to use this semaphore
-    struct ThreadsSemaphore *kthread_sem =
-        Get_Front_Of_Thread_Semaphore_List(&(kthread->SemaphoreList));
-
-    while (kthread_sem  &&  kthread_sem->semaphore->sem_id != id)
-        kthread_sem = Get_Next_In_Thread_Semaphore_List(kthread_sem);
-
-    if (!kthread_sem)
-        return EUNSPECIFIED;    /* not registered for semaphore */
-    
-    bool iflag = Begin_Int_Atomic();
-    sem->registered_users--;    /* unregister current user */
-    
-    // remove semaphore from the threads list of available semaphores
-    /* remove semaphore from current_thread */
-    Remove_From_Thread_Semaphore_List(&(kthread->SemaphoreList), kthread_sem);
-    Free(kthread_sem);    // speicher dieser Semaphore-Envelope wieder freigeben
-    
-    if (!sem->registered_users) {    /* no more users left? */
-        sem->sem_id = 0;    /* free semaphore entry */
-        Clear_Thread_Queue(&sem->semQueue);
-    }
-
-    End_Int_Atomic(iflag);    /*  Check with Clear_Thread_Queue()! */
-
-#ifdef SEMAPHORE_DEBUG
-    Print("After destroy semaphore %d of thread %d\n", id, kthread->pid);
-    PrintAllSemaphores();
-#endif    
-    
-    return 0;
+    return DestroySemaphore((int) state->ebx, Get_Current());
 }
 
 
@@ -1538,6 +1333,101 @@ int Sys_GetUid( struct Interrupt_State* state )
     return u->eUId;
 }
 
+/*
+ * Create a RAM disk
+ * Params:
+ *   state->ebx - size of the RAM disk in blocks
+ *
+ * Only root may create RAM disks, since their memory is pinned.
+ *
+ * Returns: unit number n of the new device "ram<n>" if successful,
+ *   error code (< 0) if unsuccessful
+ */
+static int Sys_CreateRamDisk(struct Interrupt_State *state)
+{
+    int rc;
+
+    KASSERT(g_currentThread->userContext);
+    if (g_currentThread->userContext->eUId != 0)
+        return EACCESS;
+
+    Enable_Interrupts();
+    rc = Create_Ram_Disk((int) state->ebx);
+    Disable_Interrupts();
+
+    return rc;
+}
+
+
+/*
+ * Put a process in a real-time scheduling class.
+ * Params:
+ *   state->ebx - pid of the process (a child of the caller), 0 for the caller
+ *   state->ecx - class: RT_NONE, RT_FIFO or RT_EDF
+ *   state->edx - FIFO priority, or EDF period in ticks
+ *   state->esi - EDF budget in ticks per period
+ *
+ * Only root may enter a real-time class, since a real-time
+ * process can lock out every normal one.
+ *
+ * Returns: 0 if successful, error code (< 0) if unsuccessful
+ */
+static int Sys_SetRealTime(struct Interrupt_State *state)
+{
+    struct Kernel_Thread *kthread = g_currentThread;
+
+    KASSERT(g_currentThread->userContext);
+    if ((int) state->ecx != RT_NONE && g_currentThread->userContext->eUId != 0)
+        return EACCESS;
+
+    if (state->ebx != 0) {
+        kthread = Lookup_Thread((int) state->ebx);
+        if (kthread == 0)
+            return ENOTFOUND;
+        if (kthread->owner != g_currentThread)
+            return EACCESS;
+    }
+
+    return Set_Real_Time(kthread, (int) state->ecx, (int) state->edx, (int) state->esi);
+}
+
+/*
+ * Create a thread sharing the user context of the current thread.
+ * Params:
+ *   state->ebx - user address the thread starts executing at
+ *   state->ecx - first argument passed to it (the thread function)
+ *   state->edx - second argument passed to it
+ *
+ * Returns: the pid of the new thread, or error code (< 0) if unsuccessful
+ */
+static int Sys_CreateThread(struct Interrupt_State *state)
+{
+    return Start_Shared_User_Thread(state->ebx, state->ecx, state->edx);
+}
+
+/*
+ * Wait on or wake up threads waiting on a futex.
+ * Params:
+ *   state->ebx - FUTEX_WAIT or FUTEX_WAKE
+ *   state->ecx - user address of the futex word
+ *   state->edx - value expected in the word (FUTEX_WAIT), or
+ *     maximum number of threads to wake up (FUTEX_WAKE)
+ *
+ * Returns: 0 or the number of threads woken up if successful,
+ *   error code (< 0) if unsuccessful
+ */
+static int Sys_Futex(struct Interrupt_State *state)
+{
+    switch (state->ebx) {
+    case FUTEX_WAIT:
+        return Futex_Wait(state->ecx, (int) state->edx);
+    case FUTEX_WAKE:
+        return Futex_Wake(state->ecx, (int) state->edx);
+    default:
+        return EINVALID;
+    }
+}
+
 
 /*
  * Global table of system call handler functions.
@@ -1592,6 +1482,13 @@ const Syscall g_syscallTable[] = {
     Sys_SetSetUid,
     Sys_SetEffectiveUid,
     Sys_GetUid,
+    /* Block device system calls. */
+    Sys_CreateRamDisk,
+    /* Scheduling system calls. */
+    Sys_SetRealTime,
+    /* Thread system calls. */
+    Sys_CreateThread,
+    Sys_Futex,
 };
 
 /*
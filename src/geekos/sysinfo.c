@@ -14,6 +14,10 @@
 #include <geekos/string.h>
 #include <geekos/paging.h>
 #include <geekos/scheduler.h>
+#include <geekos/blockdev.h>
+#include <geekos/workqueue.h>
+#include <geekos/synch.h>
+#include <geekos/semaphore.h>
 #include <libc/kernel.h>
 
 
@@ -35,6 +39,19 @@ int PrintSystemInfo(int flags) {
 
     if (flags & SYS_INFO_PAGING)     Dump_Paging_Info();
     if (flags & SYS_INFO_SCHEDULER)  Dump_Scheduler_Info();
+    if (flags & SYS_INFO_BLOCKDEV)   Dump_Block_Device_Info();
+    if (flags & SYS_INFO_THREADS) {
+	Dump_Thread_Sched_Info();
+	Dump_Work_Queue_Info();
+    }
+    if (flags & SYS_INFO_LOCKS) {
+#ifdef LOCK_PROFILING
+	Dump_Lock_Profile();
+#else
+	Print("Lock profiling is not compiled in (build with -DLOCK_PROFILING).\n");
+#endif
+    }
+    if (flags & SYS_INFO_SEMAPHORES) Dump_Semaphore_Info();
 
     return 0;
 }
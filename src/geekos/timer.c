@@ -19,6 +19,51 @@
 
 #define MAX_TIMER_EVENTS	100
 
+/*
+ * The PIT is run in one-shot mode (mode 0), and reprogrammed on each
+ * interrupt for the next tick or the next microsecond timer,
+ * whichever comes first.  A tick is PIT_TICK_COUNTS counts of the
+ * PIT_HZ input clock, the rate of the default periodic mode; this is
+ * also the longest interval the 16 bit counter can be programmed for.
+ */
+#define PIT_HZ			1193182
+#define PIT_TICK_COUNTS		65536
+#define PIT_MIN_COUNTS		100	/* about 84 us */
+
+/* Length of a tick in microseconds (about 54925, not 1000000/18) */
+#define PIT_TICK_MICROS		((ulong_t) ((PIT_TICK_COUNTS * 1000000ULL) / PIT_HZ))
+
+#define PIT_CHANNEL0_PORT	0x40
+#define PIT_COMMAND_PORT	0x43
+#define PIT_CMD_ONE_SHOT	0x30	/* channel 0, lo/hi byte, mode 0 */
+#define PIT_CMD_PERIODIC	0x36	/* channel 0, lo/hi byte, mode 3 */
+#define PIT_CMD_LATCH		0x00	/* latch channel 0 count */
+#define PIT_CMD_READ_STATUS	0xE2	/* read back channel 0 status */
+#define PIT_STATUS_OUT		0x80	/* output high: count reached 0 */
+
+/*
+ * Microsecond timers: PIT counts left until they expire.
+ */
+#define MAX_MICRO_TIMER_EVENTS	16
+#define MAX_TIMER_MICROS	1000000000UL	/* use Start_Timer() beyond this */
+
+struct Micro_Timer_Event {
+    int id;
+    long counts;
+    timerCallback callBack;		 /* called on expiry if not null */
+    struct Thread_Queue* waitQueue;	 /* woken up on expiry if not null */
+};
+
+static struct Micro_Timer_Event s_microEvents[MAX_MICRO_TIMER_EVENTS];
+static int s_microEventCount;
+
+/*
+ * PIT counts left until the next tick, and the number of
+ * counts the PIT was last programmed for.
+ */
+static long s_tickCountsLeft = PIT_TICK_COUNTS;
+static ulong_t s_programmedCounts = PIT_TICK_COUNTS;
+
 static int timerDebug = 0;
 static int timeEventCount;
 static int nextEventID;
@@ -34,6 +79,11 @@ volatile ulong_t g_numTicks;
  */
 static int s_spinCountPerTick;
 
+/*
+ * Number of time stamp counter cycles per microsecond
+ */
+static ulong_t s_cyclesPerMicro = 1;
+
 /*
  * Number of ticks to wait before calibrating the delay loop.
  */
@@ -67,12 +117,103 @@ int g_Quantum = DEFAULT_MAX_TICKS;
  * Private functions
  * ---------------------------------------------------------------------- */
 
-static void Timer_Interrupt_Handler(struct Interrupt_State* state)
+/*
+ * Start the PIT counting down given number of counts.
+ */
+static void Program_Timer(ulong_t counts)
+{
+    KASSERT(counts > 0 && counts <= PIT_TICK_COUNTS);
+
+    s_programmedCounts = counts;
+    Out_Byte(PIT_COMMAND_PORT, PIT_CMD_ONE_SHOT);
+    Out_Byte(PIT_CHANNEL0_PORT, counts & 0xff);	/* 65536 is written as 0 */
+    Out_Byte(PIT_CHANNEL0_PORT, (counts >> 8) & 0xff);
+}
+
+/*
+ * Return the number of counts since the PIT was last programmed.
+ * In mode 0 the counter keeps counting down after reaching 0,
+ * so the time since the interrupt was raised is included.
+ */
+static ulong_t Timer_Elapsed(void)
+{
+    uchar_t status;
+    ulong_t count;
+
+    Out_Byte(PIT_COMMAND_PORT, PIT_CMD_READ_STATUS);
+    status = In_Byte(PIT_CHANNEL0_PORT);
+    Out_Byte(PIT_COMMAND_PORT, PIT_CMD_LATCH);
+    count = In_Byte(PIT_CHANNEL0_PORT);
+    count |= In_Byte(PIT_CHANNEL0_PORT) << 8;
+
+    if (status & PIT_STATUS_OUT)
+	return s_programmedCounts + ((0x10000 - count) & 0xffff);
+    else if (count == 0)
+	return 0;	/* not started counting yet */
+    else
+	return s_programmedCounts - count;
+}
+
+/*
+ * Account for given number of PIT counts having passed
+ * since the PIT was last programmed.
+ */
+static void Advance_Timer(ulong_t counts)
 {
     int i;
-    struct Kernel_Thread* current = g_currentThread;
 
-    Begin_IRQ(state);
+    s_tickCountsLeft -= counts;
+    for (i = 0; i < s_microEventCount; i++)
+	s_microEvents[i].counts -= counts;
+}
+
+/*
+ * Program the PIT for the next tick or microsecond timer.
+ */
+static void Program_Next_Timer_Interrupt(void)
+{
+    long counts = s_tickCountsLeft;
+    int i;
+
+    for (i = 0; i < s_microEventCount; i++)
+	if (s_microEvents[i].counts < counts)
+	    counts = s_microEvents[i].counts;
+
+    if (counts < PIT_MIN_COUNTS)
+	counts = PIT_MIN_COUNTS;
+    Program_Timer(counts);
+}
+
+/*
+ * Run and remove the microsecond timers that have expired.
+ */
+static void Expire_Micro_Timers(void)
+{
+    int i = 0;
+
+    while (i < s_microEventCount) {
+	struct Micro_Timer_Event event = s_microEvents[i];
+
+	if (event.counts > 0) {
+	    i++;
+	    continue;
+	}
+
+	s_microEvents[i] = s_microEvents[--s_microEventCount];
+	if (event.callBack != 0)
+	    event.callBack(event.id);
+	if (event.waitQueue != 0)
+	    Wake_Up(event.waitQueue);
+    }
+}
+
+/*
+ * Work done once per tick.
+ */
+static void Timer_Tick(void)
+{
+    int i;
+    struct Kernel_Thread* current = g_currentThread;
 
     /* Update global and per-thread number of ticks */
     ++g_numTicks;
@@ -82,9 +223,17 @@ static void Timer_Interrupt_Handler(struct Interrupt_State* state)
     /* update timer events */
     for (i=0; i < timeEventCount; i++) {
 	if (pendingTimerEvents[i].ticks == 0) {
+	    int id = pendingTimerEvents[i].id;
 	    if (timerDebug) Print("timer: event %d expired (%d ticks)\n", 
-	        pendingTimerEvents[i].id, pendingTimerEvents[i].origTicks);
-	    (pendingTimerEvents[i].callBack)(pendingTimerEvents[i].id);
+	        id, pendingTimerEvents[i].origTicks);
+	    (pendingTimerEvents[i].callBack)(id);
+
+	    /*
+	     * A callback cancelling its own timer moves the last
+	     * event into this slot; don't skip that one.
+	     */
+	    if (i < timeEventCount && pendingTimerEvents[i].id != id)
+		--i;
 	} else {
 	    pendingTimerEvents[i].ticks--;
 	}
@@ -92,25 +241,32 @@ static void Timer_Interrupt_Handler(struct Interrupt_State* state)
 
     /*
      * If thread has been running for an entire quantum,
-     * inform the interrupt return code that we want
+     * the scheduler informs the interrupt return code that we want
      * to choose a new thread.
      */
 #ifdef SCHEDULE_DEBUG
 #if 0
-		 Print("Timer_Interrupt_Handler: current thread (%d) ticks: %lu - quantum: %d\n", current->pid, current->numTicks, g_Quantum);
+		 Print("Timer_Interrupt_Handler: current thread (%d) ticks: %lu - quantum: %d\n", current->pid, current->numTicks, Get_Thread_Quantum(current));
 #endif
 #endif
-    if (current->numTicks >= g_Quantum) 
-	{
-		g_needReschedule = true;
-		
-		/* determine next run/wait-queue for this thread */
-		i=Set_ThreadWaitQueueByReschedule(current);
-		KASSERT(i==1);
-		//if (current->currentReadyQueue < (MAX_QUEUE_LEVEL - 1)) current->currentReadyQueue++;
-    }
+    Account_Scheduler_Tick(current);
 
     Page_Cleaner();
+}
+
+static void Timer_Interrupt_Handler(struct Interrupt_State* state)
+{
+    Begin_IRQ(state);
+
+    Advance_Timer(Timer_Elapsed());
+    Expire_Micro_Timers();
+
+    if (s_tickCountsLeft <= 0) {
+	s_tickCountsLeft += PIT_TICK_COUNTS;
+	Timer_Tick();
+    }
+
+    Program_Next_Timer_Interrupt();
 
     End_IRQ(state);
 }
@@ -167,6 +323,8 @@ static void Spin(int count)
  */
 static void Calibrate_Delay(void)
 {
+    unsigned long long startCycles, tickCycles;
+
     Disable_Interrupts();
 
     /* Install temporarily interrupt handler */
@@ -175,9 +333,16 @@ static void Calibrate_Delay(void)
 
     Enable_Interrupts();
 
-    /* Wait a few ticks */
+    /* Wait a few ticks, timing the last one with the cycle counter */
+    while (g_numTicks < CALIBRATE_NUM_TICKS - 1)
+	;
+    startCycles = Read_Cycle_Counter();
     while (g_numTicks < CALIBRATE_NUM_TICKS)
 	;
+    tickCycles = Read_Cycle_Counter() - startCycles;
+    s_cyclesPerMicro = (ulong_t) tickCycles / PIT_TICK_MICROS;
+    if (s_cyclesPerMicro == 0)
+	s_cyclesPerMicro = 1;
 
     /*
      * Execute the spin loop.
@@ -211,17 +376,21 @@ void Init_Timer(void)
     Print("Initializing timer...\n");
 
     /* configure for default clock */
-    Out_Byte(0x43, 0x36);
-    Out_Byte(0x40, 0x00);
-    Out_Byte(0x40, 0x00);
+    Out_Byte(PIT_COMMAND_PORT, PIT_CMD_PERIODIC);
+    Out_Byte(PIT_CHANNEL0_PORT, 0x00);
+    Out_Byte(PIT_CHANNEL0_PORT, 0x00);
 
     /* Calibrate for delay loop */
     Calibrate_Delay();
     Print("Delay loop: %d iterations per tick\n", s_spinCountPerTick);
+    Print("Cycle counter: %lu cycles per microsecond\n", s_cyclesPerMicro);
 
-    /* Install an interrupt handler for the timer IRQ */
+    /* Install an interrupt handler for the timer IRQ, and go one-shot */
+    Disable_Interrupts();
     Install_IRQ(TIMER_IRQ, &Timer_Interrupt_Handler);
+    Program_Timer(PIT_TICK_COUNTS);
     Enable_IRQ(TIMER_IRQ);
+    Enable_Interrupts();
 }
 
 int Start_Timer(int ticks, timerCallback cb)
@@ -274,6 +443,122 @@ int Cancel_Timer(int id)
     return -1;
 }
 
+/*
+ * Convert microseconds to PIT counts (1.193182 counts per microsecond).
+ */
+static long Micros_To_Counts(ulong_t micros)
+{
+    return micros + (micros / 1000) * 193 + ((micros % 1000) * 193) / 1000;
+}
+
+/*
+ * Add a microsecond timer; returns its id, or -1 if there is no room.
+ */
+static int Add_Micro_Timer(ulong_t micros, timerCallback cb, struct Thread_Queue* waitQueue)
+{
+    struct Micro_Timer_Event *event;
+    ulong_t elapsed;
+
+    KASSERT(!Interrupts_Enabled());
+
+    if (s_microEventCount == MAX_MICRO_TIMER_EVENTS || micros > MAX_TIMER_MICROS)
+	return -1;
+
+    /*
+     * Make the counts of all timers relative to now. If the PIT has
+     * already raised its interrupt, the handler will reprogram it.
+     */
+    elapsed = Timer_Elapsed();
+    if (elapsed < s_programmedCounts)
+	Advance_Timer(elapsed);
+
+    event = &s_microEvents[s_microEventCount++];
+    event->id = nextEventID++;
+    event->counts = Micros_To_Counts(micros);
+    event->callBack = cb;
+    event->waitQueue = waitQueue;
+
+    if (elapsed < s_programmedCounts)
+	Program_Next_Timer_Interrupt();
+
+    return event->id;
+}
+
+/*
+ * Start a one-shot timer that calls given function (from the
+ * timer interrupt handler) after given number of microseconds.
+ * Must be called with interrupts disabled.
+ * Returns the timer id, or -1 if no timer is available.
+ */
+int Start_Timer_Micros(ulong_t micros, timerCallback cb)
+{
+    return Add_Micro_Timer(micros, cb, 0);
+}
+
+/*
+ * Cancel a timer started with Start_Timer_Micros().
+ * Must be called with interrupts disabled.
+ */
+int Cancel_Timer_Micros(int id)
+{
+    int i;
+
+    KASSERT(!Interrupts_Enabled());
+    for (i = 0; i < s_microEventCount; i++) {
+	if (s_microEvents[i].id == id) {
+	    s_microEvents[i] = s_microEvents[--s_microEventCount];
+	    return 0;
+	}
+    }
+    return -1;
+}
+
+/*
+ * Suspend the current thread for given number of microseconds.
+ * Must be called with interrupts disabled.
+ */
+void Micro_Sleep(ulong_t micros)
+{
+    struct Thread_Queue waitQueue;
+    int id, i;
+    bool pending;
+
+    KASSERT(!Interrupts_Enabled());
+
+    Clear_Thread_Queue(&waitQueue);
+    id = Add_Micro_Timer(micros, 0, &waitQueue);
+    if (id < 0) {
+	/* No timer available; fall back to spinning */
+	Micro_Delay((int) micros);
+	return;
+    }
+
+    do {
+	Wait_For(&waitQueue, WAIT_SLEEP);
+	pending = false;
+	for (i = 0; i < s_microEventCount; i++)
+	    if (s_microEvents[i].id == id)
+		pending = true;
+    } while (pending);
+}
+
+/*
+ * Convert a number of time stamp counter cycles to microseconds.
+ * Intervals too long to be represented saturate at ULONG_MAX.
+ */
+ulong_t Cycles_To_Micros(unsigned long long cycles)
+{
+    /* Stick to 32 bit division; long intervals lose some precision */
+    if ((cycles >> 32) == 0)
+	return (ulong_t) cycles / s_cyclesPerMicro;
+    if ((cycles >> 48) == 0) {
+	ulong_t micros = (ulong_t) (cycles >> 16) / s_cyclesPerMicro;
+	if (micros < 0x10000)
+	    return micros << 16;
+    }
+    return ULONG_MAX;
+}
+
 #define US_PER_TICK (TICKS_PER_SEC * 1000000)
 
 /*
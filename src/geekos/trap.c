@@ -10,9 +10,87 @@
 #include <geekos/idt.h>
 #include <geekos/kthread.h>
 #include <geekos/defs.h>
+#include <geekos/int.h>
+#include <geekos/screen.h>
+#include <geekos/string.h>
+#include <geekos/slab.h>
 #include <geekos/syscall.h>
 #include <geekos/trap.h>
 
+/* Control register bits used for FPU state management */
+#define CR0_MP		(1 << 1)	/* wait/fwait honors TS */
+#define CR0_EM		(1 << 2)	/* emulate FPU */
+#define CR0_TS		(1 << 3)	/* task switched */
+#define CR0_NE		(1 << 5)	/* native FPU error reporting */
+#define CR4_OSFXSR	(1 << 9)	/* fxsave/fxrstor and SSE enabled */
+#define CR4_OSXMMEXCPT	(1 << 10)	/* SIMD floating point exceptions */
+
+/* CPUID feature bits (leaf 1, edx) */
+#define CPUID_FXSR	(1 << 24)
+#define CPUID_SSE	(1 << 25)
+
+/* Default SSE control/status: all exceptions masked */
+#define MXCSR_DEFAULT	0x1f80
+
+/*
+ * Thread whose register state is currently loaded in the FPU.
+ * Its saved state is stale until somebody else needs the FPU.
+ */
+struct Kernel_Thread* g_fpuOwner;
+
+/* Whether the CPU has fxsave/fxrstor; otherwise fnsave/frstor are used */
+static bool s_haveFxsr;
+
+/* Saved state of a freshly initialized FPU, copied on first use */
+static uchar_t s_initialFpuState[FPU_STATE_SIZE] __attribute__ ((aligned (16)));
+
+/*
+ * Cache of FPU save areas.  Objects are carved out of pages at
+ * multiples of their size, so they are suitably aligned for fxsave.
+ */
+static struct Object_Cache s_fpuStateCache =
+    OBJECT_CACHE_INITIALIZER("fpu state", FPU_STATE_SIZE);
+
+static __inline__ ulong_t Get_CR0(void)
+{
+    ulong_t value;
+    __asm__ __volatile__ ("movl %%cr0, %0" : "=r" (value));
+    return value;
+}
+
+static __inline__ void Set_CR0(ulong_t value)
+{
+    __asm__ __volatile__ ("movl %0, %%cr0" : : "r" (value));
+}
+
+static __inline__ ulong_t Get_CR4(void)
+{
+    ulong_t value;
+    __asm__ __volatile__ ("movl %%cr4, %0" : "=r" (value));
+    return value;
+}
+
+static __inline__ void Set_CR4(ulong_t value)
+{
+    __asm__ __volatile__ ("movl %0, %%cr4" : : "r" (value));
+}
+
+static void Save_FPU_State(uchar_t* area)
+{
+    if (s_haveFxsr)
+	__asm__ __volatile__ ("fxsave %0" : "=m" (*(uchar_t (*)[FPU_STATE_SIZE]) area));
+    else
+	__asm__ __volatile__ ("fnsave %0; fwait" : "=m" (*(uchar_t (*)[FPU_STATE_SIZE]) area));
+}
+
+static void Restore_FPU_State(const uchar_t* area)
+{
+    if (s_haveFxsr)
+	__asm__ __volatile__ ("fxrstor %0" : : "m" (*(const uchar_t (*)[FPU_STATE_SIZE]) area));
+    else
+	__asm__ __volatile__ ("frstor %0" : : "m" (*(const uchar_t (*)[FPU_STATE_SIZE]) area));
+}
+
 /*
  * TODO: need to add handlers for other exceptions (such as bounds
  * check, debug, etc.)
@@ -35,6 +113,94 @@ static void GPF_Handler(struct Interrupt_State* state)
     KASSERT(false);
 }
 
+/*
+ * Handler for the device not available exception, raised by the
+ * first FPU or SSE instruction a thread executes after a context
+ * switch (see Update_FPU_Trap in lowlevel.asm).  The previous
+ * owner's registers are saved and the current thread's restored,
+ * so threads which never use the FPU never pay for it.
+ */
+static void FPU_Handler(struct Interrupt_State* state)
+{
+    struct Kernel_Thread* current = g_currentThread;
+
+    KASSERT(!Interrupts_Enabled());
+
+    __asm__ __volatile__ ("clts");
+    if (g_fpuOwner == current)
+	return;
+
+    if (current->fpuState == 0) {
+	current->fpuState = Alloc_Object(&s_fpuStateCache);
+	if (current->fpuState == 0) {
+	    Print("Out of memory for FPU state of thread %d\n", current->pid);
+	    Exit(-1);
+	}
+	memcpy(current->fpuState, s_initialFpuState, FPU_STATE_SIZE);
+    }
+
+    if (g_fpuOwner != 0)
+	Save_FPU_State(g_fpuOwner->fpuState);
+    Restore_FPU_State(current->fpuState);
+    g_fpuOwner = current;
+}
+
+/*
+ * Give back the FPU save area of a thread that is being destroyed.
+ */
+void Release_FPU_State(struct Kernel_Thread* kthread)
+{
+    bool iflag = Begin_Int_Atomic();
+
+    if (g_fpuOwner == kthread)
+	g_fpuOwner = 0;
+    if (kthread->fpuState != 0) {
+	Free_Object(&s_fpuStateCache, kthread->fpuState);
+	kthread->fpuState = 0;
+    }
+
+    End_Int_Atomic(iflag);
+}
+
+/*
+ * Enable the FPU (and SSE, if present) for lazy state switching,
+ * and capture the initial register state given to new users.
+ */
+static void Init_FPU(void)
+{
+    ulong_t eax, ebx, ecx, edx;
+    ulong_t cr0;
+
+    __asm__ __volatile__ ("cpuid"
+	: "=a" (eax), "=b" (ebx), "=c" (ecx), "=d" (edx) : "a" (1));
+    s_haveFxsr = (edx & CPUID_FXSR) != 0;
+
+    cr0 = Get_CR0();
+    cr0 &= ~(CR0_EM | CR0_TS);
+    cr0 |= CR0_MP | CR0_NE;
+    Set_CR0(cr0);
+
+    if (s_haveFxsr) {
+	ulong_t cr4 = Get_CR4() | CR4_OSFXSR;
+	if (edx & CPUID_SSE)
+	    cr4 |= CR4_OSXMMEXCPT;
+	Set_CR4(cr4);
+    }
+
+    __asm__ __volatile__ ("fninit");
+    if (edx & CPUID_SSE) {
+	ulong_t mxcsr = MXCSR_DEFAULT;
+	__asm__ __volatile__ ("ldmxcsr %0" : : "m" (mxcsr));
+    }
+    Save_FPU_State(s_initialFpuState);
+
+    /* Nobody owns the FPU yet, so the first use must trap */
+    g_fpuOwner = 0;
+    Set_CR0(cr0 | CR0_TS);
+
+    Print("FPU: %s state switching\n", s_haveFxsr ? "fxsave" : "fnsave");
+}
+
 /*
  * System call handler.
  */
@@ -65,6 +231,8 @@ static void Syscall_Handler(struct Interrupt_State* state)
  */
 void Init_Traps(void)
 {
+    Init_FPU();
+    Install_Interrupt_Handler(7, &FPU_Handler);   /* device not available */
     Install_Interrupt_Handler(12, &GPF_Handler);  /* stack exception */
     Install_Interrupt_Handler(13, &GPF_Handler);  /* general protection fault */
     Install_Interrupt_Handler(SYSCALL_INT, &Syscall_Handler);
@@ -51,22 +51,16 @@ void Attach_User_Context(struct Kernel_Thread* kthread, struct User_Context* con
     KASSERT(context != 0);
     kthread->userContext = context;
 
+    /* Threads created by Sys_CreateThread() share the context */
     Disable_Interrupts();
-
-    /*
-     * We don't actually allow multiple threads
-     * to share a user context (yet)
-     */
-    KASSERT(context->refCount == 0);
-
     ++context->refCount;
     Enable_Interrupts();
 }
 
 /*
- * If the given thread has a user context, detach it
- * and destroy it.  This is called when a thread is
- * being destroyed.
+ * If the given thread has a user context, detach it, and
+ * destroy it when the last thread sharing it goes away.
+ * This is called when a thread is being destroyed.
  */
 void Detach_User_Context(struct Kernel_Thread* kthread)
 {
@@ -81,6 +75,10 @@ void Detach_User_Context(struct Kernel_Thread* kthread)
 	    int refCount;
 
 	    Disable_Interrupts();
+	    if (kthread->userStackSlot != 0) {
+		Free_User_Thread_Stack(old, kthread->userStackSlot);
+		kthread->userStackSlot = 0;
+	    }
         --old->refCount;
 	    refCount = old->refCount;
 	    Enable_Interrupts();
@@ -206,6 +206,7 @@ static struct User_Context* Create_User_Context(ulong_t size) {
     uc->argBlockAddr = 0;
     uc->stackPointerAddr = 0;
     uc->refCount = 0;
+    uc->threadStacks = 1;
     uc->eUId = 0;
 
 #ifdef USERVM_DEBUG
@@ -711,6 +712,115 @@ bool Copy_To_User(ulong_t destInUser, void* srcInKernel, ulong_t numBytes)
     return __copy_to_user (context, destInUser, srcInKernel, numBytes);
 }
 
+/*
+ * Make the given page of the stack area a guard page, which the
+ * page fault handler never maps.  Fails if the page is in use.
+ * Must be called with interrupts disabled.
+ */
+static bool Set_Stack_Guard(pte_t* table, ulong_t page)
+{
+    pte_t* tab = table + PAGE_TABLE_INDEX(page);
+
+    if (tab->kernelInfo == KINFO_GUARD_PAGE)
+        return true;
+    if (tab->present || tab->kernelInfo == KINFO_PAGE_ON_DISK)
+        return false;
+    tab->kernelInfo = KINFO_GUARD_PAGE;
+    return true;
+}
+
+/*
+ * Reserve a stack slot for another thread in given user context,
+ * and map the top page of the stack.  Pages further down are
+ * allocated by the page fault handler as the stack grows, down to
+ * the guard page at the bottom of the slot.  The main stack gets
+ * its guard page with the first thread stack.
+ * Params:
+ *   context - the user context
+ *   pStackTop - where to store the initial stack pointer (user address)
+ * Returns:
+ *   the slot number (> 0), or an error code (< 0) if unsuccessful
+ */
+int Alloc_User_Thread_Stack(struct User_Context* context, ulong_t* pStackTop)
+{
+    pde_t* dir = context->pageDir + NUM_PAGE_DIR_ENTRIES-1;
+    pte_t* table;
+    pte_t* tab;
+    ulong_t topPage;
+    int slot;
+    bool iflag;
+
+    iflag = Begin_Int_Atomic();
+
+    for (slot = 1; slot < USER_MAX_THREADS; ++slot)
+        if (!(context->threadStacks & (1UL << slot)))
+            break;
+    if (slot == USER_MAX_THREADS) {
+        End_Int_Atomic(iflag);
+        return EBUSY;
+    }
+
+    /*
+     * Claim the slot before allocating: paging out to make room
+     * reenables interrupts, and another thread of the process
+     * must not pick the same slot meanwhile.
+     */
+    context->threadStacks |= 1UL << slot;
+
+    /* The main stack's page table covers all stack slots */
+    topPage = USER_STACK_PAGE_ADDR - slot * USER_THREAD_STACK_SIZE;
+    KASSERT(dir->present);
+    table = (pte_t*)(dir->pageTableBaseAddr << PAGE_POWER);
+    tab = table + PAGE_TABLE_INDEX(topPage);
+
+    /* Fails if the main stack has already grown into its guard page */
+    if (!Set_Stack_Guard(table, USER_STACK_PAGE_ADDR + PAGE_SIZE - USER_THREAD_STACK_SIZE) ||
+        !Set_Stack_Guard(table, topPage + PAGE_SIZE - USER_THREAD_STACK_SIZE)) {
+        context->threadStacks &= ~(1UL << slot);
+        End_Int_Atomic(iflag);
+        return ENOMEM;
+    }
+
+    /* A slot used before may still have its page (in memory or on disk) */
+    if (!tab->present && tab->kernelInfo != KINFO_PAGE_ON_DISK) {
+        void* stackPage = Alloc_Pageable_Page (tab, topPage);
+        if (stackPage == 0) {
+            context->threadStacks &= ~(1UL << slot);
+            End_Int_Atomic(iflag);
+            return ENOMEM;
+        }
+        tab->present = 1;
+        tab->flags = VM_WRITE | VM_READ | VM_EXEC | VM_USER;
+        tab->accesed = 0;
+        tab->dirty = 0;
+        tab->pteAttribute = 0;
+        tab->globalPage = 0;
+        tab->kernelInfo = 0;
+        tab->pageBaseAddr = (ulong_t) stackPage >> PAGE_POWER;
+        Flush_TLB();
+    }
+
+    End_Int_Atomic(iflag);
+
+    *pStackTop = topPage + PAGE_SIZE - USER_BASE_ADDRESS;
+    return slot;
+}
+
+/*
+ * Give back a stack slot reserved by Alloc_User_Thread_Stack().
+ * Its pages stay mapped, to be reused by the next thread.
+ */
+void Free_User_Thread_Stack(struct User_Context* context, int slot)
+{
+    bool iflag = Begin_Int_Atomic();
+
+    KASSERT(slot > 0 && slot < USER_MAX_THREADS);
+    KASSERT(context->threadStacks & (1UL << slot));
+    context->threadStacks &= ~(1UL << slot);
+
+    End_Int_Atomic(iflag);
+}
+
 /*
  * Switch to user address space.
  */
@@ -27,11 +27,13 @@
  * ---------------------------------------------------------------------- */
 
 /*
- * We use a single mutex to protect VFS data structures
- * from concurrent access/modification.  Simple, but not efficient.
- * Perhaps this should really be a reader/writer lock.
+ * A reader/writer lock protects the VFS data structures from
+ * concurrent access/modification.  Mount point lookups, done for
+ * every path, don't even take it: they retry if a mount happened
+ * meanwhile (mount points are never freed).
  */
-static struct Mutex s_vfsLock;
+static struct RW_Lock s_vfsLock = RW_LOCK_INITIALIZER(RW_FAIR);
+static struct Seq_Lock s_mountSeq = SEQ_LOCK_INITIALIZER;
 
 int debugVFS = 0;
 #define Debug(args...) if (debugVFS) Print("VFS: " args)
@@ -135,14 +137,14 @@ static struct Filesystem *Lookup_Filesystem(const char *fstype)
 {
     struct Filesystem *fs;
 
-    Mutex_Lock(&s_vfsLock);
+    RW_Read_Lock(&s_vfsLock);
     fs = Get_Front_Of_Filesystem_List(&s_filesystemList);
     while (fs != 0) {
 	if (strcmp(fs->fsName, fstype) == 0)
 	    break;
 	fs = Get_Next_In_Filesystem_List(fs);
     }
-    Mutex_Unlock(&s_vfsLock);
+    RW_Read_Unlock(&s_vfsLock);
 
     return fs;
 }
@@ -156,19 +158,20 @@ static struct Filesystem *Lookup_Filesystem(const char *fstype)
 static struct Mount_Point *Lookup_Mount_Point(const char *prefix)
 {
     struct Mount_Point *mountPoint;
-
-    Mutex_Lock(&s_vfsLock);
-
-    /* Look for a mounted filesystem with a matching prefix */
-    mountPoint = Get_Front_Of_Mount_Point_List(&s_mountPointList);
-    while (mountPoint != 0) {
-	Debug("Lookup mount point: %s,%s\n", prefix, mountPoint->pathPrefix);
-	if (strcmp(prefix, mountPoint->pathPrefix) == 0)
-	    break;
-	mountPoint = Get_Next_In_Mount_Point_List(mountPoint);
-    }
-
-    Mutex_Unlock(&s_vfsLock);
+    ulong_t seq;
+
+    do {
+	seq = Seq_Read_Begin(&s_mountSeq);
+
+	/* Look for a mounted filesystem with a matching prefix */
+	mountPoint = Get_Front_Of_Mount_Point_List(&s_mountPointList);
+	while (mountPoint != 0) {
+	    Debug("Lookup mount point: %s,%s\n", prefix, mountPoint->pathPrefix);
+	    if (strcmp(prefix, mountPoint->pathPrefix) == 0)
+		break;
+	    mountPoint = Get_Next_In_Mount_Point_List(mountPoint);
+	}
+    } while (Seq_Read_Retry(&s_mountSeq, seq));
 
     return mountPoint;
 }
@@ -257,9 +260,9 @@ bool Register_Filesystem(const char *fsName, struct Filesystem_Ops *fsOps)
     fs->fsName[VFS_MAX_FS_NAME_LEN] = '\0';
 
     /* Add the filesystem to the list */
-    Mutex_Lock(&s_vfsLock);
+    RW_Write_Lock(&s_vfsLock);
     Add_To_Back_Of_Filesystem_List(&s_filesystemList, fs);
-    Mutex_Unlock(&s_vfsLock);
+    RW_Write_Unlock(&s_vfsLock);
 
     return true;
 }
@@ -355,9 +358,11 @@ int Mount(const char *devname, const char *pathPrefix, const char *fstype)
      * FIXME: should ensure that there aren't any filesystems
      * mounted on the same filesystem root.
      */
-    Mutex_Lock(&s_vfsLock);
+    RW_Write_Lock(&s_vfsLock);
+    Seq_Write_Begin(&s_mountSeq);
     Add_To_Back_Of_Mount_Point_List(&s_mountPointList, mountPoint);
-    Mutex_Unlock(&s_vfsLock);
+    Seq_Write_End(&s_mountSeq);
+    RW_Write_Unlock(&s_vfsLock);
 
     return 0;
 
@@ -451,7 +456,7 @@ int Sync(void)
     int rc = 0;
     struct Mount_Point *mountPoint;
 
-    Mutex_Lock(&s_vfsLock);
+    RW_Read_Lock(&s_vfsLock);
     for (mountPoint = Get_Front_Of_Mount_Point_List(&s_mountPointList);
 	 mountPoint != 0;
 	 mountPoint = Get_Next_In_Mount_Point_List(mountPoint)) {
@@ -460,7 +465,7 @@ int Sync(void)
 	if (rc != 0)
 	    break;
     }
-    Mutex_Unlock(&s_vfsLock);
+    RW_Read_Unlock(&s_vfsLock);
 
     return rc;
 }
@@ -0,0 +1,233 @@
+/*
+ * Kernel work queue
+ *
+ * Deferred work is run by a pool of kernel threads that grows
+ * when work piles up and no worker is idle, and shrinks again
+ * when workers find the queue empty while another one is idle.
+ * Work may be queued from interrupt handlers, which can't start
+ * threads, so a manager thread grows the pool on their behalf.
+ * That way a worker blocking inside a work function never holds
+ * up the rest of the queue (unless all WORK_MAX_WORKERS block).
+ *
+ * This is free software.  You are permitted to use,
+ * redistribute, and modify it as specified in the file "COPYING".
+ */
+
+#include <geekos/kassert.h>
+#include <geekos/defs.h>
+#include <geekos/errno.h>
+#include <geekos/int.h>
+#include <geekos/kthread.h>
+#include <geekos/screen.h>
+#include <geekos/slab.h>
+#include <geekos/workqueue.h>
+
+IMPLEMENT_LIST(Work_List, Work_Item);
+
+/* Work waiting for a worker */
+static struct Work_List s_workList;
+
+/* Idle workers wait here */
+static struct Thread_Queue s_workerWaitQueue;
+
+static int s_numWorkers;
+static int s_idleWorkers;		/* workers in s_workerWaitQueue */
+
+/* The manager waits here until another worker is needed */
+static struct Thread_Queue s_managerWaitQueue;
+static bool s_needWorker;
+
+/* Statistics */
+static ulong_t s_workDone;
+static int s_maxWorkers;
+
+/* Items allocated by Queue_Work() */
+static struct Object_Cache s_workItemCache =
+    OBJECT_CACHE_INITIALIZER("work item", sizeof(struct Work_Item));
+
+static void Start_Worker(void);
+
+/*
+ * Hand queued work to an idle worker, or ask the manager for
+ * a new one if none is idle.
+ * Must be called with interrupts disabled.
+ */
+static void Dispatch_Work(void)
+{
+    KASSERT(!Interrupts_Enabled());
+
+    if (s_idleWorkers > 0) {
+	/* Count it as busy right away, so it isn't handed two items */
+	--s_idleWorkers;
+	Wake_Up_One(&s_workerWaitQueue);
+    } else if (s_numWorkers < WORK_MAX_WORKERS && !s_needWorker) {
+	s_needWorker = true;
+	Wake_Up(&s_managerWaitQueue);
+    }
+}
+
+/*
+ * Worker thread: run queued work items until the queue is empty,
+ * then either wait for more work or, if another worker is already
+ * waiting, exit.
+ */
+static void Worker(ulong_t arg)
+{
+    Disable_Interrupts();
+
+    while (true) {
+	struct Work_Item* item;
+	Work_Func func;
+	ulong_t funcArg;
+
+	if (Is_Work_List_Empty(&s_workList)) {
+	    if (s_idleWorkers > 0 && s_numWorkers > WORK_MIN_WORKERS) {
+		--s_numWorkers;
+		Exit(0);
+	    }
+	    ++s_idleWorkers;
+	    Wait_For(&s_workerWaitQueue, WAIT_WORK_QUEUE);	/* the waker uncounts us */
+	    continue;
+	}
+
+	item = Remove_From_Front_Of_Work_List(&s_workList);
+	item->pending = false;
+	func = item->func;
+	funcArg = item->arg;
+	if (item->allocated)
+	    Free_Object(&s_workItemCache, item);
+
+	/* More work behind this item: find someone else to do it */
+	if (!Is_Work_List_Empty(&s_workList))
+	    Dispatch_Work();
+	Enable_Interrupts();
+
+	func(funcArg);
+
+	Disable_Interrupts();
+	++s_workDone;
+    }
+}
+
+/*
+ * Manager thread: start a worker whenever queued work
+ * finds no idle worker.
+ */
+static void Work_Manager(ulong_t arg)
+{
+    Disable_Interrupts();
+
+    while (true) {
+	while (!s_needWorker)
+	    Wait_For(&s_managerWaitQueue, WAIT_WORK_QUEUE);
+	s_needWorker = false;
+
+	if (Is_Work_List_Empty(&s_workList) || s_numWorkers >= WORK_MAX_WORKERS)
+	    continue;
+
+	++s_numWorkers;
+	Enable_Interrupts();
+	Start_Worker();
+	Disable_Interrupts();
+    }
+}
+
+/*
+ * Start a worker thread; s_numWorkers must already count it.
+ */
+static void Start_Worker(void)
+{
+    if (Start_Kernel_Thread(Worker, 0, PRIORITY_NORMAL, true, "Worker") == 0) {
+	bool iflag = Begin_Int_Atomic();
+	--s_numWorkers;
+	End_Int_Atomic(iflag);
+	Print("Could not start worker thread\n");
+	return;
+    }
+
+    if (s_numWorkers > s_maxWorkers)
+	s_maxWorkers = s_numWorkers;
+}
+
+/*
+ * Prepare a work item that is not allocated by Queue_Work(),
+ * e.g. a static one which is scheduled again and again.
+ */
+void Init_Work_Item(struct Work_Item* item, Work_Func func, ulong_t arg)
+{
+    item->func = func;
+    item->arg = arg;
+    item->pending = false;
+    item->allocated = false;
+}
+
+/*
+ * Queue given work item, unless it is already queued and has
+ * not started yet.  May be called from interrupt handlers.
+ */
+void Schedule_Work(struct Work_Item* item)
+{
+    bool iflag = Begin_Int_Atomic();
+
+    if (!item->pending) {
+	item->pending = true;
+	Add_To_Back_Of_Work_List(&s_workList, item);
+	Dispatch_Work();
+    }
+
+    End_Int_Atomic(iflag);
+}
+
+/*
+ * Run func(arg) in a worker thread.  May be called from
+ * interrupt handlers.
+ * Returns 0 if successful, or ENOMEM if there isn't enough
+ * memory for the work item.
+ */
+int Queue_Work(Work_Func func, ulong_t arg)
+{
+    struct Work_Item* item = Alloc_Object(&s_workItemCache);
+
+    if (item == 0)
+	return ENOMEM;
+
+    Init_Work_Item(item, func, arg);
+    item->allocated = true;
+    Schedule_Work(item);
+    return 0;
+}
+
+/*
+ * Print the state of the worker pool.
+ */
+void Dump_Work_Queue_Info(void)
+{
+    bool iflag = Begin_Int_Atomic();
+    int queued = 0;
+    struct Work_Item* item;
+
+    for (item = Get_Front_Of_Work_List(&s_workList); item != 0;
+	 item = Get_Next_In_Work_List(item))
+	++queued;
+
+    Print("Work queue: %d workers (%d idle, max %d), %d queued, %lu done\n",
+	s_numWorkers, s_idleWorkers, s_maxWorkers, queued, s_workDone);
+
+    End_Int_Atomic(iflag);
+}
+
+/*
+ * Start the minimum number of workers, and the manager.
+ */
+void Init_Work_Queue(void)
+{
+    int i;
+
+    for (i = 0; i < WORK_MIN_WORKERS; ++i) {
+	++s_numWorkers;
+	Start_Worker();
+    }
+
+    if (Start_Kernel_Thread(Work_Manager, 0, PRIORITY_NORMAL, true, "Work Manager") == 0)
+	Print("Could not start work queue manager thread\n");
+}
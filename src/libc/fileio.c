@@ -48,6 +48,9 @@ DEF_SYSCALL(Seek,SYS_SEEK,int,(int fd, int pos),
 DEF_SYSCALL(Delete,SYS_DELETE,int,(const char *path),
     const char *arg0 = path; size_t arg1 = strlen(path);,
     SYSCALL_REGS_2)
+DEF_SYSCALL(Create_Ram_Disk,SYS_CREATERAMDISK,int,(int numBlocks),
+    int arg0 = numBlocks;,
+    SYSCALL_REGS_1)
 
 
 DEF_SYSCALL(Create_Pipe,SYS_CREATEPIPE,int,
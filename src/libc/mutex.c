@@ -0,0 +1,119 @@
+/*
+ * User mode mutexes and condition variables, built on futexes
+ *
+ * Locking and unlocking an uncontended mutex are a single atomic
+ * instruction each; the kernel is only entered to sleep while
+ * the mutex is held, and to wake up sleepers.
+ *
+ * This is free software.  You are permitted to use,
+ * redistribute, and modify it as specified in the file "COPYING".
+ */
+
+#include <geekos/syscall.h>
+#include <mutex.h>
+
+DEF_SYSCALL(Futex_Wait,SYS_FUTEX,int,(volatile int *addr, int val),
+    int arg0 = FUTEX_WAIT; volatile int *arg1 = addr; int arg2 = val;,
+    SYSCALL_REGS_3)
+DEF_SYSCALL(Futex_Wake,SYS_FUTEX,int,(volatile int *addr, int count),
+    int arg0 = FUTEX_WAKE; volatile int *arg1 = addr; int arg2 = count;,
+    SYSCALL_REGS_3)
+
+/* Wake up all waiters */
+#define WAKE_ALL 0x7fffffff
+
+/*
+ * Atomically replace *addr by value if it holds expected.
+ * Returns the previous value.
+ */
+static __inline__ int Compare_And_Swap(volatile int *addr, int expected, int value)
+{
+    int prev;
+    __asm__ __volatile__ ("lock; cmpxchgl %2, %1"
+	: "=a" (prev), "+m" (*addr) : "r" (value), "0" (expected) : "memory");
+    return prev;
+}
+
+/*
+ * Atomically store value in *addr.  Returns the previous value.
+ */
+static __inline__ int Exchange(volatile int *addr, int value)
+{
+    __asm__ __volatile__ ("xchgl %0, %1"
+	: "=r" (value), "+m" (*addr) : "0" (value) : "memory");
+    return value;
+}
+
+/*
+ * Atomically add value to *addr.
+ */
+static __inline__ void Atomic_Add(volatile int *addr, int value)
+{
+    __asm__ __volatile__ ("lock; addl %1, %0" : "+m" (*addr) : "ir" (value) : "memory");
+}
+
+void Mutex_Init(struct Mutex *mutex)
+{
+    mutex->state = MUTEX_UNLOCKED;
+}
+
+/*
+ * Lock a mutex whose state may have waiters.  Marks the mutex
+ * contended, so the thread unlocking it wakes up the next waiter.
+ */
+static void Mutex_Lock_Contended(struct Mutex *mutex)
+{
+    while (Exchange(&mutex->state, MUTEX_CONTENDED) != MUTEX_UNLOCKED)
+	Futex_Wait(&mutex->state, MUTEX_CONTENDED);
+}
+
+void Mutex_Lock(struct Mutex *mutex)
+{
+    if (Compare_And_Swap(&mutex->state, MUTEX_UNLOCKED, MUTEX_LOCKED) != MUTEX_UNLOCKED)
+	Mutex_Lock_Contended(mutex);
+}
+
+/*
+ * Lock a mutex if it is free.  Returns nonzero if it was locked.
+ */
+int Mutex_Try_Lock(struct Mutex *mutex)
+{
+    return Compare_And_Swap(&mutex->state, MUTEX_UNLOCKED, MUTEX_LOCKED) == MUTEX_UNLOCKED;
+}
+
+void Mutex_Unlock(struct Mutex *mutex)
+{
+    if (Exchange(&mutex->state, MUTEX_UNLOCKED) == MUTEX_CONTENDED)
+	Futex_Wake(&mutex->state, 1);
+}
+
+void Cond_Init(struct Condition *cond)
+{
+    cond->seq = 0;
+}
+
+/*
+ * Wait on a condition; the mutex must be locked by the caller.
+ * A signal after the mutex is released is not lost, since it
+ * changes the sequence number the kernel compares against.
+ */
+void Cond_Wait(struct Condition *cond, struct Mutex *mutex)
+{
+    int seq = cond->seq;
+
+    Mutex_Unlock(mutex);
+    Futex_Wait(&cond->seq, seq);
+    Mutex_Lock_Contended(mutex);
+}
+
+void Cond_Signal(struct Condition *cond)
+{
+    Atomic_Add(&cond->seq, 1);
+    Futex_Wake(&cond->seq, 1);
+}
+
+void Cond_Broadcast(struct Condition *cond)
+{
+    Atomic_Add(&cond->seq, 1);
+    Futex_Wake(&cond->seq, WAKE_ALL);
+}
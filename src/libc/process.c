@@ -26,6 +26,30 @@ DEF_SYSCALL(Spawn_Program,SYS_SPAWN,int,
 DEF_SYSCALL(Wait,SYS_WAIT,int,(int pid),int arg0 = pid;,SYSCALL_REGS_1)
 DEF_SYSCALL(Get_PID,SYS_GETPID,int,(void),,SYSCALL_REGS_0)
 DEF_SYSCALL(Print_ProcessList,SYS_PRINTPROCESSLIST,int,(void),,SYSCALL_REGS_0)
+static DEF_SYSCALL(Create_Thread_At,SYS_CREATETHREAD,int,
+    (void (*entry)(void (*)(void *), void *), void (*startFunc)(void *), void *arg),
+    void *arg0 = entry; void *arg1 = startFunc; void *arg2 = arg;,
+    SYSCALL_REGS_3)
+
+/*
+ * Where threads created by Create_Thread() start: run the thread
+ * function, and exit when it returns.
+ */
+static void Thread_Start(void (*startFunc)(void *), void *arg)
+{
+    startFunc(arg);
+    Exit(0);
+}
+
+/*
+ * Start a thread running startFunc(arg) in the address space of
+ * the calling process.  Returns its pid, which can be passed to
+ * Wait(), or an error code (< 0).
+ */
+int Create_Thread(void (*startFunc)(void *arg), void *arg)
+{
+    return Create_Thread_At(Thread_Start, startFunc, arg);
+}
 
 #define CMDLEN 79
 
@@ -12,7 +12,13 @@
 #include <string.h>
 
 DEF_SYSCALL(Set_Scheduling_Policy,SYS_SETSCHEDULINGPOLICY,int, (int policy, int quantum),
-    int arg0 = policy; int arg1 = quantum;,
-    SYSCALL_REGS_2)
+    int arg0 = policy; int arg1 = quantum; int arg2 = -1;,
+    SYSCALL_REGS_3)
+DEF_SYSCALL(Set_Scheduling_Aging,SYS_SETSCHEDULINGPOLICY,int, (int policy, int quantum, int agingTicks),
+    int arg0 = policy; int arg1 = quantum; int arg2 = agingTicks;,
+    SYSCALL_REGS_3)
+DEF_SYSCALL(Set_Real_Time,SYS_SETREALTIME,int, (int pid, int rtClass, int param, int budget),
+    int arg0 = pid; int arg1 = rtClass; int arg2 = param; int arg3 = budget;,
+    SYSCALL_REGS_4)
 DEF_SYSCALL(Get_Time_Of_Day,SYS_GETTIMEOFDAY,int,(void),,SYSCALL_REGS_0)
 
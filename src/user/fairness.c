@@ -0,0 +1,153 @@
+/*
+ * Fairness benchmark: runs CPU-bound jobs next to a steady stream
+ * of interactive (ping-pong) jobs and reports when each job completes.
+ *
+ * usage: fairness [rr|mlf|fair] <quantum> [<aging ticks>]
+ *
+ * The same program is spawned for the jobs, with "cpu", "ping"
+ * or "pong" as first argument and the common start time as second.
+ *
+ * This is free software.  You are permitted to use,
+ * redistribute, and modify it as specified in the file "COPYING".
+ */
+
+#include <conio.h>
+#include <process.h>
+#include <sched.h>
+#include <sema.h>
+#include <string.h>
+
+#define FAIRNESS_PROGRAM "/c/fairness.exe"
+
+#define NUM_CPU_JOBS 3
+#define NUM_IO_PAIRS 2
+
+/* Work units of a CPU-bound job, and rounds of an interactive job */
+#define CPU_JOB_WORK 300
+#define IO_JOB_ROUNDS 3000
+
+static void Report(const char *kind, int start)
+{
+    int scr_sem = Create_Semaphore("screen", 1);
+
+    P(scr_sem);
+    Print("  %-4s job pid %3d completed at %5d ticks\n",
+        kind, Get_PID(), Get_Time_Of_Day() - start);
+    V(scr_sem);
+}
+
+static void Cpu_Job(int start)
+{
+    volatile int sink = 0;
+    int i, j;
+
+    for (i = 0; i < CPU_JOB_WORK; i++)
+        for (j = 0; j < 10000; j++)
+            sink += i ^ j;
+
+    Report("cpu", start);
+}
+
+/*
+ * Bounce between two semaphores with a little work in between,
+ * so the job blocks long before using up its quantum.
+ */
+static void Io_Job(int start, int pair, bool ping)
+{
+    char name[32];
+    int mine, other;
+    volatile int sink = 0;
+    int i, j;
+
+    snprintf(name, sizeof(name), "fping%d", pair);
+    mine = Create_Semaphore(name, 1);
+    snprintf(name, sizeof(name), "fpong%d", pair);
+    other = Create_Semaphore(name, 0);
+    if (!ping) {
+        int tmp = mine;
+        mine = other;
+        other = tmp;
+    }
+
+    for (i = 0; i < IO_JOB_ROUNDS; i++) {
+        P(mine);
+        for (j = 0; j < 100; j++)
+            sink += j;
+        V(other);
+    }
+
+    Report(ping ? "ping" : "pong", start);
+}
+
+static int Spawn_Job(const char *kind, int start, int arg)
+{
+    char command[64];
+    int pid;
+
+    snprintf(command, sizeof(command), "%s %s %d %d", FAIRNESS_PROGRAM, kind, start, arg);
+    pid = Spawn_Program(FAIRNESS_PROGRAM, command, 0, 1);
+    if (pid < 0)
+        Print("Could not spawn %s job: %d\n", kind, pid);
+    return pid;
+}
+
+int main(int argc, char **argv)
+{
+    int policy;
+    int quantum;
+    int start;
+    int pids[NUM_CPU_JOBS + 2 * NUM_IO_PAIRS];
+    int numPids = 0;
+    int i, rc;
+
+    if (argc == 4 && !strcmp(argv[1], "cpu")) {
+        Cpu_Job(atoi(argv[2]));
+        return 0;
+    } else if (argc == 4 && (!strcmp(argv[1], "ping") || !strcmp(argv[1], "pong"))) {
+        Io_Job(atoi(argv[2]), atoi(argv[3]), !strcmp(argv[1], "ping"));
+        return 0;
+    }
+
+    if (argc != 3 && argc != 4) {
+        Print("usage: %s [rr|mlf|fair] <quantum> [<aging ticks>]\n", argv[0]);
+        return 1;
+    }
+
+    if (!strcmp(argv[1], "rr")) {
+        policy = 0;
+    } else if (!strcmp(argv[1], "mlf")) {
+        policy = 1;
+    } else if (!strcmp(argv[1], "fair")) {
+        policy = 2;
+    } else {
+        Print("usage: %s [rr|mlf|fair] <quantum> [<aging ticks>]\n", argv[0]);
+        return 1;
+    }
+    quantum = atoi(argv[2]);
+
+    if (argc == 4)
+        rc = Set_Scheduling_Aging(policy, quantum, atoi(argv[3]));
+    else
+        rc = Set_Scheduling_Policy(policy, quantum);
+    if (rc != 0) {
+        Print("Could not set scheduling policy: %d\n", rc);
+        return 1;
+    }
+
+    Print("Fairness benchmark: %d cpu jobs, %d ping-pong pairs\n", NUM_CPU_JOBS, NUM_IO_PAIRS);
+    start = Get_Time_Of_Day();
+
+    for (i = 0; i < NUM_IO_PAIRS; i++) {
+        pids[numPids++] = Spawn_Job("ping", start, i);
+        pids[numPids++] = Spawn_Job("pong", start, i);
+    }
+    for (i = 0; i < NUM_CPU_JOBS; i++)
+        pids[numPids++] = Spawn_Job("cpu", start, i);
+
+    for (i = 0; i < numPids; i++)
+        if (pids[i] >= 0)
+            Wait(pids[i]);
+
+    Print("All jobs completed at %d ticks\n", Get_Time_Of_Day() - start);
+    return 0;
+}
@@ -0,0 +1,20 @@
+/*
+ * iostat - Print I/O statistics of block devices
+ *
+ * This is free software.  You are permitted to use,
+ * redistribute, and modify it as specified in the file "COPYING".
+ */
+
+#include <conio.h>
+#include <process.h>
+#include <kernel.h>
+
+int main(int argc, char *argv[])
+{
+    if (argc != 1) {
+	Print("Usage: iostat\n");
+	Exit(1);
+    }
+
+    return Print_System_Info(SYS_INFO_BLOCKDEV);
+}
@@ -0,0 +1,37 @@
+/*
+ * ramdisk - Create a RAM disk block device
+ *
+ * This is free software.  You are permitted to use,
+ * redistribute, and modify it as specified in the file "COPYING".
+ */
+
+#include <conio.h>
+#include <process.h>
+#include <fileio.h>
+#include <string.h>
+
+int main(int argc, char *argv[])
+{
+    int sizeKB;
+    int rc;
+
+    if (argc != 2) {
+	Print("Usage: ramdisk <size in KB>\n");
+	Exit(1);
+    }
+
+    sizeKB = atoi(argv[1]);
+    if (sizeKB <= 0) {
+	Print("Error: Invalid size %s\n", argv[1]);
+	Exit(1);
+    }
+
+    rc = Create_Ram_Disk(sizeKB * 1024 / SECTOR_SIZE);
+    if (rc < 0) {
+	Print("Error: Could not create RAM disk: %s\n", Get_Error_String(rc));
+	Exit(1);
+    }
+
+    Print("Created ram%d (%d KB)\n", rc, sizeKB);
+    return 0;
+}
@@ -0,0 +1,71 @@
+/*
+ * rtset: run a program in a real-time scheduling class
+ *
+ * usage: rtset fifo <priority> <program> [<args>...]
+ *        rtset edf <period> <budget> <program> [<args>...]
+ *
+ * The program is started as a child of rtset, put in the given
+ * class, and waited for.  Its exit code is returned.
+ *
+ * This is free software.  You are permitted to use,
+ * redistribute, and modify it as specified in the file "COPYING".
+ */
+
+#include <conio.h>
+#include <process.h>
+#include <sched.h>
+#include <string.h>
+
+#define DEFAULT_PATH "/c:/d:/a"
+
+static void Usage(const char *prog)
+{
+    Print("usage: %s fifo <priority> <program> [<args>...]\n", prog);
+    Print("       %s edf <period> <budget> <program> [<args>...]\n", prog);
+    Exit(1);
+}
+
+int main(int argc, char **argv)
+{
+    char command[256];
+    int rtClass, param, budget = 0;
+    int first;
+    int i, pid, rc;
+
+    if (argc >= 4 && !strcmp(argv[1], "fifo")) {
+        rtClass = RT_FIFO;
+        param = atoi(argv[2]);
+        first = 3;
+    } else if (argc >= 5 && !strcmp(argv[1], "edf")) {
+        rtClass = RT_EDF;
+        param = atoi(argv[2]);
+        budget = atoi(argv[3]);
+        first = 4;
+    } else {
+        Usage(argv[0]);
+        return 1;
+    }
+
+    command[0] = '\0';
+    for (i = first; i < argc; i++) {
+        if (strlen(command) + strlen(argv[i]) + 2 > sizeof(command)) {
+            Print("%s: command too long\n", argv[0]);
+            return 1;
+        }
+        if (i > first)
+            strcat(command, " ");
+        strcat(command, argv[i]);
+    }
+
+    pid = Spawn_With_Path(argv[first], command, 0, 1, DEFAULT_PATH);
+    if (pid < 0) {
+        Print("%s: could not spawn %s: %d\n", argv[0], argv[first], pid);
+        return 1;
+    }
+
+    rc = Set_Real_Time(pid, rtClass, param, budget);
+    if (rc != 0)
+        Print("%s: could not set real-time class: %d\n", argv[0], rc);
+
+    return Wait(pid);
+}
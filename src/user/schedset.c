@@ -22,19 +22,26 @@ int main(int argc , char ** argv)
   int policy = -1;
   int quantum;
 
-  if (argc == 3) {
+  if (argc == 3 || (argc == 4 && !strcmp(argv[3], "adaptive"))) {
       if (!strcmp(argv[1], "rr")) {
-          policy = 0;
+          policy = SCHEDULE_ROUNDROBIN;
       } else if (!strcmp(argv[1], "mlf")) {
-          policy = 1;
+          policy = SCHEDULE_MLF;
+      } else if (!strcmp(argv[1], "fair")) {
+          policy = SCHEDULE_FAIR;
       } else {
-	  Print("usage: %s [rr|mlf] <quantum>\n", argv[0]);
+	  Print("usage: %s [rr|mlf|fair] <quantum> [adaptive]\n", argv[0]);
 	  Exit(1);
       }
       quantum = atoi(argv[2]);
-      Set_Scheduling_Policy(policy, quantum);
+      if (argc == 4)
+	  policy |= SCHEDULE_ADAPTIVE;	/* lengthen slices while few threads are runnable */
+      if (Set_Scheduling_Policy(policy, quantum) != 0) {
+	  Print("%s: could not set scheduling policy\n", argv[0]);
+	  Exit(1);
+      }
   } else {
-      Print("usage: %s [rr|mlf] <quantum>\n", argv[0]);
+      Print("usage: %s [rr|mlf|fair] <quantum> [adaptive]\n", argv[0]);
       Exit(1);
   }
   
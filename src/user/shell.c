@@ -88,6 +88,10 @@ int main(int argc, char **argv)
             Print_System_Info(SYS_INFO_PAGING|SYS_INFO_SCHEDULER);
             Print ("User id=%d\n", uid);
             continue;
+        } else if (strcmp(command, "locks") == 0) {
+            /* print lock and semaphore contention statistics to screen */
+            Print_System_Info(SYS_INFO_LOCKS|SYS_INFO_SEMAPHORES);
+            continue;
         } else if (strcmp(command, "paging-default") == 0) {
             Select_Paging_Algorithm(PAGING_DEFAULT);
             continue;
@@ -111,6 +115,7 @@ int main(int argc, char **argv)
                "   pid .............. print the process id of this shell\n"
                "   ps ............... show process information\n"
                "   info ............. show system information\n"
+               "   locks ............ show lock and semaphore statistics\n"
                "   paging-default ... set default paging algorithm\n"
                "   paging-wsclock ... set WS Clock paging algorithm\n"
                "   exitCodes ........ print exit codes of spawned processes\n"
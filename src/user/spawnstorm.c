@@ -0,0 +1,57 @@
+/*
+ * spawnstorm - Measure how fast processes can be created and destroyed
+ *
+ * usage: spawnstorm [<count>]
+ *
+ * Spawns itself (with the "-child" argument, which exits at once)
+ * count times in a row, waiting for each child, and reports the rate.
+ *
+ * This is free software.  You are permitted to use,
+ * redistribute, and modify it as specified in the file "COPYING".
+ */
+
+#include <conio.h>
+#include <process.h>
+#include <sched.h>
+#include <string.h>
+
+#define SPAWNSTORM_PROGRAM "/c/spawnstorm.exe"
+#define DEFAULT_COUNT 200
+
+/* Timer ticks per second, see <geekos/timer.c> */
+#define TICKS_PER_SEC 18
+
+int main(int argc, char **argv)
+{
+    int count = DEFAULT_COUNT;
+    int start, elapsed;
+    int i, pid;
+
+    if (argc == 2 && !strcmp(argv[1], "-child"))
+	return 0;
+
+    if (argc == 2)
+	count = atoi(argv[1]);
+    else if (argc != 1) {
+	Print("usage: %s [<count>]\n", argv[0]);
+	return 1;
+    }
+
+    start = Get_Time_Of_Day();
+    for (i = 0; i < count; i++) {
+	pid = Spawn_Program(SPAWNSTORM_PROGRAM, SPAWNSTORM_PROGRAM " -child", 0, 1);
+	if (pid < 0) {
+	    Print("spawn %d failed: %d\n", i, pid);
+	    return 1;
+	}
+	Wait(pid);
+    }
+    elapsed = Get_Time_Of_Day() - start;
+
+    Print("%d processes in %d ticks", count, elapsed);
+    if (elapsed > 0)
+	Print(", %d per second", count * TICKS_PER_SEC / elapsed);
+    Print("\n");
+
+    return 0;
+}
@@ -0,0 +1,87 @@
+/*
+ * Sums an array with several threads sharing the address space
+ * of the process, and checks the result against a plain loop.
+ * The partial sums are added up under a futex-based mutex.
+ *
+ * usage: threads [<number of threads>]
+ *
+ * This is free software.  You are permitted to use,
+ * redistribute, and modify it as specified in the file "COPYING".
+ */
+
+#include <conio.h>
+#include <mutex.h>
+#include <process.h>
+#include <sched.h>
+#include <string.h>
+
+#define MAX_THREADS 16
+#define NUM_VALUES 65536
+
+static int s_values[NUM_VALUES];
+
+/* Work of one thread: a range of s_values, and its partial sum */
+struct Slice {
+    int start, end;
+    int sum;
+};
+
+static struct Slice s_slices[MAX_THREADS];
+
+static struct Mutex s_totalLock = MUTEX_INITIALIZER;
+static int s_total;
+
+static void Sum_Slice(void *arg)
+{
+    struct Slice *slice = arg;
+    int i, sum = 0;
+
+    for (i = slice->start; i < slice->end; i++)
+        sum += s_values[i];
+    slice->sum = sum;
+
+    Mutex_Lock(&s_totalLock);
+    s_total += sum;
+    Mutex_Unlock(&s_totalLock);
+}
+
+int main(int argc, char **argv)
+{
+    int numThreads = 4;
+    int pids[MAX_THREADS];
+    int i, sum, expected = 0;
+    int start;
+
+    if (argc == 2)
+        numThreads = atoi(argv[1]);
+    if (argc > 2 || numThreads < 1 || numThreads > MAX_THREADS) {
+        Print("usage: %s [<number of threads (1..%d)>]\n", argv[0], MAX_THREADS);
+        return 1;
+    }
+
+    for (i = 0; i < NUM_VALUES; i++) {
+        s_values[i] = i % 1000;
+        expected += s_values[i];
+    }
+
+    start = Get_Time_Of_Day();
+    for (i = 0; i < numThreads; i++) {
+        s_slices[i].start = i * (NUM_VALUES / numThreads);
+        s_slices[i].end = (i == numThreads - 1) ? NUM_VALUES : (i + 1) * (NUM_VALUES / numThreads);
+        pids[i] = Create_Thread(Sum_Slice, &s_slices[i]);
+        if (pids[i] < 0) {
+            Print("Could not create thread: %d\n", pids[i]);
+            return 1;
+        }
+    }
+
+    sum = 0;
+    for (i = 0; i < numThreads; i++) {
+        Wait(pids[i]);
+        sum += s_slices[i].sum;
+    }
+
+    Print("%d threads: sum %d, total %d (%s) in %d ticks\n", numThreads, sum, s_total,
+        sum == expected && s_total == expected ? "ok" : "WRONG", Get_Time_Of_Day() - start);
+    return sum == expected && s_total == expected ? 0 : 1;
+}
@@ -0,0 +1,20 @@
+/*
+ * top - Print scheduling statistics of all threads
+ *
+ * This is free software.  You are permitted to use,
+ * redistribute, and modify it as specified in the file "COPYING".
+ */
+
+#include <conio.h>
+#include <process.h>
+#include <kernel.h>
+
+int main(int argc, char *argv[])
+{
+    if (argc != 1) {
+	Print("Usage: top\n");
+	Exit(1);
+    }
+
+    return Print_System_Info(SYS_INFO_SCHEDULER | SYS_INFO_THREADS);
+}
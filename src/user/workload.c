@@ -53,14 +53,16 @@ int main(int argc , char ** argv)
           policy = 0;
       } else if (!strcmp(argv[1], "mlf")) {
           policy = 1;
+      } else if (!strcmp(argv[1], "fair")) {
+          policy = 2;
       } else {
-	  Print("usage: %s [rr|mlf] <quantum>\n", argv[0]);
+	  Print("usage: %s [rr|mlf|fair] <quantum>\n", argv[0]);
 	  Exit(1);
       }
       quantum = atoi(argv[2]);
       Set_Scheduling_Policy(policy, quantum);
   } else {
-      Print("usage: %s [rr|mlf] <quantum>\n", argv[0]);
+      Print("usage: %s [rr|mlf|fair] <quantum>\n", argv[0]);
       Exit(1);
   }
 